@@ -16,10 +16,26 @@
 
 #include "blob.h"
 
+#include <filesystem>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/calib3d.hpp>
 
+namespace fs = std::filesystem;
+
 void show(cv::Mat& matrix, const char* window, int width, int height)
 {
     cv::namedWindow(window, cv::WINDOW_NORMAL);
@@ -29,6 +45,587 @@ void show(cv::Mat& matrix, const char* window, int width, int height)
     cv::destroyAllWindows();
 }
 
+// ============================================================================
+
+// runtime dispatch of the hot pixel kernels. each kernel is compiled for a few
+// instruction sets through target attributes, so that one binary built with
+// plain -O2 runs on any x86 node, and the best set the cpu supports is chosen
+// at startup by cpuid, or forced by --isa. the scalar kernels are the original
+// loops and stay as the reference: every variant writes the same bytes and
+// returns the same sums, which blobbench --check verifies.
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define isa_x86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define isa_target(x)
+#else
+#include <cpuid.h>
+#define isa_target(x) __attribute__((target(x)))
+#endif
+#endif
+
+typedef struct isa_kernels {
+    const char* name;
+
+    // row[i] = 255 - row[i].
+    void (*invert)(uchar* row, int n);
+
+    // the count of the non-zero bytes.
+    int (*count)(const uchar* row, int n);
+
+    // the color significance of n hsv pixels. cosines holds the cosine term
+    // of each of the 256 hues, for the kernels that look it up.
+    void (*significance)(const uchar* hsv, uchar* out, int n, double orient, const double* cosines);
+
+    // one row of a flank: out[w] = the bilinear sample at (ox + w * dx + hx,
+    // oy + w * dy + hy) for the points within the image.
+    void (*flank_row)(
+        const uchar* data, size_t step, int cols, int rows, uchar* out, int n,
+        double ox, double dx, double hx, double oy, double dy, double hy);
+
+    // the sum and the count of the bytes under the non-zero mask bytes.
+    void (*masked_sum)(const uchar* row, const uchar* mask, int n, uint64_t& sum, uint64_t& count);
+} isa_kernels_t;
+
+// the bilinear sample of get_bilinear, on the raw rows of a matrix.
+
+static inline uchar bilinear_at(const uchar* data, size_t step, int cols, int rows, double x, double y)
+{
+    int borderx = -1, bordery = -1;
+    if (x < 0)
+        borderx = 0;
+    if (y < 0)
+        bordery = 0;
+    if (x >= cols)
+        borderx = cols - 1;
+    if (y >= rows)
+        bordery = rows - 1;
+
+    if (borderx != -1 && bordery != -1)
+        return data[bordery * step + borderx];
+
+    if (borderx != -1)
+    {
+        uchar y1 = data[int(floor(y)) * step + borderx];
+        uchar y2 = data[int(ceil(y)) * step + borderx];
+        return uchar(int(y1 + (y2 - y1) * (y - floor(y))));
+    }
+
+    if (bordery != -1)
+    {
+        uchar x1 = data[bordery * step + int(floor(x))];
+        uchar x2 = data[bordery * step + int(ceil(x))];
+        return uchar(int(x1 + (x2 - x1) * (x - floor(x))));
+    }
+
+    return bilinear(
+        data[int(floor(y)) * step + int(floor(x))],
+        data[int(floor(y)) * step + int(ceil(x))],
+        data[int(ceil(y)) * step + int(floor(x))],
+        data[int(ceil(y)) * step + int(ceil(x))],
+        x - floor(x), y - floor(y));
+}
+
+// the lround of the non-negative x, as the truncation plus one if the exact
+// fraction reaches a half.
+
+static inline uchar round_level(double x)
+{
+    double t = trunc(x);
+    return (uchar) (t + (x - t >= 0.5 ? 1 : 0));
+}
+
+// scalar, the reference.
+
+static void invert_scalar(uchar* row, int n)
+{
+    for (int i = 0; i < n; i++) row[i] = 255 - row[i];
+}
+
+static int count_scalar(const uchar* row, int n)
+{
+    int count = 0;
+    for (int i = 0; i < n; i++)
+        if (row[i] > 0) count += 1;
+    return count;
+}
+
+static void significance_scalar(const uchar* hsv, uchar* out, int n, double orient, const double* cosines)
+{
+    for (int i = 0; i < n; i++)
+    {
+        double hue = 2.0 * hsv[3 * i];
+        double proj = cos((hue - orient) * CV_PI / 180.0) *
+            (hsv[3 * i + 1] / 255.0) *
+            (hsv[3 * i + 2] / 255.0);
+
+        if (proj < 0)
+            proj = 0;
+        out[i] = (uchar)lround(proj * 255);
+    }
+}
+
+// the points [begin, end) of a flank row, one at a time.
+
+static inline void flank_points(
+    const uchar* data, size_t step, int cols, int rows, uchar* out, int begin, int end,
+    double ox, double dx, double hx, double oy, double dy, double hy)
+{
+    for (int w = begin; w < end; w++)
+    {
+        double x = ox + w * dx + hx;
+        double y = oy + w * dy + hy;
+
+        if (x > cols || y > rows || x < 0 || y < 0)
+            continue;
+        out[w] = bilinear_at(data, step, cols, rows, x, y);
+    }
+}
+
+static void flank_row_scalar(
+    const uchar* data, size_t step, int cols, int rows, uchar* out, int n,
+    double ox, double dx, double hx, double oy, double dy, double hy)
+{
+    flank_points(data, step, cols, rows, out, 0, n, ox, dx, hx, oy, dy, hy);
+}
+
+static void masked_sum_scalar(const uchar* row, const uchar* mask, int n, uint64_t& sum, uint64_t& count)
+{
+    for (int i = 0; i < n; i++)
+        if (mask[i] != 0) { sum += row[i]; count += 1; }
+}
+
+// the significance of the pixels from i on, by the table of cosines.
+
+static inline void significance_tail(const uchar* hsv, uchar* out, int i, int n, const double* cosines)
+{
+    for (; i < n; i++)
+    {
+        double proj = cosines[hsv[3 * i]] * (hsv[3 * i + 1] / 255.0) * (hsv[3 * i + 2] / 255.0);
+        if (proj < 0)
+            proj = 0;
+        out[i] = round_level(proj * 255);
+    }
+}
+
+static isa_kernels_t scalar_kernels = {
+    "scalar", invert_scalar, count_scalar, significance_scalar,
+    flank_row_scalar, masked_sum_scalar
+};
+
+#ifdef isa_x86
+
+static inline int popcount32(uint32_t x)
+{
+#ifdef _MSC_VER
+    return (int) __popcnt(x);
+#else
+    return __builtin_popcount(x);
+#endif
+}
+
+static inline int popcount64(uint64_t x)
+{
+#ifdef _MSC_VER
+    return (int) __popcnt64(x);
+#else
+    return __builtin_popcountll(x);
+#endif
+}
+
+// sse4.2, 16 bytes or 2 doubles a step.
+
+isa_target("sse4.2")
+static void invert_sse42(uchar* row, int n)
+{
+    const __m128i ones = _mm_set1_epi8(-1);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (row + i));
+        _mm_storeu_si128((__m128i*) (row + i), _mm_xor_si128(v, ones));
+    }
+    invert_scalar(row + i, n - i);
+}
+
+isa_target("sse4.2")
+static int count_sse42(const uchar* row, int n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int count = 0, i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (row + i));
+        count += 16 - popcount32(_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)));
+    }
+    return count + count_scalar(row + i, n - i);
+}
+
+isa_target("sse4.2")
+static void significance_sse42(const uchar* hsv, uchar* out, int n, double orient, const double* cosines)
+{
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d full = _mm_set1_pd(255.0);
+    const __m128d half = _mm_set1_pd(0.5);
+    const __m128d one = _mm_set1_pd(1.0);
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        const uchar* p = hsv + 3 * i;
+        __m128d c = _mm_setr_pd(cosines[p[0]], cosines[p[3]]);
+        __m128d s = _mm_div_pd(_mm_setr_pd(p[1], p[4]), full);
+        __m128d v = _mm_div_pd(_mm_setr_pd(p[2], p[5]), full);
+        __m128d proj = _mm_max_pd(_mm_mul_pd(_mm_mul_pd(c, s), v), zero);
+        __m128d x = _mm_mul_pd(proj, full);
+        __m128d t = _mm_round_pd(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        t = _mm_add_pd(t, _mm_and_pd(_mm_cmpge_pd(_mm_sub_pd(x, t), half), one));
+        __m128i r = _mm_cvttpd_epi32(t);
+        out[i] = (uchar) _mm_cvtsi128_si32(r);
+        out[i + 1] = (uchar) _mm_extract_epi32(r, 1);
+    }
+    significance_tail(hsv, out, i, n, cosines);
+}
+
+isa_target("sse4.2")
+static void masked_sum_sse42(const uchar* row, const uchar* mask, int n, uint64_t& sum, uint64_t& count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i off = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (mask + i)), zero);
+        __m128i v = _mm_andnot_si128(off, _mm_loadu_si128((const __m128i*) (row + i)));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+        count += 16 - popcount32(_mm_movemask_epi8(off));
+    }
+    sum += (uint64_t) _mm_cvtsi128_si64(acc) + (uint64_t) _mm_extract_epi64(acc, 1);
+    masked_sum_scalar(row + i, mask + i, n - i, sum, count);
+}
+
+static isa_kernels_t sse42_kernels = {
+    "sse4.2", invert_sse42, count_sse42, significance_sse42,
+    flank_row_scalar, masked_sum_sse42
+};
+
+// avx2, 32 bytes or 4 doubles a step. the target has no fma, so that the
+// products and sums round as in the scalar code.
+
+isa_target("avx2")
+static void invert_avx2(uchar* row, int n)
+{
+    const __m256i ones = _mm256_set1_epi8(-1);
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (row + i));
+        _mm256_storeu_si256((__m256i*) (row + i), _mm256_xor_si256(v, ones));
+    }
+    invert_scalar(row + i, n - i);
+}
+
+isa_target("avx2")
+static int count_avx2(const uchar* row, int n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    int count = 0, i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (row + i));
+        count += 32 - popcount32((uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)));
+    }
+    return count + count_scalar(row + i, n - i);
+}
+
+isa_target("avx2")
+static void significance_avx2(const uchar* hsv, uchar* out, int n, double orient, const double* cosines)
+{
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d full = _mm256_set1_pd(255.0);
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d one = _mm256_set1_pd(1.0);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const uchar* p = hsv + 3 * i;
+        __m128i h = _mm_setr_epi32(p[0], p[3], p[6], p[9]);
+        __m128i s = _mm_setr_epi32(p[1], p[4], p[7], p[10]);
+        __m128i v = _mm_setr_epi32(p[2], p[5], p[8], p[11]);
+        __m256d c = _mm256_i32gather_pd(cosines, h, 8);
+        __m256d proj = _mm256_mul_pd(
+            _mm256_mul_pd(c, _mm256_div_pd(_mm256_cvtepi32_pd(s), full)),
+            _mm256_div_pd(_mm256_cvtepi32_pd(v), full));
+        proj = _mm256_max_pd(proj, zero);
+        __m256d x = _mm256_mul_pd(proj, full);
+        __m256d t = _mm256_round_pd(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        t = _mm256_add_pd(t, _mm256_and_pd(_mm256_cmp_pd(_mm256_sub_pd(x, t), half, _CMP_GE_OQ), one));
+        __m128i r = _mm256_cvttpd_epi32(t);
+        r = _mm_packus_epi16(_mm_packus_epi32(r, r), r);
+        uint32_t bytes = (uint32_t) _mm_cvtsi128_si32(r);
+        memcpy(out + i, &bytes, 4);
+    }
+    significance_tail(hsv, out, i, n, cosines);
+}
+
+// the points whose four neighbours are inside the image, and not within the
+// first three bytes, are sampled four at a time: each neighbour is gathered as
+// the top byte of the 32-bit word ending on it, so that no byte past it is
+// read. the other points go through the scalar sample.
+
+isa_target("avx2")
+static void flank_row_avx2(
+    const uchar* data, size_t step, int cols, int rows, uchar* out, int n,
+    double ox, double dx, double hx, double oy, double dy, double hy)
+{
+    const __m256d lanes = _mm256_setr_pd(0, 1, 2, 3);
+    const __m256d vox = _mm256_set1_pd(ox), vdx = _mm256_set1_pd(dx), vhx = _mm256_set1_pd(hx);
+    const __m256d voy = _mm256_set1_pd(oy), vdy = _mm256_set1_pd(dy), vhy = _mm256_set1_pd(hy);
+    const __m256d vstep = _mm256_set1_pd((double) step);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d xlast = _mm256_set1_pd(cols - 1), ylast = _mm256_set1_pd(rows - 1);
+    const __m256d three = _mm256_set1_pd(3);
+    const int* base = (const int*) (data - 3);
+
+    int w = 0;
+    for (; w + 4 <= n; w += 4) {
+        __m256d vw = _mm256_add_pd(_mm256_set1_pd(w), lanes);
+        __m256d x = _mm256_add_pd(_mm256_add_pd(vox, _mm256_mul_pd(vw, vdx)), vhx);
+        __m256d y = _mm256_add_pd(_mm256_add_pd(voy, _mm256_mul_pd(vw, vdy)), vhy);
+        __m256d fx = _mm256_floor_pd(x), fy = _mm256_floor_pd(y);
+        __m256d cx = _mm256_ceil_pd(x), cy = _mm256_ceil_pd(y);
+        __m256d top = _mm256_mul_pd(fy, vstep), bottom = _mm256_mul_pd(cy, vstep);
+        __m256d first = _mm256_add_pd(top, fx);
+
+        __m256d inside = _mm256_and_pd(
+            _mm256_and_pd(_mm256_cmp_pd(x, zero, _CMP_GE_OQ), _mm256_cmp_pd(y, zero, _CMP_GE_OQ)),
+            _mm256_and_pd(_mm256_cmp_pd(x, xlast, _CMP_LT_OQ), _mm256_cmp_pd(y, ylast, _CMP_LT_OQ)));
+        inside = _mm256_and_pd(inside, _mm256_cmp_pd(first, three, _CMP_GE_OQ));
+
+        if (_mm256_movemask_pd(inside) != 15) {
+            flank_points(data, step, cols, rows, out, w, w + 4, ox, dx, hx, oy, dy, hy);
+            continue;
+        }
+
+        __m128i o1 = _mm256_cvttpd_epi32(first);
+        __m128i o2 = _mm256_cvttpd_epi32(_mm256_add_pd(top, cx));
+        __m128i o3 = _mm256_cvttpd_epi32(_mm256_add_pd(bottom, fx));
+        __m128i o4 = _mm256_cvttpd_epi32(_mm256_add_pd(bottom, cx));
+        __m128i p1 = _mm_srli_epi32(_mm_i32gather_epi32(base, o1, 1), 24);
+        __m128i p2 = _mm_srli_epi32(_mm_i32gather_epi32(base, o2, 1), 24);
+        __m128i p3 = _mm_srli_epi32(_mm_i32gather_epi32(base, o3, 1), 24);
+        __m128i p4 = _mm_srli_epi32(_mm_i32gather_epi32(base, o4, 1), 24);
+
+        __m256d rx = _mm256_sub_pd(x, fx), ry = _mm256_sub_pd(y, fy);
+        __m256d x1 = _mm256_add_pd(_mm256_cvtepi32_pd(p1),
+                                   _mm256_mul_pd(_mm256_cvtepi32_pd(_mm_sub_epi32(p2, p1)), rx));
+        __m256d x2 = _mm256_add_pd(_mm256_cvtepi32_pd(p3),
+                                   _mm256_mul_pd(_mm256_cvtepi32_pd(_mm_sub_epi32(p4, p3)), rx));
+        __m256d r = _mm256_add_pd(x1, _mm256_mul_pd(_mm256_sub_pd(x2, x1), ry));
+
+        __m128i v = _mm256_cvttpd_epi32(r);
+        v = _mm_packus_epi16(_mm_packus_epi32(v, v), v);
+        uint32_t bytes = (uint32_t) _mm_cvtsi128_si32(v);
+        memcpy(out + w, &bytes, 4);
+    }
+
+    flank_points(data, step, cols, rows, out, w, n, ox, dx, hx, oy, dy, hy);
+}
+
+isa_target("avx2")
+static void masked_sum_avx2(const uchar* row, const uchar* mask, int n, uint64_t& sum, uint64_t& count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i off = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (mask + i)), zero);
+        __m256i v = _mm256_andnot_si256(off, _mm256_loadu_si256((const __m256i*) (row + i)));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+        count += 32 - popcount32((uint32_t) _mm256_movemask_epi8(off));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*) lanes, acc);
+    sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    masked_sum_scalar(row + i, mask + i, n - i, sum, count);
+}
+
+static isa_kernels_t avx2_kernels = {
+    "avx2", invert_avx2, count_avx2, significance_avx2,
+    flank_row_avx2, masked_sum_avx2
+};
+
+// avx-512 (f and bw), 64 bytes or 8 doubles a step. the flank stays on the
+// avx2 kernel, whose gathers already bound it.
+
+isa_target("avx512f,avx512bw")
+static void invert_avx512(uchar* row, int n)
+{
+    const __m512i ones = _mm512_set1_epi8(-1);
+    int i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void*) (row + i));
+        _mm512_storeu_si512((void*) (row + i), _mm512_xor_si512(v, ones));
+    }
+    invert_scalar(row + i, n - i);
+}
+
+isa_target("avx512f,avx512bw")
+static int count_avx512(const uchar* row, int n)
+{
+    int count = 0, i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void*) (row + i));
+        count += popcount64(_mm512_test_epi8_mask(v, v));
+    }
+    return count + count_scalar(row + i, n - i);
+}
+
+isa_target("avx512f,avx512bw")
+static void significance_avx512(const uchar* hsv, uchar* out, int n, double orient, const double* cosines)
+{
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512d full = _mm512_set1_pd(255.0);
+    const __m512d half = _mm512_set1_pd(0.5);
+    const __m512d one = _mm512_set1_pd(1.0);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const uchar* p = hsv + 3 * i;
+        __m256i h = _mm256_setr_epi32(p[0], p[3], p[6], p[9], p[12], p[15], p[18], p[21]);
+        __m256i s = _mm256_setr_epi32(p[1], p[4], p[7], p[10], p[13], p[16], p[19], p[22]);
+        __m256i v = _mm256_setr_epi32(p[2], p[5], p[8], p[11], p[14], p[17], p[20], p[23]);
+        __m512d c = _mm512_i32gather_pd(h, cosines, 8);
+        __m512d proj = _mm512_mul_pd(
+            _mm512_mul_pd(c, _mm512_div_pd(_mm512_cvtepi32_pd(s), full)),
+            _mm512_div_pd(_mm512_cvtepi32_pd(v), full));
+        proj = _mm512_max_pd(proj, zero);
+        __m512d x = _mm512_mul_pd(proj, full);
+        __m512d t = _mm512_roundscale_pd(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        __mmask8 up = _mm512_cmp_pd_mask(_mm512_sub_pd(x, t), half, _CMP_GE_OQ);
+        t = _mm512_mask_add_pd(t, up, t, one);
+        __m128i r = _mm512_cvtepi32_epi8(_mm512_castsi256_si512(_mm512_cvttpd_epi32(t)));
+        _mm_storel_epi64((__m128i*) (out + i), r);
+    }
+    significance_tail(hsv, out, i, n, cosines);
+}
+
+isa_target("avx512f,avx512bw")
+static void masked_sum_avx512(const uchar* row, const uchar* mask, int n, uint64_t& sum, uint64_t& count)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    __m512i acc = _mm512_setzero_si512();
+    int i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i m = _mm512_loadu_si512((const void*) (mask + i));
+        __mmask64 on = _mm512_test_epi8_mask(m, m);
+        __m512i v = _mm512_maskz_mov_epi8(on, _mm512_loadu_si512((const void*) (row + i)));
+        acc = _mm512_add_epi64(acc, _mm512_sad_epu8(v, zero));
+        count += popcount64(on);
+    }
+    uint64_t lanes[8];
+    _mm512_storeu_si512((void*) lanes, acc);
+    for (int k = 0; k < 8; k++) sum += lanes[k];
+    masked_sum_scalar(row + i, mask + i, n - i, sum, count);
+}
+
+static isa_kernels_t avx512_kernels = {
+    "avx512", invert_avx512, count_avx512, significance_avx512,
+    flank_row_avx2, masked_sum_avx512
+};
+
+// the instruction sets the cpu and the operating system support: sse4.2
+// (with ssse3 and sse4.1), avx2 (with the ymm state saved), and avx-512 f and
+// bw (with the zmm and mask states saved).
+
+static void cpuid(int leaf, int sub, int* regs)
+{
+#ifdef _MSC_VER
+    __cpuidex(regs, leaf, sub);
+#else
+    unsigned a, b, c, d;
+    __cpuid_count(leaf, sub, a, b, c, d);
+    regs[0] = a; regs[1] = b; regs[2] = c; regs[3] = d;
+#endif
+}
+
+static uint64_t xgetbv0()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+    __asm__ volatile ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+    return ((uint64_t) hi << 32) | lo;
+#endif
+}
+
+static int isa_supported()
+{
+    int regs[4];
+    cpuid(0, 0, regs);
+    int leaves = regs[0];
+
+    cpuid(1, 0, regs);
+    bool ssse3 = regs[2] & (1 << 9), sse41 = regs[2] & (1 << 19), sse42 = regs[2] & (1 << 20);
+    bool osxsave = regs[2] & (1 << 27), avx = regs[2] & (1 << 28);
+    if (!(ssse3 && sse41 && sse42)) return 0;
+
+    uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+    if (!avx || (xcr0 & 0x6) != 0x6 || leaves < 7) return 1;
+
+    cpuid(7, 0, regs);
+    bool avx2 = regs[1] & (1 << 5);
+    bool avx512f = regs[1] & (1 << 16), avx512bw = regs[1] & (1 << 30);
+    if (!avx2) return 1;
+    if (!avx512f || !avx512bw || (xcr0 & 0xe6) != 0xe6) return 2;
+    return 3;
+}
+
+static isa_kernels_t* isa_all[4] = { &scalar_kernels, &sse42_kernels, &avx2_kernels, &avx512_kernels };
+
+#else
+
+static int isa_supported() { return 0; }
+static isa_kernels_t* isa_all[1] = { &scalar_kernels };
+
+#endif
+
+// the best kernels are selected before main, so that the tools not calling
+// isa_open use them as well.
+
+static int isa_best = isa_supported();
+static isa_kernels_t* kernels = isa_all[isa_best];
+
+// select the kernels by name ("scalar", "sse4.2", "avx2", "avx512"), or the
+// best supported if the name is empty or "auto", and print the selection.
+
+bool isa_open(const char* name, bool show_msg)
+{
+    int level = isa_best;
+    if (name != NULL && name[0] != 0 && strcmp(name, "auto") != 0) {
+        const char* names[4] = { "scalar", "sse4.2", "avx2", "avx512" };
+        level = -1;
+        for (int i = 0; i < 4; i++)
+            if (strcmp(name, names[i]) == 0) level = i;
+
+        if (level < 0) {
+            printf("[e] unknown instruction set %s (scalar, sse4.2, avx2, avx512 or auto). \n", name);
+            return false;
+        }
+
+        if (level > isa_best) {
+            printf("[e] the cpu does not support %s. \n", name);
+            return false;
+        }
+    }
+
+    kernels = isa_all[level];
+    if (show_msg)
+        printf("[i] kernels: %s, of up to %s supported. \n", kernels -> name, isa_all[isa_best] -> name);
+    return true;
+}
+
+const char* isa_name()
+{
+    return kernels -> name;
+}
+
+// ============================================================================
+
 void reverse(cv::Mat& binary)
 {
     int width = binary.size().width;
@@ -37,10 +634,7 @@ void reverse(cv::Mat& binary)
     for (int line = 0; line < height; line++)
     {
         uchar* row = binary.ptr<uchar>(line);
-        for (int col = 1; col < width; col++)
-        {
-            row[col] = 255 - row[col];
-        }
+        kernels -> invert(row + 1, width - 1);
     }
 }
 
@@ -53,22 +647,17 @@ void color_significance(cv::Mat& hsv, cv::Mat& grayscale, double orient)
     int width = hsv.size().width;
     int height = hsv.size().height;
 
+    // the cosine term of each hue, as the scalar kernel computes it.
+
+    double cosines[256];
+    for (int h = 0; h < 256; h++)
+        cosines[h] = cos((2.0 * h - orient) * CV_PI / 180.0);
+
     for (int line = 0; line < height; line++)
     {
-        cv::Vec3b* rhsv = hsv.ptr<cv::Vec3b>(line);
+        uchar* rhsv = hsv.ptr<uchar>(line);
         uchar* rgray = grayscale.ptr<uchar>(line);
-
-        for (int col = 1; col < width; col++)
-        {
-            double hue = 2.0 * rhsv[col][0];
-            double proj = cos((hue - orient) * CV_PI / 180.0) *
-                (rhsv[col][1] / 255.0) *
-                (rhsv[col][2] / 255.0);
-
-            if (proj < 0)
-                proj = 0;
-            rgray[col] = (uchar)lround(proj * 255);
-        }
+        kernels -> significance(rhsv + 3, rgray + 1, width - 1, orient, cosines);
     }
 }
 
@@ -250,39 +839,7 @@ uchar bilinear(uchar p1, uchar p2, uchar p3, uchar p4, double x, double y)
 
 uchar get_bilinear(cv::Mat& grayscale, double x, double y)
 {
-    int borderx = -1, bordery = -1;
-    if (x < 0)
-        borderx = 0;
-    if (y < 0)
-        bordery = 0;
-    if (x >= grayscale.cols)
-        borderx = grayscale.cols - 1;
-    if (y >= grayscale.rows)
-        bordery = grayscale.rows - 1;
-
-    if (borderx != -1 && bordery != -1)
-        return grayscale.at<uchar>(bordery, borderx);
-
-    if (borderx != -1)
-    {
-        uchar y1 = grayscale.at<uchar>(int(floor(y)), borderx);
-        uchar y2 = grayscale.at<uchar>(int(ceil(y)), borderx);
-        return uchar(int(y1 + (y2 - y1) * (y - floor(y))));
-    }
-
-    if (bordery != -1)
-    {
-        uchar x1 = grayscale.at<uchar>(bordery, int(floor(x)));
-        uchar x2 = grayscale.at<uchar>(bordery, int(ceil(x)));
-        return uchar(int(x1 + (x2 - x1) * (x - floor(x))));
-    }
-
-    return bilinear(
-        grayscale.at<uchar>(int(floor(y)), int(floor(x))),
-        grayscale.at<uchar>(int(floor(y)), int(ceil(x))),
-        grayscale.at<uchar>(int(ceil(y)), int(floor(x))),
-        grayscale.at<uchar>(int(ceil(y)), int(ceil(x))),
-        x - floor(x), y - floor(y));
+    return bilinear_at(grayscale.data, grayscale.step, grayscale.cols, grayscale.rows, x, y);
 }
 
 void extract_flank(
@@ -294,37 +851,26 @@ void extract_flank(
     int width = extend;
     int height = 2 * flank + 1;
 
+    // the row flank - h maps the points origin + w * orient + h * up. the
+    // points outside the photograph are left zero.
+
     cv::Mat roi = cv::Mat::zeros(cv::Size(width, height), CV_8U);
     for (int h = -flank; h <= +flank; h++)
     {
-        for (int w = 0; w < width; w++)
-        {
-
-            cv::Point2d mapped(
-                origin.x + w * orient.x + h * up.x,
-                origin.y + w * orient.y + h * up.y);
-
-            cv::Point target(w, flank - h);
-
-            if (mapped.x > grayscale.cols)
-                continue;
-            if (mapped.y > grayscale.rows)
-                continue;
-            if (mapped.x < 0)
-                continue;
-            if (mapped.y < 0)
-                continue;
-
-            roi.at<uchar>(target.y, target.x) =
-                get_bilinear(grayscale, mapped.x, mapped.y);
-        }
+        kernels -> flank_row(
+            grayscale.data, grayscale.step, grayscale.cols, grayscale.rows,
+            roi.ptr<uchar>(flank - h), width,
+            origin.x, orient.x, h * up.x, origin.y, orient.y, h * up.y);
     }
 
     roi.copyTo(out);
 }
 
-uchar** matrix(cv::Mat& mat) {
-    uchar** ptrs = (uchar**)malloc(sizeof(uchar*) * mat.rows);
+// the row pointers of a matrix. the table is owned by the vector, and freed
+// with it at the end of infect.
+
+static std::vector<uchar*> matrix(cv::Mat& mat) {
+    std::vector<uchar*> ptrs(mat.rows);
     for (int r = 0; r < mat.rows; r++) ptrs[r] = mat.ptr(r);
     return ptrs;
 }
@@ -335,7 +881,7 @@ uchar** matrix(cv::Mat& mat) {
 int infect_cell(
     uchar** inp, uchar** out, uchar** flag, int width, int height,
     cv::Point center, std::queue<cv::Point>& next,
-    std::vector<double>& bg, double cutoff)
+    double& bg_sum, int& bg_count, double cutoff)
 {
     int x = center.x;
     int y = center.y;
@@ -359,7 +905,7 @@ int infect_cell(
         }                                                       \
         else                                                    \
         {                                                       \
-            double mbg = mean(bg.size(), bg.data());            \
+            double mbg = bg_sum / bg_count;                     \
             double pval = (mbg - (inp[_y][_x] * 1.)) / mbg;     \
             if (pval > cutoff)                                  \
             {                                                   \
@@ -368,7 +914,8 @@ int infect_cell(
             else                                                \
             {                                                   \
                 flag[_y][_x] = 1;                               \
-                bg.push_back(inp[_y][_x] * 1.);                 \
+                bg_sum += inp[_y][_x];                          \
+                bg_count += 1;                                  \
                 out[_y][_x] = 255;                              \
                 next.push(cv::Point(_x, _y));                   \
                 is_dirty += 1;                                  \
@@ -409,7 +956,6 @@ void infect(cv::Mat& grayscale, cv::Mat& out, cv::Point init, double cutoff)
 {
 
     std::queue<cv::Point> nexts;
-    std::vector<double> bg;
     cv::Mat flag = cv::Mat::zeros(grayscale.size(), CV_8U);
 
     // the init point is ensured previously to not be on the border of images.
@@ -420,12 +966,18 @@ void infect(cv::Mat& grayscale, cv::Mat& out, cv::Point init, double cutoff)
     // 1 - background points.
     // 2 - foreground points.
 
-    bg.push_back(grayscale.at<uchar>(init.y, init.x) * 1.0);
+    // the background is kept as the running sum and count of its levels. the
+    // levels are integers, so the sum is exact, and its mean the same as that
+    // of the list of levels, at constant cost per pixel.
 
-    bg.push_back(grayscale.at<uchar>(init.y - 1, init.x) * 1.0);
-    bg.push_back(grayscale.at<uchar>(init.y + 1, init.x) * 1.0);
-    bg.push_back(grayscale.at<uchar>(init.y, init.x - 1) * 1.0);
-    bg.push_back(grayscale.at<uchar>(init.y, init.x + 1) * 1.0);
+    double bg_sum = grayscale.at<uchar>(init.y, init.x);
+    int bg_count = 1;
+
+    bg_sum += grayscale.at<uchar>(init.y - 1, init.x);
+    bg_sum += grayscale.at<uchar>(init.y + 1, init.x);
+    bg_sum += grayscale.at<uchar>(init.y, init.x - 1);
+    bg_sum += grayscale.at<uchar>(init.y, init.x + 1);
+    bg_count += 4;
 
     nexts.push(cv::Point(init.x - 1, init.y));
     nexts.push(cv::Point(init.x + 1, init.y));
@@ -447,16 +999,19 @@ void infect(cv::Mat& grayscale, cv::Mat& out, cv::Point init, double cutoff)
     // the main loop. if any changes made in the infect_cell call, it returns
     // a non-zero value, otherwise, 0 is returned to indicate a stop.
 
-    uchar** ptr_in = matrix(grayscale);
-    uchar** ptr_out = matrix(out);
-    uchar** ptr_flag = matrix(flag);
+    std::vector<uchar*> rows_in = matrix(grayscale);
+    std::vector<uchar*> rows_out = matrix(out);
+    std::vector<uchar*> rows_flag = matrix(flag);
+    uchar** ptr_in = rows_in.data();
+    uchar** ptr_out = rows_out.data();
+    uchar** ptr_flag = rows_flag.data();
 
     while (nexts.size() > 0)
     {
         auto point = nexts.front();
         infect_cell(
             ptr_in, ptr_out, ptr_flag, grayscale.cols, grayscale.rows,
-            point, nexts, bg, cutoff);
+            point, nexts, bg_sum, bg_count, cutoff);
         nexts.pop();
     }
 }
@@ -525,10 +1080,7 @@ int quartile(cv::Mat& grayscale, cv::Mat mask, double lower) {
 int any(cv::Mat& binary) {
     int count = 0;
     for (int r = 0; r < binary.rows; r++) {
-        auto ptr = binary.ptr(r);
-        for (int c = 0; c < binary.cols; c++) {
-            if (ptr[c] > 0) count += 1;
-        }
+        count += kernels -> count(binary.ptr(r), binary.cols);
     }
     return count;
 }
@@ -536,10 +1088,2290 @@ int any(cv::Mat& binary) {
 int any_right(cv::Mat& binary, int col) {
     int count = 0;
     for (int r = 0; r < binary.rows; r++) {
-        auto ptr = binary.ptr(r);
-        for (int c = col; c < binary.cols; c++) {
-            if (ptr[c] > 0) count += 1;
-        }
+        count += kernels -> count(binary.ptr(r) + col, binary.cols - col);
     }
     return count;
 }
+
+// the mean of a grayscale image under a mask, as cv::mean takes it: the
+// integer sum times the reciprocal of the count, and zero for an empty mask.
+// other types go to cv::mean.
+
+static double masked_mean(cv::Mat& image, cv::Mat& mask)
+{
+    if (image.type() != CV_8U || mask.type() != CV_8U || image.size() != mask.size())
+        return cv::mean(image, mask)[0];
+
+    uint64_t sum = 0, count = 0;
+    for (int r = 0; r < image.rows; r++)
+        kernels -> masked_sum(image.ptr(r), mask.ptr(r), image.cols, sum, count);
+
+    return count == 0 ? 0 : sum * (1. / count);
+}
+
+// the measurements are taken on the original roi, with the foreground mask
+// dilated twice to include the smoothed border of the blob.
+
+void measure(
+    cv::Mat& roi, cv::Mat& foreground, cv::Mat& back_strict, cv::Mat& back_loose,
+    bool detected, measure_t& out)
+{
+    out.detected = detected;
+    out.fore_mean = -1;
+    out.fore_size = -1;
+
+    if (detected) {
+        cv::Mat kernel_full = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
+        cv::Mat morph;
+
+        cv::morphologyEx(
+            foreground, morph,
+            cv::MORPH_DILATE, kernel_full,
+            cv::Point(-1, -1), 2
+        );
+
+        out.fore_mean = masked_mean(roi, morph);
+        out.fore_size = any(morph);
+    }
+
+    out.back_strict = masked_mean(roi, back_strict);
+    out.back_loose = masked_mean(roi, back_loose);
+}
+
+// 64-bit fnv-1a. this is not a cryptographic hash, but it is enough to tell
+// apart the rois and parameter sets of the datasets we process.
+
+uint64_t hash_bytes(const void* data, size_t len, uint64_t seed)
+{
+    const uchar* bytes = (const uchar*) data;
+    uint64_t h = seed ^ 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= bytes[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+uint64_t hash_mat(cv::Mat& image, uint64_t seed)
+{
+    int header[3] = { image.rows, image.cols, image.type() };
+    uint64_t h = hash_bytes(header, sizeof(header), seed);
+    for (int r = 0; r < image.rows; r++)
+        h = hash_bytes(image.ptr(r), image.cols * image.elemSize(), h);
+    return h;
+}
+
+// the files are hashed in chunks of hash_chunk bytes, each chunk seeding the
+// next. hash_contents gives the same value as hash_file for the bytes of a
+// file read whole, so that a source read once for decoding is hashed without
+// reading it again.
+
+static const size_t hash_chunk = 65536;
+
+uint64_t hash_file(const char* fname, uint64_t seed)
+{
+    uint64_t h = seed;
+    FILE* f = fopen(fname, "rb");
+    if (f == NULL) return h;
+
+    std::vector<uchar> buffer(hash_chunk);
+    size_t read;
+    while ((read = fread(buffer.data(), 1, buffer.size(), f)) > 0)
+        h = hash_bytes(buffer.data(), read, h);
+
+    fclose(f);
+    return h;
+}
+
+uint64_t hash_contents(std::vector<uchar>& bytes, uint64_t seed)
+{
+    uint64_t h = seed;
+    for (size_t at = 0; at < bytes.size(); at += hash_chunk)
+        h = hash_bytes(bytes.data() + at, std::min(hash_chunk, bytes.size() - at), h);
+    return h;
+}
+
+// the whole content of a file. false (and empty) if it cannot be read.
+
+bool read_file(const char* fname, std::vector<uchar>& bytes)
+{
+    bytes.clear();
+    FILE* f = fopen(fname, "rb");
+    if (f == NULL) return false;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size > 0) {
+        bytes.resize(size);
+        bytes.resize(fread(bytes.data(), 1, size, f));
+    }
+
+    fclose(f);
+    return true;
+}
+
+// the cache lives in {SOURCE}/cache. the index.tsv holds one line per entry
+// with the measurements, and the masks of each entry are stacked as channels
+// of {key}.png (lossless), the visualization is kept as {key}.jpg.
+
+static std::map<uint64_t, measure_t> cache_index;
+static FILE* cache_file = NULL;
+static char cache_path[1024] = "";
+static int cache_hits = 0;
+static int cache_misses = 0;
+
+bool cache_open(const char* datapath)
+{
+    strcpy(cache_path, datapath);
+    strcat(cache_path, "/cache");
+    if (!fs::is_directory(cache_path)) fs::create_directories(cache_path);
+
+    char idxfname[1024] = "";
+    sprintf(idxfname, "%s/index.tsv", cache_path);
+
+    FILE* read_idx = fopen(idxfname, "r");
+    if (read_idx != NULL) {
+        char line[512];
+        while (fgets(line, sizeof(line), read_idx) != NULL) {
+            unsigned long long key;
+            int det;
+            measure_t m;
+            if (sscanf(
+                line, "%llx\t%d\t%lf\t%d\t%lf\t%lf", &key, &det,
+                &m.fore_mean, &m.fore_size, &m.back_strict, &m.back_loose) != 6)
+                continue;
+
+            m.detected = det != 0;
+            cache_index[key] = m;
+        }
+        fclose(read_idx);
+    }
+
+    cache_file = fopen(idxfname, "a");
+    return cache_file != NULL;
+}
+
+bool cache_lookup(
+    uint64_t key, measure_t& entry,
+    std::vector<cv::Mat>& masks, cv::Mat& overlap)
+{
+    auto found = cache_index.find(key);
+    if (found == cache_index.end()) {
+        cache_misses += 1;
+        return false;
+    }
+
+    char fname[1024] = "";
+    sprintf(fname, "%s/%016llx.png", cache_path, (unsigned long long) key);
+    cv::Mat stacked = cv::imread(fname, cv::IMREAD_UNCHANGED);
+    sprintf(fname, "%s/%016llx.jpg", cache_path, (unsigned long long) key);
+    cv::Mat annot = cv::imread(fname, cv::IMREAD_COLOR);
+
+    // the image files may have been removed by hand, treat it as a miss.
+
+    if (stacked.empty() || annot.empty()) {
+        cache_misses += 1;
+        return false;
+    }
+
+    masks.clear();
+    cv::split(stacked, masks);
+    overlap = annot;
+    entry = found -> second;
+    cache_hits += 1;
+    return true;
+}
+
+void cache_store(
+    uint64_t key, measure_t& entry,
+    std::vector<cv::Mat>& masks, cv::Mat& overlap)
+{
+    if (cache_file == NULL) return;
+
+    // png only stores 1, 3 or 4 channels. pad with an empty mask.
+
+    std::vector<cv::Mat> channels(masks);
+    if (channels.size() == 2)
+        channels.push_back(cv::Mat::zeros(masks[0].size(), CV_8U));
+
+    cv::Mat stacked;
+    cv::merge(channels, stacked);
+
+    char fname[1024] = "";
+    sprintf(fname, "%s/%016llx.png", cache_path, (unsigned long long) key);
+    cv::imwrite(fname, stacked);
+    sprintf(fname, "%s/%016llx.jpg", cache_path, (unsigned long long) key);
+    cv::imwrite(fname, overlap);
+
+    fprintf(
+        cache_file, "%016llx\t%d\t%.17g\t%d\t%.17g\t%.17g\n",
+        (unsigned long long) key, entry.detected ? 1 : 0,
+        entry.fore_mean, entry.fore_size, entry.back_strict, entry.back_loose
+    );
+
+    fflush(cache_file);
+    cache_index[key] = entry;
+}
+
+void cache_close()
+{
+    printf("[i] cache: %d hits, %d misses. \n", cache_hits, cache_misses);
+    if (cache_file != NULL) fclose(cache_file);
+    cache_file = NULL;
+}
+
+void read_results(const char* fname, results_t& res)
+{
+    res.lines.clear();
+    res.uids.clear();
+    res.written = 0;
+
+    FILE* f = fopen(fname, "r");
+    if (f == NULL) return;
+
+    std::vector<std::pair<int, char*>> rows;
+    std::vector<char> buffer(65536);
+
+    // every line is kept in its own allocation throughout the program's
+    // lifespan, do not free them!
+
+    while (fgets(buffer.data(), buffer.size(), f) != NULL) {
+        char* tab = strchr(buffer.data(), '\t');
+        if (tab == NULL) continue;
+
+        char* line = (char*) malloc(strlen(buffer.data()) + 1);
+        strcpy(line, buffer.data());
+        rows.push_back(std::pair<int, char*>(atoi(line), line));
+    }
+
+    fclose(f);
+
+    std::stable_sort(rows.begin(), rows.end(),
+        [](const std::pair<int, char*>& a, const std::pair<int, char*>& b) {
+            return a.first < b.first;
+        });
+
+    for (auto row : rows) {
+        res.uids.push_back(row.first);
+        res.lines.push_back(row.second);
+    }
+}
+
+char* find_result(results_t& res, int uid)
+{
+    auto found = std::lower_bound(res.uids.begin(), res.uids.end(), uid);
+    if (found == res.uids.end() || *found != uid) return NULL;
+    return res.lines.at(found - res.uids.begin());
+}
+
+// write the previous lines with uids before `upto` (exclusive) that are kept
+// in this run. the lines of replaced or vanished uids are dropped.
+
+void write_previous(FILE* out, results_t& res, int upto, std::set<int>& keep)
+{
+    while (res.written < res.uids.size() && res.uids.at(res.written) < upto) {
+        if (keep.count(res.uids.at(res.written)) > 0)
+            fprintf(out, "%s", res.lines.at(res.written));
+        res.written += 1;
+    }
+}
+
+// split a line of a tab-separated table in place. the tabs are replaced with
+// terminators, and cols points to the start of each column.
+
+int split_columns(char* line, std::vector<char*>& cols)
+{
+    cols.clear();
+    char* start = line;
+    while (true) {
+        cols.push_back(start);
+        char* tab = strchr(start, '\t');
+        if (tab == NULL) break;
+        *tab = '\0';
+        start = tab + 1;
+    }
+
+    return cols.size();
+}
+
+// whether a previous line of raw.tsv is derived from the same row of
+// rois.tsv. the raw.tsv columns are documented in the readme.
+
+bool result_matches(
+    const char* rawline, const char* fname, int sid, const char* name,
+    bool det_success, bool scale_success, int scale_dark, int scale_light)
+{
+    std::vector<char> copy(rawline, rawline + strlen(rawline) + 1);
+    std::vector<char*> cols;
+    split_columns(copy.data(), cols);
+
+    if (cols.size() < 13) return false;
+
+    return strcmp(cols[1], fname) == 0 &&
+        atoi(cols[2]) == sid &&
+        strcmp(cols[3], name) == 0 &&
+        (cols[4][0] == 'x') == det_success &&
+        (cols[5][0] == 'x') == scale_success &&
+        atoi(cols[11]) == scale_dark &&
+        atoi(cols[12]) == scale_light;
+}
+
+// the source hash of a previous line of raw.tsv, 0 for the lines written
+// before the column is added.
+
+uint64_t result_source(const char* rawline)
+{
+    std::vector<char> copy(rawline, rawline + strlen(rawline) + 1);
+    std::vector<char*> cols;
+    split_columns(copy.data(), cols);
+
+    if (cols.size() < 14) return 0;
+    return strtoull(cols[13], NULL, 16);
+}
+
+// ============================================================================
+
+// the binary columnar results (results.bin). the layout is a header, then the
+// fixed-width columns each sized for the capacity of rows, then the dictionary
+// of the file and sample names (a 4-byte length and the characters each):
+//
+//     header | uid | sid | fname | name | flags | fore_mean | fore_size |
+//     back_strict | back_loose | scale_dark | scale_light | source | dictionary
+//
+// fname and name hold the indices of their strings in the dictionary. a row is
+// updated in place by uid, and appended into the spare capacity; when the
+// capacity is full, the columns are moved to a file twice as large.
+
+typedef struct columns_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t rows;
+    uint32_t capacity;
+    uint32_t strings;
+    uint64_t dict_end;
+} columns_header_t;
+
+static const char columns_magic[8] = { 's', 'p', 'b', 'l', 'o', 'b', 'r', 'b' };
+static const int column_count = 12;
+static const size_t column_widths[column_count] = { 4, 4, 4, 4, 1, 8, 4, 8, 8, 4, 4, 8 };
+static const uint32_t columns_version = 2;
+static const uint32_t columns_initial = 1024;
+
+#define flag_det 1
+#define flag_scale 2
+#define flag_fore 4
+#define flag_removed 8
+
+static size_t column_offset(uint32_t capacity, int col)
+{
+    size_t offset = sizeof(columns_header_t);
+    for (int c = 0; c < col; c++) offset += column_widths[c] * capacity;
+    return offset;
+}
+
+static void columns_header_write(columns_t& cols)
+{
+    columns_header_t header;
+    memcpy(header.magic, columns_magic, sizeof(columns_magic));
+    header.version = columns_version;
+    header.rows = cols.rows;
+    header.capacity = cols.capacity;
+    header.strings = cols.dict.size();
+    header.dict_end = cols.dict_end;
+
+    fseek(cols.file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, cols.file);
+}
+
+static void column_read(columns_t& cols, int col, std::vector<char>& out)
+{
+    out.resize(column_widths[col] * cols.rows);
+    if (cols.rows == 0) return;
+    fseek(cols.file, column_offset(cols.capacity, col), SEEK_SET);
+    if (fread(out.data(), 1, out.size(), cols.file) != out.size()) out.clear();
+}
+
+// open (or create, when writable) the results file. the dictionary and the uid
+// index are read into memory, the columns stay on the disk.
+
+bool columns_open(columns_t& cols, const char* fname, bool writable)
+{
+    cols.file = NULL;
+    cols.writable = writable;
+    cols.rows = 0;
+    cols.capacity = 0;
+    cols.dict_end = 0;
+    cols.dict.clear();
+    cols.dict_index.clear();
+    cols.index.clear();
+
+    if (!std::filesystem::is_regular_file(fname)) {
+        if (!writable) return false;
+        cols.file = fopen(fname, "w+b");
+        if (cols.file == NULL) return false;
+
+        cols.capacity = columns_initial;
+        cols.dict_end = column_offset(cols.capacity, column_count);
+        columns_header_write(cols);
+
+        // the columns are zeroed by extending the file to the dictionary.
+
+        std::vector<char> zeros(cols.dict_end - sizeof(columns_header_t), 0);
+        fwrite(zeros.data(), 1, zeros.size(), cols.file);
+        fflush(cols.file);
+        return true;
+    }
+
+    cols.file = fopen(fname, writable ? "r+b" : "rb");
+    if (cols.file == NULL) return false;
+
+    columns_header_t header;
+    if (fread(&header, sizeof(header), 1, cols.file) != 1 ||
+        memcmp(header.magic, columns_magic, sizeof(columns_magic)) != 0 ||
+        header.version != columns_version) {
+        fclose(cols.file);
+        cols.file = NULL;
+        return false;
+    }
+
+    cols.rows = header.rows;
+    cols.capacity = header.capacity;
+    cols.dict_end = header.dict_end;
+
+    fseek(cols.file, column_offset(cols.capacity, column_count), SEEK_SET);
+    for (uint32_t s = 0; s < header.strings; s++) {
+        uint32_t len = 0;
+        if (fread(&len, sizeof(len), 1, cols.file) != 1) break;
+        std::string str(len, '\0');
+        if (len > 0 && fread(&str[0], 1, len, cols.file) != len) break;
+        cols.dict_index[str] = cols.dict.size();
+        cols.dict.push_back(str);
+    }
+
+    std::vector<char> uids;
+    column_read(cols, 0, uids);
+    for (uint32_t r = 0; r < cols.rows && uids.size() > 0; r++)
+        cols.index[((int*) uids.data())[r]] = r;
+
+    return true;
+}
+
+static int columns_string(columns_t& cols, const char* str)
+{
+    auto found = cols.dict_index.find(str);
+    if (found != cols.dict_index.end()) return found->second;
+
+    uint32_t len = strlen(str);
+    fseek(cols.file, cols.dict_end, SEEK_SET);
+    fwrite(&len, sizeof(len), 1, cols.file);
+    fwrite(str, 1, len, cols.file);
+    cols.dict_end += sizeof(len) + len;
+
+    cols.dict_index[str] = cols.dict.size();
+    cols.dict.push_back(str);
+    return cols.dict.size() - 1;
+}
+
+// move the columns into twice the capacity. the columns are moved from the last
+// one, each to an offset not before its old one, so nothing is overwritten
+// before it is read.
+
+static void columns_grow(columns_t& cols)
+{
+    uint32_t capacity = cols.capacity * 2;
+    size_t dict_start = column_offset(cols.capacity, column_count);
+    std::vector<char> dict(cols.dict_end - dict_start);
+    fseek(cols.file, dict_start, SEEK_SET);
+    if (dict.size() > 0 && fread(dict.data(), 1, dict.size(), cols.file) != dict.size()) return;
+
+    std::vector<char> column;
+    for (int c = column_count - 1; c >= 0; c--) {
+        column.assign(column_widths[c] * cols.capacity, 0);
+        fseek(cols.file, column_offset(cols.capacity, c), SEEK_SET);
+        if (fread(column.data(), 1, column.size(), cols.file) != column.size()) return;
+        column.resize(column_widths[c] * capacity, 0);
+        fseek(cols.file, column_offset(capacity, c), SEEK_SET);
+        fwrite(column.data(), 1, column.size(), cols.file);
+    }
+
+    size_t new_start = column_offset(capacity, column_count);
+    fseek(cols.file, new_start, SEEK_SET);
+    fwrite(dict.data(), 1, dict.size(), cols.file);
+
+    cols.capacity = capacity;
+    cols.dict_end = new_start + dict.size();
+    columns_header_write(cols);
+}
+
+static void column_write(columns_t& cols, int col, uint32_t row, const void* value)
+{
+    fseek(cols.file, column_offset(cols.capacity, col) + column_widths[col] * row, SEEK_SET);
+    fwrite(value, column_widths[col], 1, cols.file);
+}
+
+// write a row, in place of the row of its uid if any, or appended.
+
+void columns_put(columns_t& cols, result_row_t& row)
+{
+    uint32_t r;
+    size_t rows = cols.rows, strings = cols.dict.size();
+    auto found = cols.index.find(row.uid);
+    if (found != cols.index.end()) r = found->second;
+    else {
+        if (cols.rows == cols.capacity) columns_grow(cols);
+        r = cols.rows++;
+        cols.index[row.uid] = r;
+    }
+
+    int fname = columns_string(cols, row.fname);
+    int name = columns_string(cols, row.name);
+    if (cols.rows != rows || cols.dict.size() != strings) columns_header_write(cols);
+    uchar flags =
+        (row.det_success ? flag_det : 0) | (row.scale_success ? flag_scale : 0) |
+        (row.measures.detected ? flag_fore : 0);
+
+    column_write(cols, 0, r, &row.uid);
+    column_write(cols, 1, r, &row.sid);
+    column_write(cols, 2, r, &fname);
+    column_write(cols, 3, r, &name);
+    column_write(cols, 4, r, &flags);
+    column_write(cols, 5, r, &row.measures.fore_mean);
+    column_write(cols, 6, r, &row.measures.fore_size);
+    column_write(cols, 7, r, &row.measures.back_strict);
+    column_write(cols, 8, r, &row.measures.back_loose);
+    column_write(cols, 9, r, &row.scale_dark);
+    column_write(cols, 10, r, &row.scale_light);
+    column_write(cols, 11, r, &row.source);
+}
+
+// mark the rows of uids not in keep as removed. they are skipped by the
+// readers, and their rows are reused when the uids are written again.
+
+void columns_retain(columns_t& cols, std::set<int>& keep)
+{
+    std::vector<char> flags;
+    column_read(cols, 4, flags);
+    if (flags.size() < cols.rows) return;
+
+    for (auto& entry : cols.index) {
+        uchar flag = flags[entry.second];
+        if (keep.count(entry.first) > 0 || (flag & flag_removed)) continue;
+        flag |= flag_removed;
+        column_write(cols, 4, entry.second, &flag);
+    }
+}
+
+// read the rows, sorted by uid, without the removed ones. each column is read
+// whole at once. the names point into the dictionary of cols.
+
+void columns_rows(columns_t& cols, std::vector<result_row_t>& rows)
+{
+    std::vector<char> data[column_count];
+    for (int c = 0; c < column_count; c++) {
+        column_read(cols, c, data[c]);
+        if (data[c].size() < column_widths[c] * cols.rows) return;
+    }
+
+    rows.clear();
+    for (auto& entry : cols.index) {
+        uint32_t r = entry.second;
+        uchar flags = data[4][r];
+        if (flags & flag_removed) continue;
+
+        result_row_t row;
+        row.uid = ((int*) data[0].data())[r];
+        row.sid = ((int*) data[1].data())[r];
+        row.fname = cols.dict.at(((int*) data[2].data())[r]).c_str();
+        row.name = cols.dict.at(((int*) data[3].data())[r]).c_str();
+        row.det_success = flags & flag_det;
+        row.scale_success = flags & flag_scale;
+        row.measures.detected = flags & flag_fore;
+        row.measures.fore_mean = ((double*) data[5].data())[r];
+        row.measures.fore_size = ((int*) data[6].data())[r];
+        row.measures.back_strict = ((double*) data[7].data())[r];
+        row.measures.back_loose = ((double*) data[8].data())[r];
+        row.scale_dark = ((int*) data[9].data())[r];
+        row.scale_light = ((int*) data[10].data())[r];
+        row.source = ((uint64_t*) data[11].data())[r];
+        rows.push_back(row);
+    }
+}
+
+// read the rows [begin, begin + count) in the order they are stored, without
+// the removed ones, for a pass over a file larger than the memory. returns the
+// number of stored rows read.
+
+int columns_range(columns_t& cols, uint32_t begin, uint32_t count, std::vector<result_row_t>& rows)
+{
+    rows.clear();
+    if (begin >= cols.rows) return 0;
+    if (count > cols.rows - begin) count = cols.rows - begin;
+
+    std::vector<char> data[column_count];
+    for (int c = 0; c < column_count; c++) {
+        data[c].resize(column_widths[c] * count);
+        fseek(cols.file, column_offset(cols.capacity, c) + column_widths[c] * begin, SEEK_SET);
+        if (fread(data[c].data(), 1, data[c].size(), cols.file) != data[c].size()) return 0;
+    }
+
+    for (uint32_t r = 0; r < count; r++) {
+        uchar flags = data[4][r];
+        if (flags & flag_removed) continue;
+
+        result_row_t row;
+        row.uid = ((int*) data[0].data())[r];
+        row.sid = ((int*) data[1].data())[r];
+        row.fname = cols.dict.at(((int*) data[2].data())[r]).c_str();
+        row.name = cols.dict.at(((int*) data[3].data())[r]).c_str();
+        row.det_success = flags & flag_det;
+        row.scale_success = flags & flag_scale;
+        row.measures.detected = flags & flag_fore;
+        row.measures.fore_mean = ((double*) data[5].data())[r];
+        row.measures.fore_size = ((int*) data[6].data())[r];
+        row.measures.back_strict = ((double*) data[7].data())[r];
+        row.measures.back_loose = ((double*) data[8].data())[r];
+        row.scale_dark = ((int*) data[9].data())[r];
+        row.scale_light = ((int*) data[10].data())[r];
+        row.source = ((uint64_t*) data[11].data())[r];
+        rows.push_back(row);
+    }
+
+    return count;
+}
+
+// whether the row of uid is present (and not removed), and derived from the
+// same row of rois.tsv.
+
+bool columns_matches(
+    columns_t& cols, int uid, const char* fname, int sid, const char* name,
+    bool det_success, bool scale_success, int scale_dark, int scale_light)
+{
+    auto found = cols.index.find(uid);
+    if (found == cols.index.end()) return false;
+
+    uint32_t r = found->second;
+    int values[7];
+    uchar flags = 0;
+    for (int c = 1; c <= 3; c++) {
+        fseek(cols.file, column_offset(cols.capacity, c) + column_widths[c] * r, SEEK_SET);
+        if (fread(&values[c], column_widths[c], 1, cols.file) != 1) return false;
+    }
+
+    fseek(cols.file, column_offset(cols.capacity, 4) + r, SEEK_SET);
+    if (fread(&flags, 1, 1, cols.file) != 1) return false;
+    for (int c = 9; c <= 10; c++) {
+        fseek(cols.file, column_offset(cols.capacity, c) + column_widths[c] * r, SEEK_SET);
+        if (fread(&values[c - 4], column_widths[c], 1, cols.file) != 1) return false;
+    }
+
+    if (flags & flag_removed) return false;
+    if (values[2] >= cols.dict.size() || values[3] >= cols.dict.size()) return false;
+
+    return cols.dict[values[2]] == fname &&
+        values[1] == sid &&
+        cols.dict[values[3]] == name &&
+        ((flags & flag_det) != 0) == det_success &&
+        ((flags & flag_scale) != 0) == scale_success &&
+        values[5] == scale_dark &&
+        values[6] == scale_light;
+}
+
+// the source hash of the row of uid, 0 if there is none.
+
+uint64_t columns_source(columns_t& cols, int uid)
+{
+    auto found = cols.index.find(uid);
+    if (found == cols.index.end()) return 0;
+
+    uint64_t source = 0;
+    fseek(cols.file, column_offset(cols.capacity, 11) + column_widths[11] * found->second, SEEK_SET);
+    if (fread(&source, sizeof(source), 1, cols.file) != 1) return 0;
+    return source;
+}
+
+void columns_close(columns_t& cols)
+{
+    if (cols.file == NULL) return;
+
+    // a read-only handle leaves the header as it is, and the fwrite to a "rb"
+    // stream would fail anyway.
+
+    if (cols.writable) columns_header_write(cols);
+    fclose(cols.file);
+    cols.file = NULL;
+}
+
+// the lines of raw.tsv and stats.tsv of a row. the rows whose detection is
+// defected, or whose values would crash the log(0), have no stats.tsv line.
+
+void write_raw_row(FILE* out, result_row_t& row)
+{
+    fprintf(
+        out, "%d\t%s\t%d\t%s\t%s\t%s\t%s\t" "%.2f\t%d\t%.2f\t%.2f\t%d\t%d\t%016llx\n",
+        row.uid, row.fname, row.sid, row.name,
+        row.det_success ? "x" : ".", row.scale_success ? "x" : ".",
+        row.measures.detected ? "x" : ".",
+        row.measures.fore_mean, row.measures.fore_size,
+        row.measures.back_strict, row.measures.back_loose,
+        row.scale_dark, row.scale_light, (unsigned long long) row.source
+    );
+}
+
+// the eight logarithms of a row in stats.tsv, in the order of its columns
+// (log.abs, log.delta, log.light, log.dark, log.back, log.back.strict,
+// log.mean, log.sz). false if the row has no stats.tsv line.
+
+bool stat_values(result_row_t& row, double* values)
+{
+    double fm = row.measures.fore_mean;
+    int fsz = row.measures.fore_size;
+    double bs = row.measures.back_strict;
+    double bl = row.measures.back_loose;
+
+    if (!(row.det_success && row.scale_success && row.measures.detected &&
+          fsz > 0 && fm > 0 && (bs - fm) > 0 &&
+          row.scale_light > 0 && row.scale_dark > 0 &&
+          row.scale_light > row.scale_dark &&
+          bl > 0 && bs > 0))
+        return false;
+
+    values[0] = log((bs - fm) * fsz);                      // log.abs
+    values[1] = log(row.scale_light - row.scale_dark);     // log.delta
+    values[2] = log(row.scale_light);                      // log.light
+    values[3] = log(row.scale_dark);                       // log.dark
+    values[4] = log(bl);                                   // log.back
+    values[5] = log(bs);                                   // log.back.strict
+    values[6] = log(fm);                                   // log.mean
+    values[7] = log(fsz);                                  // log.sz
+    return true;
+}
+
+bool write_stat_row(FILE* out, result_row_t& row)
+{
+    double v[8];
+    if (!stat_values(row, v)) return false;
+
+    fprintf(
+        out, "%d\t%s\t%d\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%s\n",
+        row.uid, row.fname, row.sid, v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], row.name
+    );
+
+    return true;
+}
+
+// append a string to the arena of the batch, and return its offset.
+
+static size_t batch_string(roi_batch_t& batch, const char* str)
+{
+    size_t at = batch.arena.size();
+    batch.arena.insert(batch.arena.end(), str, str + strlen(str) + 1);
+    return at;
+}
+
+void batch_push(
+    roi_batch_t& batch, int uid, const char* fname, int sid, const char* name,
+    bool det_success, bool scale_success, int scale_dark, int scale_light, cv::Mat& roi,
+    uint64_t source)
+{
+    batch.uid.push_back(uid);
+    batch.sid.push_back(sid);
+    batch.fname_at.push_back(batch_string(batch, fname));
+    batch.name_at.push_back(batch_string(batch, name));
+    batch.det_success.push_back(det_success);
+    batch.scale_success.push_back(scale_success);
+    batch.scale_dark.push_back(scale_dark);
+    batch.scale_light.push_back(scale_light);
+    batch.source.push_back(source);
+    batch.rois.push_back(roi);
+}
+
+int batch_size(roi_batch_t& batch)
+{
+    return (int) batch.uid.size();
+}
+
+// the names are valid until the next push, which may move the arena.
+
+const char* batch_fname(roi_batch_t& batch, int i)
+{
+    return batch.arena.data() + batch.fname_at[i];
+}
+
+const char* batch_name(roi_batch_t& batch, int i)
+{
+    return batch.arena.data() + batch.name_at[i];
+}
+
+void batch_outputs(roi_batch_t& batch)
+{
+    size_t n = batch.uid.size();
+    batch.hit.assign(n, false);
+    batch.keys.assign(n, 0);
+    batch.measures.assign(n, measure_t { false, -1, -1, -1, -1 });
+    batch.back_strict.assign(n, cv::Mat());
+    batch.back_loose.assign(n, cv::Mat());
+    batch.foreground.assign(n, cv::Mat());
+    batch.prediction.assign(n, cv::Mat());
+    batch.overlap.assign(n, cv::Mat());
+    batch.has_foreground.assign(n, false);
+}
+
+// split the batch into (at most) the given number of contiguous slices of
+// nearly equal rows.
+
+void batch_slices(roi_batch_t& batch, int workers, std::vector<roi_slice_t>& slices)
+{
+    int n = batch_size(batch);
+    if (workers < 1) workers = 1;
+    if (workers > n) workers = n;
+
+    slices.clear();
+    for (int w = 0; w < workers; w++) {
+        roi_slice_t slice;
+        slice.begin = (int) ((long long) n * w / workers);
+        slice.end = (int) ((long long) n * (w + 1) / workers);
+        slices.push_back(slice);
+    }
+}
+
+// append the row i of src to dst, with its outputs if src has them. the
+// encoded source, if any, is moved rather than copied.
+
+void batch_take(roi_batch_t& dst, roi_batch_t& src, int i)
+{
+    batch_push(
+        dst, src.uid.at(i), batch_fname(src, i), src.sid.at(i), batch_name(src, i),
+        src.det_success.at(i), src.scale_success.at(i), src.scale_dark.at(i),
+        src.scale_light.at(i), src.rois.at(i), src.source.at(i)
+    );
+
+    if (src.encoded.size() == src.uid.size())
+        dst.encoded.push_back(std::move(src.encoded.at(i)));
+
+    if (src.hit.size() != src.uid.size()) return;
+    dst.hit.push_back(src.hit.at(i));
+    dst.keys.push_back(src.keys.at(i));
+    dst.measures.push_back(src.measures.at(i));
+    dst.back_strict.push_back(src.back_strict.at(i));
+    dst.back_loose.push_back(src.back_loose.at(i));
+    dst.foreground.push_back(src.foreground.at(i));
+    dst.prediction.push_back(src.prediction.at(i));
+    dst.overlap.push_back(src.overlap.at(i));
+    dst.has_foreground.push_back(src.has_foreground.at(i));
+}
+
+// drop the matrices of the row i, keeping its measures. the rows of a batch
+// whose images are written may then be held until their results are.
+
+void batch_release(roi_batch_t& batch, int i)
+{
+    batch.rois.at(i) = cv::Mat();
+    if (batch.encoded.size() == batch.uid.size())
+        std::vector<uchar>().swap(batch.encoded.at(i));
+    if (batch.hit.size() != batch.uid.size()) return;
+    batch.back_strict.at(i) = cv::Mat();
+    batch.back_loose.at(i) = cv::Mat();
+    batch.foreground.at(i) = cv::Mat();
+    batch.prediction.at(i) = cv::Mat();
+    batch.overlap.at(i) = cv::Mat();
+}
+
+// the grayscale roi from the bytes of its source file, read once with
+// read_file and hashed from the same bytes. empty if the file was missing.
+
+cv::Mat decode_roi(std::vector<uchar>& encoded)
+{
+    if (encoded.empty()) return cv::Mat();
+    return cv::imdecode(encoded, cv::IMREAD_GRAYSCALE);
+}
+
+void batch_clear(roi_batch_t& batch)
+{
+    batch = roi_batch_t();
+}
+
+// ============================================================================
+
+// the segmentation drivers, shared by blobshed, blobnn and blobseg.
+
+// segment a batch with the segmenter. the cached rois are taken from the cache
+// first, the rest are segmented on the given number of workers, each taking a
+// contiguous slice of the batch.
+
+void segment_batch(segmenter_t& seg, roi_batch_t& batch, int jobs, bool use_cache, bool show_msg)
+{
+    std::vector<int>& uid = batch.uid;
+    std::vector<cv::Mat>& rois = batch.rois;
+    batch_outputs(batch);
+
+    // hits skip the segmentation, and bring their masks (stacked as strict,
+    // loose, foreground and the prediction if any) and measurements with them.
+
+    uint64_t params = use_cache ? seg.params() : 0;
+
+    for (int i = 0; i < rois.size(); i++) {
+        if (!use_cache || !batch.det_success.at(i)) continue;
+
+        stage_timer_t timer("cache", uid.at(i));
+        std::vector<cv::Mat> masks;
+        batch.keys.at(i) = hash_mat(rois.at(i), params);
+        if (cache_lookup(batch.keys.at(i), batch.measures.at(i), masks, batch.overlap.at(i)) &&
+            masks.size() >= seg.masks) {
+            batch.hit.at(i) = true;
+            batch.back_strict.at(i) = masks[0];
+            batch.back_loose.at(i) = masks[1];
+            batch.foreground.at(i) = masks[2];
+            if (seg.masks > 3) batch.prediction.at(i) = masks[3];
+            batch.has_foreground.at(i) = batch.measures.at(i).detected;
+        }
+    }
+
+    // the rest are segmented on the workers, or in one slice if the segmenter
+    // is not reentrant.
+
+    std::vector<roi_slice_t> slices;
+    batch_slices(batch, seg.serial ? 1 : jobs, slices);
+
+    if (slices.size() <= 1) {
+        for (auto& slice : slices) seg.segment(show_msg, batch, slice);
+    } else {
+        std::vector<std::thread> workers;
+        for (auto& slice : slices)
+            workers.push_back(std::thread(seg.segment, false, std::ref(batch), slice));
+        for (auto& worker : workers) worker.join();
+    }
+
+    if (show_msg) printf("\n");
+}
+
+// open the results of a segmenter under the folder. both raw.tsv and stats.tsv
+// are automatically maintained: newer detections overwrite the older ones, and
+// those not previously detected are added in the uid order. so the old files
+// are read first, and rewritten in every run. in binary, the rows of results.bin
+// are updated in place instead, and the tables are left untouched.
+
+// this also suggests that NO TWO INSTANCE OF THESE PROGRAMS SHOULD BE RUN
+// WITH THE SAME OUTPUT FOLDER! or this will cause edit conflict.
+
+bool sink_open(sink_t& sink, const char* datapath, bool binary)
+{
+    std::string opath(datapath);
+    if (!std::filesystem::is_directory(opath)) std::filesystem::create_directories(opath);
+    if (!std::filesystem::is_directory(opath + "/annots"))
+        std::filesystem::create_directories(opath + "/annots");
+    if (!std::filesystem::is_directory(opath + "/masks"))
+        std::filesystem::create_directories(opath + "/masks");
+
+    strcpy(sink.datapath, datapath);
+    sink.binary = binary;
+    sink.written.clear();
+    sink.rawfile = NULL;
+    sink.statfile = NULL;
+
+    if (binary) {
+        std::string binfpath = opath + "/results.bin";
+        return columns_open(sink.columns, binfpath.c_str(), true);
+    }
+
+    std::string rawfpath = opath + "/raw.tsv";
+    std::string statfpath = opath + "/stats.tsv";
+
+    read_results(rawfpath.c_str(), sink.raws);
+    read_results(statfpath.c_str(), sink.stats);
+
+    sink.rawfile = fopen(rawfpath.c_str(), "w");
+    sink.statfile = fopen(statfpath.c_str(), "w");
+    if (sink.rawfile == NULL || sink.statfile == NULL) {
+        if (sink.rawfile != NULL) fclose(sink.rawfile);
+        if (sink.statfile != NULL) fclose(sink.statfile);
+        return false;
+    }
+
+    return true;
+}
+
+// whether a roi needs segmenting again in incremental mode: it has no
+// previous result derived from the same rois.tsv row, or the source image
+// hashes differently from the one the previous result is segmented from (as
+// when blobroi --replay rewrites it). source is the hash of the current source
+// image, 0 if it is missing.
+
+bool sink_stale(
+    sink_t& sink, int uid, const char* fname, int sid, const char* name,
+    bool det_success, bool scale_success, int scale_dark, int scale_light,
+    uint64_t source)
+{
+    bool matches = false;
+    uint64_t previous = 0;
+    if (sink.binary) {
+        matches = columns_matches(
+            sink.columns, uid, fname, sid, name,
+            det_success, scale_success, scale_dark, scale_light);
+        if (matches) previous = columns_source(sink.columns, uid);
+    } else {
+        char* prev = find_result(sink.raws, uid);
+        matches = prev != NULL && result_matches(
+            prev, fname, sid, name, det_success, scale_success, scale_dark, scale_light);
+        if (matches) previous = result_source(prev);
+    }
+
+    return !matches || source == 0 || previous != source;
+}
+
+// measure the segmented rows of a batch, and store them to the cache. the rows
+// measured are then marked as hits, so that they are neither measured nor
+// stored again.
+
+void batch_measure(roi_batch_t& batch, bool use_cache)
+{
+    for (int i = 0; i < batch_size(batch); i++) {
+        if (batch.hit.at(i)) continue;
+
+        stage_timer_t timer("measure", batch.uid.at(i));
+        measure(
+            batch.rois.at(i), batch.foreground.at(i), batch.back_strict.at(i),
+            batch.back_loose.at(i), batch.has_foreground.at(i), batch.measures.at(i)
+        );
+        timer.stop();
+
+        if (use_cache && batch.det_success.at(i)) {
+            stage_timer_t store("cache", batch.uid.at(i));
+            std::vector<cv::Mat> masks = {
+                batch.back_strict.at(i), batch.back_loose.at(i), batch.foreground.at(i)
+            };
+            if (!batch.prediction.at(i).empty()) masks.push_back(batch.prediction.at(i));
+            cache_store(batch.keys.at(i), batch.measures.at(i), masks, batch.overlap.at(i));
+        }
+
+        batch.hit.at(i) = true;
+    }
+}
+
+// the annotated roi and the mask of the row i, to the annots and masks
+// folders. the masks folder takes the network prediction where there is one,
+// and the foreground mask otherwise.
+
+void sink_images(sink_t& sink, roi_batch_t& batch, int i)
+{
+    char savefname[1024] = "";
+    char fmtstring_annot[1024] = "";
+    char fmtstring_mask[1024] = "";
+    strcpy(fmtstring_annot, sink.datapath);
+    strcpy(fmtstring_mask, sink.datapath);
+
+    strcat(fmtstring_annot, "/annots/%d.jpg");
+    strcat(fmtstring_mask, "/masks/%d.jpg");
+
+    sprintf(savefname, fmtstring_annot, batch.uid.at(i));
+    cv::imwrite(savefname, batch.overlap.at(i));
+
+    sprintf(savefname, fmtstring_mask, batch.uid.at(i));
+    cv::Mat& prediction = batch.prediction.at(i);
+    cv::imwrite(savefname, prediction.empty() ? batch.foreground.at(i) : prediction);
+}
+
+// measure the segmented batch, and write its results. the previous lines
+// (kept) are merged in the order of uids, as the batch is ordered by uid
+// (inherited from the ordered rois.tsv). the images are written along, unless
+// the caller has written them already (images false).
+
+void sink_write(
+    sink_t& sink, roi_batch_t& batch, std::set<int>& kept, bool use_cache, bool images)
+{
+    batch_measure(batch, use_cache);
+
+    std::vector<int>& uid = batch.uid;
+    std::vector<int>& sid = batch.sid;
+    std::vector<uchar>& det_success = batch.det_success;
+    std::vector<uchar>& scale_success = batch.scale_success;
+    std::vector<int>& scale_dark = batch.scale_dark;
+    std::vector<int>& scale_light = batch.scale_light;
+    std::vector<cv::Mat>& rois = batch.rois;
+    std::vector<uchar>& has_foreground = batch.has_foreground;
+    std::vector<measure_t>& measures = batch.measures;
+
+    for (int i = 0; i < rois.size(); i++) {
+
+        if (!sink.binary) {
+            write_previous(sink.rawfile, sink.raws, uid.at(i), kept);
+            write_previous(sink.statfile, sink.stats, uid.at(i), kept);
+        }
+
+        stage_timer_t timer("write", uid.at(i));
+        result_row_t row = {
+            uid.at(i), batch_fname(batch, i), sid.at(i), batch_name(batch, i),
+            (bool) det_success.at(i), (bool) scale_success.at(i),
+            scale_dark.at(i), scale_light.at(i), measures.at(i), batch.source.at(i)
+        };
+        row.measures.detected = has_foreground.at(i);
+
+        if (sink.binary) columns_put(sink.columns, row);
+        else {
+            write_raw_row(sink.rawfile, row);
+            write_stat_row(sink.statfile, row);
+            fflush(sink.rawfile);
+            fflush(sink.statfile);
+        }
+
+        sink.written.insert(uid.at(i));
+        if (images) sink_images(sink, batch, i);
+    }
+
+    if (sink.binary) fflush(sink.columns.file);
+    else {
+        fflush(sink.rawfile);
+        fflush(sink.statfile);
+    }
+}
+
+// merge back the previous lines after the last segmented uid, and close. in
+// binary, the rows neither kept nor segmented in this run are removed.
+
+void sink_close(sink_t& sink, std::set<int>& kept)
+{
+    if (sink.binary) {
+        std::set<int> keep(kept);
+        keep.insert(sink.written.begin(), sink.written.end());
+        columns_retain(sink.columns, keep);
+        columns_close(sink.columns);
+        return;
+    }
+
+    write_previous(sink.rawfile, sink.raws, INT32_MAX, kept);
+    write_previous(sink.statfile, sink.stats, INT32_MAX, kept);
+    fclose(sink.rawfile);
+    fclose(sink.statfile);
+}
+
+// the infection ladder of the watershed-like segmenter. the segmentation walks
+// from the most invasive thresholds (the last ones) down to the finer ones
+// until a blob is found.
+
+#define higher_reach 4
+
+static double fthreshs[4 + higher_reach] = {
+    0.02,   0.025,  0.032,  0.04,   0.05, 
+    0.0625, 0.0781, 0.0977 /*, 0.122,
+    0.15,   0.18,   0.22 */
+};
+
+static double cthreshs[4 + higher_reach] = {
+    0.045,  0.056,  0.07,   0.09,   0.12,
+    0.15,   0.1875, 0.2344 /*, 0.29,
+    0.36,   0.5,   0.75 */
+};
+
+// the seed of cache keys, any change to the ladder invalidates the cache.
+
+uint64_t shed_params()
+{
+    const char tag[] = "spblob:blobshed 1.5";
+    int reach = higher_reach;
+    uint64_t h = hash_bytes(tag, sizeof(tag), 0);
+    h = hash_bytes(&reach, sizeof(reach), h);
+    h = hash_bytes(fthreshs, sizeof(fthreshs), h);
+    h = hash_bytes(cthreshs, sizeof(cthreshs), h);
+    return h;
+}
+
+// the watershed-like segmenter (blobshed). the sharpened roi is infected from
+// its left edge, walking the ladder from the most invasive thresholds down until
+// a round blob is found, and the blob is then refined with finer thresholds.
+
+void shed_segment(bool show_msg, roi_batch_t& batch, roi_slice_t slice)
+{
+    for (int i = slice.begin; i < slice.end; i++)
+    {
+        cv::Mat& roi = batch.rois[i];
+        if (!batch.det_success[i]) {
+            batch.back_strict[i] = cv::Mat(cv::Size(3, 3), CV_8U, cv::Scalar(0));
+            batch.back_loose[i] = cv::Mat(cv::Size(3, 3), CV_8U, cv::Scalar(0));
+            batch.foreground[i] = cv::Mat(cv::Size(3, 3), CV_8U, cv::Scalar(0));
+            batch.overlap[i] = cv::Mat(cv::Size(3, 3), CV_8U, cv::Scalar(0));
+            batch.has_foreground[i] = false;
+            continue;
+        }
+
+        if (batch.hit[i]) continue;
+
+        // the usm sharpened image of the roi.
+
+        stage_timer_t timer("usm", batch.uid[i]);
+        cv::Mat blurred;
+        cv::GaussianBlur(roi, blurred, cv::Size(5, 5), 0);
+
+        cv::Mat blur_usm, usm;
+        cv::GaussianBlur(blurred, blur_usm, cv::Size(0, 0), 25);
+        cv::addWeighted(blurred, 1.5, blur_usm, -0.5, 0, usm);
+
+        blur_usm.release();
+        timer.stop();
+
+        stage_timer_t span("roi", batch.uid[i]);
+
+        cv::Mat bgstrict, bgloose, fg, ol;
+        cv::Mat red(roi.size(), CV_8UC3, cv::Scalar(0, 0, 255));
+        cv::Mat green(roi.size(), CV_8UC3, cv::Scalar(0, 255, 0));
+        cv::Mat blue(roi.size(), CV_8UC3, cv::Scalar(255, 0, 0));
+
+        bool detected = false;
+        int maxiter = 4 + higher_reach;
+
+        double finethresh = fthreshs[3 + higher_reach];
+        double coarsethresh = cthreshs[3 + higher_reach]; 
+        double circularity;
+
+        stage_timer_t ladder("ladder", batch.uid[i]);
+        while ((!detected) && maxiter > 0) {
+
+            maxiter -= 1;
+            stage_timer_t step("ladder.step", batch.uid[i], maxiter);
+            finethresh = fthreshs[maxiter];
+            coarsethresh = cthreshs[maxiter];
+            bgstrict = cv::Mat::zeros(roi.size(), CV_8U);
+            bgloose = cv::Mat::zeros(roi.size(), CV_8U);
+            
+            cv::cvtColor(roi, ol, cv::COLOR_GRAY2BGR);
+
+            if (show_msg) printf("[.] performing infection for %d ... \r", batch.uid[i]);
+            fflush(stdout);
+
+            stage_timer_t infect_strict("infect", batch.uid[i], maxiter);
+            infect(usm, bgstrict, cv::Point(1, (roi.rows - 1) / 2 + 1), finethresh);
+            infect_strict.stop();
+
+            stage_timer_t infect_loose("infect", batch.uid[i], maxiter);
+            infect(usm, bgloose, cv::Point(1, (roi.rows - 1) / 2 + 1), coarsethresh);
+            infect_loose.stop();
+
+            // extract the foreground from the looser background, as an inner circle
+
+            cv::Mat kernel_full = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
+            cv::Mat morph;
+
+            cv::morphologyEx(bgloose, morph, cv::MORPH_CLOSE, kernel_full, cv::Point(-1, -1), 1);
+            reverse(morph);
+            cv::morphologyEx(morph, morph, cv::MORPH_CLOSE, kernel_full, cv::Point(-1, -1), 2);
+
+            // extract the central circle.
+
+            std::vector<std::vector<cv::Point>> contours;
+            cv::findContours(morph, contours, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+
+            // match a roughly circular shape, with an estimated rational size.
+
+            int idc = 0;
+            for (auto cont : contours) {
+                double lenconts = cv::arcLength(cont, true);
+                double area = cv::contourArea(cont, false);
+                double ratio = lenconts * lenconts / area;
+
+                if (area > 1000 && area < 50000) {
+
+                    fg = cv::Mat::zeros(roi.size(), CV_8U);
+                    cv::drawContours(fg, contours, idc, cv::Scalar(255), cv::FILLED);
+
+                    int collapse_right = any_right(fg, fg.cols - 20);
+                    if (collapse_right < 10) {
+                        cv::drawContours(
+                            ol, contours, idc, cv::Scalar(0, 0, 255), 2
+                        );
+                        circularity = ratio;
+                        detected = true;
+                        break;
+                    }
+
+                } else {
+                    cv::drawContours(ol, contours, idc, cv::Scalar(0, 0, 0), 1);
+                }
+
+                idc ++;
+            }
+        }
+
+        // TODO: the higher threshold may be too invasive for the circle detection.
+        // however, for some images (where objects are too sticked to the border)
+        // such invasiveness is required to strip the subject from the 
+        // surroundings. however, these objects may not be round, and may lose
+        // the gradients border of natural color. if the effects are mild, we
+        // will just solve the problem by the 2 or 3 times of dilation when counting
+        // but sometimes the shape itself is far from round and the loss cannot be reversed
+
+        ladder.stop();
+
+        stage_timer_t correction("correction", batch.uid[i]);
+        bool nextround = true;
+        bool update = false;
+        cv::Mat backup_fg, backup_ol;
+        fg.copyTo(backup_fg);
+        ol.copyTo(backup_ol);
+
+        while (detected && nextround) {
+            
+            coarsethresh *= 0.64;
+            bgloose = cv::Mat::zeros(roi.size(), CV_8U);
+
+            if (show_msg) printf("[.] correcting infection for %d ... \r", batch.uid[i]);
+            fflush(stdout);
+            stage_timer_t infect_loose("infect", batch.uid[i]);
+            infect(usm, bgloose, cv::Point(1, (roi.rows - 1) / 2 + 1), coarsethresh);
+            infect_loose.stop();
+
+            // extract the foreground from the looser background, as an inner circle
+
+            cv::Mat kernel_full = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
+            cv::Mat morph;
+
+            cv::morphologyEx(bgloose, morph, cv::MORPH_CLOSE, kernel_full, cv::Point(-1, -1), 1);
+            reverse(morph);
+            cv::morphologyEx(morph, morph, cv::MORPH_CLOSE, kernel_full, cv::Point(-1, -1), 2);
+
+            // extract the central circle.
+
+            std::vector<std::vector<cv::Point>> contours;
+            cv::findContours(morph, contours, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+
+            int idc = 0;
+            bool hasany = false;
+            for (auto cont : contours) {
+                double lenconts = cv::arcLength(cont, true);
+                double area = cv::contourArea(cont, false);
+                double ratio = lenconts * lenconts / area;
+                
+                // the circularity ratio should decrease (more circular)
+                // after each iteration.
+
+                if (area > 2000 && area < 50000) {
+                    
+                    // update the foreground mask.
+
+                    int collapse_right = any_right(fg, fg.cols - 20);
+                    if (collapse_right < 10) {
+                        if (ratio < circularity * 0.95) {
+                            backup_fg = cv::Mat::zeros(roi.size(), CV_8U);
+                            cv::drawContours(backup_fg, contours, idc, cv::Scalar(255), cv::FILLED);
+                            cv::drawContours(
+                                backup_ol, contours, idc, cv::Scalar(0, 255, 0), 2);
+                            hasany = true;
+                            update = true;
+                            circularity = ratio;
+
+                        } else nextround = false;
+                        break;
+                    }
+                }
+
+                idc ++;
+            }
+
+            if (!hasany) {
+                nextround = false;
+            }
+        }
+
+        if (update) {
+            backup_fg.copyTo(fg);
+            backup_ol.copyTo(ol);
+        }
+
+        // draw the visualization map.
+
+        cv::Mat temp1, temp2, temp3;
+        cv::bitwise_and(blue, blue, temp1, bgloose);
+        cv::bitwise_and(green, green, temp2, bgstrict);
+        cv::bitwise_and(red, red, temp3, fg);
+        cv::addWeighted(temp1, 0.3, ol, 0.7, 0, ol);
+        cv::addWeighted(temp2, 0.3, ol, 0.7, 0, ol);
+        cv::addWeighted(temp3, 0.3, ol, 0.7, 0, ol);
+
+        batch.back_strict[i] = bgstrict;
+        batch.back_loose[i] = bgloose;
+        batch.foreground[i] = fg;
+        batch.overlap[i] = ol;
+        batch.has_foreground[i] = detected;
+    }
+}
+
+segmenter_t shed_segmenter = { "shed", 3, false, shed_params, shed_segment };
+
+// the bucket of a value in microseconds. values below 64 have their own
+// buckets, and above that every power of two is split into 32 buckets.
+
+static int histogram_bucket(uint64_t us)
+{
+    int shift = 0;
+    while ((us >> shift) >= 64) shift += 1;
+    if (shift == 0) return (int) us;
+    return 64 + (shift - 1) * 32 + (int) ((us >> shift) - 32);
+}
+
+// the midpoint of the bucket, in microseconds.
+
+static double histogram_value(int bucket)
+{
+    if (bucket < 64) return bucket;
+    int shift = (bucket - 64) / 32 + 1;
+    uint64_t sub = (bucket - 64) % 32 + 32;
+    return ((sub << shift) + ((sub + 1) << shift)) * 0.5;
+}
+
+void histogram_add(histogram_t& hist, double us)
+{
+    if (us < 0) us = 0;
+    int bucket = histogram_bucket((uint64_t) llround(us));
+    if (hist.counts.size() <= bucket) hist.counts.resize(bucket + 1, 0);
+    hist.counts[bucket] += 1;
+
+    if (hist.total == 0 || us < hist.min) hist.min = us;
+    if (hist.total == 0 || us > hist.max) hist.max = us;
+    hist.total += 1;
+    hist.sum += us;
+}
+
+// the q-quantile in microseconds.
+
+double histogram_quantile(histogram_t& hist, double q)
+{
+    if (hist.total == 0) return 0;
+    uint64_t rank = (uint64_t) ceil(q * hist.total);
+    if (rank < 1) rank = 1;
+
+    uint64_t cumulative = 0;
+    for (int b = 0; b < hist.counts.size(); b++) {
+        cumulative += hist.counts[b];
+        if (cumulative >= rank)
+            return std::min(hist.max, std::max(hist.min, histogram_value(b)));
+    }
+
+    return hist.max;
+}
+
+// the histograms of all stages, in the order they are first recorded. the
+// stage timers may run from several threads.
+
+static std::mutex timing_lock;
+static std::vector<std::string> timing_stages;
+static std::map<std::string, histogram_t> timing_hists;
+
+void timing_record(const char* stage, double ms)
+{
+    std::lock_guard<std::mutex> guard(timing_lock);
+    if (timing_hists.count(stage) == 0) {
+        timing_stages.push_back(stage);
+        histogram_t hist;
+        hist.total = 0;
+        hist.sum = 0;
+        hist.min = 0;
+        hist.max = 0;
+        timing_hists[stage] = hist;
+    }
+
+    histogram_add(timing_hists[stage], ms * 1000.0);
+}
+
+stage_timer::stage_timer(const char* stage, int uid, int level)
+{
+    this -> stage = stage;
+    this -> start = std::chrono::steady_clock::now();
+    this -> running = true;
+    this -> uid = uid;
+    this -> level = level;
+    this -> counting = counters_read(this -> begin);
+    this -> tracking = memory_begin(this -> memory);
+}
+
+stage_timer::~stage_timer()
+{
+    stop();
+}
+
+// stop the timer and record the stage. returns the elapsed milliseconds.
+
+double stage_timer::stop()
+{
+    auto end = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+    if (running) {
+        counters_t end;
+        if (counting && counters_read(end)) counters_record(stage, begin, end);
+        if (tracking) memory_end(stage, memory);
+        timing_record(stage, ms);
+        trace_span(stage, start, ms, uid, level);
+    }
+
+    running = false;
+    return ms;
+}
+
+// the rows of a summary table shared by the three tools (timings.tsv,
+// counters.tsv and memory.tsv) that belong to the other tools. rows with less
+// than ncols columns are dropped.
+
+static void read_other_rows(
+    const char* fname, const char* tool, int ncols, std::vector<std::string>& rows)
+{
+    FILE* previous = fopen(fname, "r");
+    if (previous == NULL) return;
+
+    char line[4096];
+    while (fgets(line, sizeof(line), previous) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || strncmp(line, "tool\t", 5) == 0) continue;
+        if (std::count(line, line + strlen(line), '\t') < ncols - 1) continue;
+        size_t toollen = strcspn(line, "\t");
+        if (strlen(tool) == toollen && strncmp(line, tool, toollen) == 0) continue;
+        rows.push_back(line);
+    }
+
+    fclose(previous);
+}
+
+// print the per-stage summary, and write it to timings.tsv and timings.json
+// under the output folder. the files are shared by the three tools, each run
+// replaces the rows of its own tool and keeps those of the others. the tsv
+// columns are: tool, stage, count, total, mean, min, p50, p95, p99 and max,
+// all in milliseconds.
+
+void timing_write(const char* datapath, const char* tool)
+{
+    std::lock_guard<std::mutex> guard(timing_lock);
+    if (timing_stages.size() == 0) return;
+
+    std::string tsvpath = std::string(datapath) + "/timings.tsv";
+    std::string jsonpath = std::string(datapath) + "/timings.json";
+
+    std::vector<std::string> rows;
+    read_other_rows(tsvpath.c_str(), tool, 10, rows);
+
+    printf(
+        "[i] %-12s %8s %10s %9s %9s %9s %9s (ms) \n",
+        "stage", "count", "total", "mean", "p50", "p95", "p99"
+    );
+
+    char row[1024];
+    for (auto& stage : timing_stages) {
+        histogram_t& hist = timing_hists[stage];
+        double total = hist.sum / 1000.0;
+        double mean = total / hist.total;
+        double p50 = histogram_quantile(hist, 0.50) / 1000.0;
+        double p95 = histogram_quantile(hist, 0.95) / 1000.0;
+        double p99 = histogram_quantile(hist, 0.99) / 1000.0;
+
+        printf(
+            "[i] %-12s %8llu %10.1f %9.3f %9.3f %9.3f %9.3f \n",
+            stage.c_str(), (unsigned long long) hist.total, total, mean, p50, p95, p99
+        );
+
+        snprintf(
+            row, sizeof(row), "%s\t%s\t%llu\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f",
+            tool, stage.c_str(), (unsigned long long) hist.total, total, mean,
+            hist.min / 1000.0, p50, p95, p99, hist.max / 1000.0
+        );
+
+        rows.push_back(row);
+    }
+
+    FILE* tsv = fopen(tsvpath.c_str(), "w");
+    FILE* json = fopen(jsonpath.c_str(), "w");
+    if (tsv == NULL || json == NULL) {
+        printf("[e] cannot write the timings to the output folder! \n");
+        if (tsv != NULL) fclose(tsv);
+        if (json != NULL) fclose(json);
+        return;
+    }
+
+    fprintf(tsv, "tool\tstage\tcount\ttotal\tmean\tmin\tp50\tp95\tp99\tmax\n");
+    fprintf(json, "[\n");
+
+    for (int i = 0; i < rows.size(); i++) {
+        fprintf(tsv, "%s\n", rows[i].c_str());
+
+        std::vector<char> copy(rows[i].begin(), rows[i].end());
+        copy.push_back('\0');
+        std::vector<char*> cols;
+        split_columns(copy.data(), cols);
+
+        fprintf(
+            json,
+            "  {\"tool\": \"%s\", \"stage\": \"%s\", \"count\": %s, \"total\": %s, "
+            "\"mean\": %s, \"min\": %s, \"p50\": %s, \"p95\": %s, \"p99\": %s, \"max\": %s}%s\n",
+            cols[0], cols[1], cols[2], cols[3], cols[4], cols[5], cols[6], cols[7],
+            cols[8], cols[9], i + 1 < rows.size() ? "," : ""
+        );
+    }
+
+    fprintf(json, "]\n");
+    fclose(tsv);
+    fclose(json);
+}
+
+// chrome trace-event export, in the json array format that chrome://tracing
+// and perfetto read. a span is a complete event ("ph": "X") with microsecond
+// timestamps since the trace is opened. the events are written as they come,
+// so a crashed run still leaves a readable trace. with tracing off, a span
+// costs one test of the flag.
+
+static std::atomic<bool> tracing(false);
+static FILE* tracefile = NULL;
+static std::mutex trace_lock;
+static std::chrono::steady_clock::time_point trace_epoch;
+static std::atomic<int> trace_threads(0);
+
+static int trace_tid()
+{
+    static thread_local int tid = ++trace_threads;
+    return tid;
+}
+
+bool trace_open(const char* fname, const char* tool)
+{
+    tracefile = fopen(fname, "w");
+    if (tracefile == NULL) return false;
+
+    trace_epoch = std::chrono::steady_clock::now();
+    fprintf(
+        tracefile,
+        "[\n{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+        "\"args\": {\"name\": \"%s\"}}",
+        trace_tid(), tool
+    );
+
+    tracing = true;
+    return true;
+}
+
+void trace_span(
+    const char* name, std::chrono::steady_clock::time_point start,
+    double ms, int uid, int level)
+{
+    if (!tracing) return;
+
+    double ts = std::chrono::duration<double, std::micro>(start - trace_epoch).count();
+    int tid = trace_tid();
+
+    std::lock_guard<std::mutex> guard(trace_lock);
+    if (tracefile == NULL) return;
+    fprintf(
+        tracefile,
+        ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+        "\"ts\": %.1f, \"dur\": %.1f, \"args\": {",
+        name, tid, ts, ms * 1000.0
+    );
+
+    if (uid >= 0) fprintf(tracefile, "\"uid\": %d", uid);
+    if (level >= 0) fprintf(tracefile, "%s\"level\": %d", uid >= 0 ? ", " : "", level);
+    fprintf(tracefile, "}}");
+}
+
+void trace_close()
+{
+    if (!tracing) return;
+
+    std::lock_guard<std::mutex> guard(trace_lock);
+    tracing = false;
+    fprintf(tracefile, "\n]\n");
+    fclose(tracefile);
+    tracefile = NULL;
+}
+
+// hardware counters. the counters count the thread that opens them, so each
+// thread opens its own set on its first read. the four events are opened apart
+// rather than as a group, so that a cpu (or a virtual machine) lacking one of
+// them still counts the others. when the kernel multiplexes the events, the
+// counts are scaled by the enabled over the running time.
+
+static std::atomic<bool> counters_on(false);
+static std::mutex counters_lock;
+static std::vector<std::string> counters_stages;
+static std::map<std::string, std::pair<uint64_t, counters_t>> counters_sums;
+static counters_t counters_begin;
+
+#ifdef __linux__
+
+typedef struct counter_fds {
+    int fd[4];
+    bool opened;
+    counter_fds() {
+        for (int i = 0; i < 4; i++) fd[i] = -1;
+        opened = false;
+    }
+    ~counter_fds() {
+        for (int i = 0; i < 4; i++) if (fd[i] >= 0) close(fd[i]);
+    }
+} counter_fds_t;
+
+static thread_local counter_fds_t counter_thread;
+
+static int counter_event(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static bool counter_thread_open()
+{
+    if (!counter_thread.opened) {
+        counter_thread.opened = true;
+        counter_thread.fd[0] = counter_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        counter_thread.fd[1] = counter_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        counter_thread.fd[2] = counter_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        counter_thread.fd[3] = counter_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    }
+
+    for (int i = 0; i < 4; i++) if (counter_thread.fd[i] >= 0) return true;
+    return false;
+}
+
+static uint64_t counter_value(int fd)
+{
+    if (fd < 0) return 0;
+
+    uint64_t values[3];
+    if (read(fd, values, sizeof(values)) != sizeof(values)) return 0;
+    if (values[2] == 0) return 0;
+    if (values[2] >= values[1]) return values[0];
+    return (uint64_t) ((double) values[0] * values[1] / values[2]);
+}
+
+#endif
+
+// turn the counters on for this run. returns false (and leaves them off) when
+// the counters cannot be opened here.
+
+bool counters_open()
+{
+#ifdef __linux__
+    if (!counter_thread_open()) {
+        int paranoid = -1;
+        FILE* f = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+        if (f != NULL) {
+            if (fscanf(f, "%d", &paranoid) != 1) paranoid = -1;
+            fclose(f);
+        }
+
+        printf(
+            "[!] hardware counters are not permitted (perf_event_paranoid = %d), "
+            "running without them. \n", paranoid
+        );
+        return false;
+    }
+
+    counters_on = true;
+    counters_read(counters_begin);
+    return true;
+#else
+    printf("[!] hardware counters are only supported on linux, running without them. \n");
+    return false;
+#endif
+}
+
+// read the counters of the calling thread. returns false if counting is off.
+
+bool counters_read(counters_t& out)
+{
+    if (!counters_on) return false;
+
+#ifdef __linux__
+    if (!counter_thread_open()) return false;
+    out.cycles = counter_value(counter_thread.fd[0]);
+    out.instructions = counter_value(counter_thread.fd[1]);
+    out.cache_misses = counter_value(counter_thread.fd[2]);
+    out.branch_misses = counter_value(counter_thread.fd[3]);
+    return true;
+#else
+    return false;
+#endif
+}
+
+static uint64_t counter_delta(uint64_t begin, uint64_t end)
+{
+    return end > begin ? end - begin : 0;
+}
+
+void counters_record(const char* stage, counters_t& begin, counters_t& end)
+{
+    std::lock_guard<std::mutex> guard(counters_lock);
+    if (counters_sums.count(stage) == 0) {
+        counters_stages.push_back(stage);
+        counters_sums[stage] = std::make_pair(0, counters_t { 0, 0, 0, 0 });
+    }
+
+    auto& sum = counters_sums[stage];
+    sum.first += 1;
+    sum.second.cycles += counter_delta(begin.cycles, end.cycles);
+    sum.second.instructions += counter_delta(begin.instructions, end.instructions);
+    sum.second.cache_misses += counter_delta(begin.cache_misses, end.cache_misses);
+    sum.second.branch_misses += counter_delta(begin.branch_misses, end.branch_misses);
+}
+
+// print the per-stage counters with the whole run (of the main thread) as the
+// last row, and write them to counters.tsv under the output folder, shared by
+// the tools as timings.tsv is. the columns are: tool, stage, count, cycles,
+// instructions, cache misses, branch misses, instructions per cycle, and the
+// cache and branch misses per thousand instructions. the stages nest, so their
+// counts do not add up to the run.
+
+void counters_write(const char* datapath, const char* tool)
+{
+    counters_t end;
+    if (!counters_read(end)) return;
+    counters_record("(run)", counters_begin, end);
+    counters_on = false;
+
+    std::lock_guard<std::mutex> guard(counters_lock);
+    std::string tsvpath = std::string(datapath) + "/counters.tsv";
+    std::vector<std::string> rows;
+    read_other_rows(tsvpath.c_str(), tool, 10, rows);
+
+    printf(
+        "[i] %-12s %8s %12s %12s %6s %11s %12s \n",
+        "stage", "count", "cycles (m)", "instrs (m)", "ipc", "cache mpki", "branch mpki"
+    );
+
+    char row[1024];
+    for (auto& stage : counters_stages) {
+        uint64_t count = counters_sums[stage].first;
+        counters_t& sum = counters_sums[stage].second;
+        double kinstrs = sum.instructions / 1000.0;
+        double ipc = sum.cycles > 0 ? (double) sum.instructions / sum.cycles : 0;
+        double cache_mpki = kinstrs > 0 ? sum.cache_misses / kinstrs : 0;
+        double branch_mpki = kinstrs > 0 ? sum.branch_misses / kinstrs : 0;
+
+        printf(
+            "[i] %-12s %8llu %12.1f %12.1f %6.2f %11.2f %12.2f \n",
+            stage.c_str(), (unsigned long long) count, sum.cycles / 1e6,
+            sum.instructions / 1e6, ipc, cache_mpki, branch_mpki
+        );
+
+        snprintf(
+            row, sizeof(row), "%s\t%s\t%llu\t%llu\t%llu\t%llu\t%llu\t%.3f\t%.3f\t%.3f",
+            tool, stage.c_str(), (unsigned long long) count,
+            (unsigned long long) sum.cycles, (unsigned long long) sum.instructions,
+            (unsigned long long) sum.cache_misses, (unsigned long long) sum.branch_misses,
+            ipc, cache_mpki, branch_mpki
+        );
+
+        rows.push_back(row);
+    }
+
+    FILE* tsv = fopen(tsvpath.c_str(), "w");
+    if (tsv == NULL) {
+        printf("[e] cannot write the counters to the output folder! \n");
+        return;
+    }
+
+    fprintf(
+        tsv, "tool\tstage\tcount\tcycles\tinstructions\tcache_misses\t"
+        "branch_misses\tipc\tcache_mpki\tbranch_mpki\n"
+    );
+
+    for (auto& line : rows) fprintf(tsv, "%s\n", line.c_str());
+    fclose(tsv);
+}
+
+// the matrix pool. the size class of a buffer rounds its size up to the next
+// quarter of a power of two, wasting at most a fifth of it. the buffers larger
+// than the largest class go to the system directly.
+
+static const int pool_classes = 96;
+static const size_t pool_largest = (size_t) 64 << 20;
+
+static std::mutex pool_lock;
+static std::vector<void*> pool_free[pool_classes];
+static size_t pool_limit = 0;
+static size_t pool_cached = 0;
+static uint64_t pool_allocs = 0;
+static uint64_t pool_reused = 0;
+static bool pool_on = false;
+
+static int pool_class(size_t size, size_t& rounded)
+{
+    if (size > pool_largest) { rounded = size; return -1; }
+    if (size <= 64) { rounded = 64; return 0; }
+
+    size_t base = 64;
+    int cls = 1;
+    while (base * 2 < size) { base *= 2; cls += 4; }
+
+    size_t quarter = base / 4;
+    size_t steps = (size - base + quarter - 1) / quarter;
+    rounded = base + steps * quarter;
+    return cls + (int) steps - 1;
+}
+
+class pool_allocator : public cv::MatAllocator
+{
+public:
+    cv::UMatData* allocate(
+        int dims, const int* sizes, int type, void* data, size_t* step,
+        cv::AccessFlag flags, cv::UMatUsageFlags usage) const override
+    {
+        if (data != NULL)
+            return cv::Mat::getStdAllocator() ->
+                allocate(dims, sizes, type, data, step, flags, usage);
+
+        // the same layout as the standard allocator: continuous, with the
+        // steps filled in from the last dimension.
+
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; i--) {
+            if (step) step[i] = total;
+            total *= sizes[i];
+        }
+
+        size_t rounded;
+        int cls = pool_class(total, rounded);
+        void* buffer = NULL;
+        {
+            std::lock_guard<std::mutex> guard(pool_lock);
+            pool_allocs++;
+            if (cls >= 0 && pool_free[cls].size() > 0) {
+                buffer = pool_free[cls].back();
+                pool_free[cls].pop_back();
+                pool_cached -= rounded;
+                pool_reused++;
+            }
+        }
+
+        if (buffer == NULL) buffer = cv::fastMalloc(rounded);
+
+        cv::UMatData* u = new cv::UMatData(this);
+        u -> data = u -> origdata = (uchar*) buffer;
+        u -> size = total;
+        return u;
+    }
+
+    bool allocate(cv::UMatData* data, cv::AccessFlag flags, cv::UMatUsageFlags usage) const override
+    {
+        return data != NULL;
+    }
+
+    void deallocate(cv::UMatData* data) const override
+    {
+        if (data == NULL || data -> refcount != 0) return;
+
+        size_t rounded;
+        int cls = pool_class(data -> size, rounded);
+        void* buffer = data -> origdata;
+        delete data;
+
+        {
+            std::lock_guard<std::mutex> guard(pool_lock);
+            if (cls >= 0 && pool_cached + rounded <= pool_limit) {
+                pool_free[cls].push_back(buffer);
+                pool_cached += rounded;
+                return;
+            }
+        }
+
+        cv::fastFree(buffer);
+    }
+};
+
+static pool_allocator pool;
+
+void pool_open(size_t limit)
+{
+    pool_limit = limit;
+    pool_on = true;
+    cv::Mat::setDefaultAllocator(&pool);
+}
+
+void pool_stats(uint64_t& allocs, uint64_t& reused, uint64_t& cached)
+{
+    std::lock_guard<std::mutex> guard(pool_lock);
+    allocs = pool_allocs;
+    reused = pool_reused;
+    cached = pool_cached;
+}
+
+// the cached bytes the pool may keep under a memory budget (--mem-budget, in
+// bytes, 0 for none): an eighth of the budget, and never more than the 256 mb
+// without one. the budgeted tools plan their chunks (or bands) in the rest, so
+// that the buffers kept for reuse count against the budget too.
+
+size_t pool_share(double budget)
+{
+    size_t limit = (size_t) 256 << 20;
+    if (budget <= 0) return limit;
+    return std::min(limit, (size_t) (budget / 8));
+}
+
+// memory accounting. the tracking allocator hands the allocation to the
+// allocator installed before it (the pool, or the standard one), but marks the
+// buffer as its own (currAllocator) so that the release of the last reference
+// comes back through it. buffers given by the caller (a mat over existing
+// data) are left to the standard allocator and not counted. the peak is a
+// high-water mark of the live bytes, which each stage lowers to the live
+// bytes at its start and raises back at its stop, so that the nested stages
+// and the enclosing ones each see their own peaks.
+
+static std::atomic<bool> memory_on(false);
+static std::atomic<uint64_t> memory_allocs(0);
+static std::atomic<uint64_t> memory_bytes(0);
+static std::atomic<uint64_t> memory_live(0);
+static std::atomic<uint64_t> memory_peak(0);
+static std::atomic<uint64_t> memory_top(0);
+
+typedef struct memory_sum {
+    uint64_t count;
+    uint64_t allocs;
+    uint64_t bytes;
+    uint64_t peak;
+    uint64_t rss;
+    uint64_t cached;
+} memory_sum_t;
+
+static std::mutex memory_lock;
+static std::vector<std::string> memory_stages;
+static std::map<std::string, memory_sum_t> memory_sums;
+static cv::MatAllocator* memory_base = NULL;
+
+static void memory_raise(std::atomic<uint64_t>& mark, uint64_t value)
+{
+    uint64_t current = mark.load();
+    while (value > current && !mark.compare_exchange_weak(current, value)) { }
+}
+
+class tracking_allocator : public cv::MatAllocator
+{
+public:
+    cv::UMatData* allocate(
+        int dims, const int* sizes, int type, void* data, size_t* step,
+        cv::AccessFlag flags, cv::UMatUsageFlags usage) const override
+    {
+        cv::UMatData* u = memory_base -> allocate(dims, sizes, type, data, step, flags, usage);
+        if (u == NULL || data != NULL) return u;
+
+        u -> currAllocator = this;
+        memory_allocs++;
+        memory_bytes += u -> size;
+        uint64_t live = (memory_live += u -> size);
+        memory_raise(memory_peak, live);
+        memory_raise(memory_top, live);
+        return u;
+    }
+
+    bool allocate(cv::UMatData* data, cv::AccessFlag flags, cv::UMatUsageFlags usage) const override
+    {
+        return memory_base -> allocate(data, flags, usage);
+    }
+
+    void deallocate(cv::UMatData* data) const override
+    {
+        if (data == NULL || data -> refcount != 0) return;
+        memory_live -= data -> size;
+        memory_base -> deallocate(data);
+    }
+};
+
+static tracking_allocator memory_allocator;
+
+// the resident set size of the process, in bytes. 0 where it cannot be read.
+
+uint64_t memory_rss()
+{
+#ifdef __linux__
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL) return 0;
+
+    unsigned long long pages = 0, resident = 0;
+    int fields = fscanf(statm, "%llu %llu", &pages, &resident);
+    fclose(statm);
+    if (fields != 2) return 0;
+    return (uint64_t) resident * sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
+
+// turn the accounting on. should be called before the first matrix is made
+// (and after pool_open), the matrices made before are not counted.
+
+void memory_open()
+{
+    memory_base = cv::Mat::getDefaultAllocator();
+    cv::Mat::setDefaultAllocator(&memory_allocator);
+    memory_on = true;
+}
+
+// start the accounting of a stage. returns false if the accounting is off.
+
+bool memory_begin(memory_t& out)
+{
+    if (!memory_on) return false;
+    out.allocs = memory_allocs;
+    out.bytes = memory_bytes;
+    out.live = memory_live;
+    out.peak = memory_peak.exchange(out.live);
+    return true;
+}
+
+void memory_end(const char* stage, memory_t& begin)
+{
+    uint64_t peak = memory_peak.load();
+    memory_raise(memory_peak, begin.peak);
+    uint64_t rss = memory_rss();
+    uint64_t allocs, reused, cached = 0;
+    if (pool_on) pool_stats(allocs, reused, cached);
+
+    std::lock_guard<std::mutex> guard(memory_lock);
+    if (memory_sums.count(stage) == 0) {
+        memory_stages.push_back(stage);
+        memory_sums[stage] = memory_sum_t { 0, 0, 0, 0, 0, 0 };
+    }
+
+    memory_sum_t& sum = memory_sums[stage];
+    sum.count += 1;
+    sum.allocs += memory_allocs - begin.allocs;
+    sum.bytes += memory_bytes - begin.bytes;
+    sum.peak = std::max(sum.peak, peak);
+    sum.rss = std::max(sum.rss, rss);
+    sum.cached = std::max(sum.cached, cached);
+}
+
+// print the per-stage memory with the whole run as the last row, and write it
+// to memory.tsv under the output folder, shared by the tools as timings.tsv is.
+// the columns are: tool, stage, count, allocations, allocated megabytes, the
+// peak megabytes of live matrices, and the largest resident set in megabytes
+// seen at the stop of the stage (for the run, the peak resident set), and the
+// most megabytes the pool held cached at the stop of the stage (for the run, at
+// its end). the cached buffers are part of the resident set, not of the peak.
+
+void memory_write(const char* datapath, const char* tool)
+{
+    if (!memory_on) return;
+
+    uint64_t run_rss = memory_rss();
+    uint64_t allocs = 0, reused = 0, cached = 0;
+    if (pool_on) pool_stats(allocs, reused, cached);
+#ifdef __linux__
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        run_rss = std::max(run_rss, (uint64_t) usage.ru_maxrss * 1024);
+#endif
+
+    std::lock_guard<std::mutex> guard(memory_lock);
+    memory_stages.push_back("(run)");
+    memory_sums["(run)"] = memory_sum_t {
+        1, memory_allocs.load(), memory_bytes.load(), memory_top.load(), run_rss, cached
+    };
+
+    std::string tsvpath = std::string(datapath) + "/memory.tsv";
+    std::vector<std::string> rows;
+    read_other_rows(tsvpath.c_str(), tool, 8, rows);
+
+    printf(
+        "[i] %-12s %8s %10s %12s %10s %10s %10s \n",
+        "stage", "count", "allocs", "alloc (mb)", "peak (mb)", "rss (mb)", "pool (mb)"
+    );
+
+    char row[1024];
+    for (auto& stage : memory_stages) {
+        memory_sum_t& sum = memory_sums[stage];
+        double mb = 1024.0 * 1024.0;
+
+        printf(
+            "[i] %-12s %8llu %10llu %12.1f %10.1f %10.1f %10.1f \n",
+            stage.c_str(), (unsigned long long) sum.count, (unsigned long long) sum.allocs,
+            sum.bytes / mb, sum.peak / mb, sum.rss / mb, sum.cached / mb
+        );
+
+        snprintf(
+            row, sizeof(row), "%s\t%s\t%llu\t%llu\t%.3f\t%.3f\t%.3f\t%.3f",
+            tool, stage.c_str(), (unsigned long long) sum.count,
+            (unsigned long long) sum.allocs, sum.bytes / mb, sum.peak / mb, sum.rss / mb,
+            sum.cached / mb
+        );
+
+        rows.push_back(row);
+    }
+
+    FILE* tsv = fopen(tsvpath.c_str(), "w");
+    if (tsv == NULL) {
+        printf("[e] cannot write the memory usage to the output folder! \n");
+        return;
+    }
+
+    if (pool_on) {
+        printf(
+            "[i] pool: %llu allocations, %.1f%% reused, %.1f mb cached. \n",
+            (unsigned long long) allocs, allocs > 0 ? 100.0 * reused / allocs : 0.0,
+            cached / (1024.0 * 1024.0)
+        );
+    }
+
+    fprintf(tsv, "tool\tstage\tcount\tallocs\talloc_mb\tpeak_mb\trss_mb\tpool_mb\n");
+    for (auto& line : rows) fprintf(tsv, "%s\n", line.c_str());
+    fclose(tsv);
+}
+
+// the dimensions from the png ihdr chunk, or the first jpeg start-of-frame
+// segment. the exif orientation is not applied, so the width and height may be
+// swapped against the decoded image, which does not change the pixel count.
+
+static int read_be16(FILE* f)
+{
+    int hi = fgetc(f), lo = fgetc(f);
+    if (hi == EOF || lo == EOF) return -1;
+    return (hi << 8) | lo;
+}
+
+bool image_size(const char* fname, int& width, int& height)
+{
+    FILE* f = fopen(fname, "rb");
+    if (f == NULL) return false;
+
+    unsigned char head[24];
+    bool found = false;
+    if (fread(head, 1, 2, f) != 2) { fclose(f); return false; }
+
+    if (head[0] == 0x89 && head[1] == 'P') {
+        if (fread(head + 2, 1, 22, f) == 22 && memcmp(head + 12, "IHDR", 4) == 0) {
+            width = (head[16] << 24) | (head[17] << 16) | (head[18] << 8) | head[19];
+            height = (head[20] << 24) | (head[21] << 16) | (head[22] << 8) | head[23];
+            found = true;
+        }
+
+    } else if (head[0] == 0xff && head[1] == 0xd8) {
+        while (!found) {
+            int c = fgetc(f);
+            if (c == EOF) break;
+            if (c != 0xff) continue;
+
+            int marker = fgetc(f);
+            while (marker == 0xff) marker = fgetc(f);
+            if (marker == EOF || marker == 0xd9 || marker == 0xda) break;
+            if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7)) continue;
+
+            int length = read_be16(f);
+            if (length < 2) break;
+
+            // the start-of-frame markers c0 to cf, save dht (c4), jpg (c8) and dac (cc).
+
+            if (marker >= 0xc0 && marker <= 0xcf &&
+                marker != 0xc4 && marker != 0xc8 && marker != 0xcc) {
+                fgetc(f);
+                height = read_be16(f);
+                width = read_be16(f);
+                found = height > 0 && width > 0;
+                break;
+            }
+
+            if (fseek(f, length - 2, SEEK_CUR) != 0) break;
+        }
+    }
+
+    fclose(f);
+    return found;
+}
@@ -14,6 +14,8 @@
 //    You should have received a copy of the GNU General Public License
 //    along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#pragma once
+
 #define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
 #define _CRT_SECURE_NO_WARNINGS
 #define _ARGPARSE_NO_PRINT_ARGUMENT_PROPS
@@ -21,6 +23,12 @@
 #include <iostream>
 #include <vector>
 #include <memory>
+#include <map>
+#include <set>
+#include <string>
+#include <chrono>
+#include <filesystem>
+#include <cstdint>
 
 #include <opencv2/opencv.hpp>
 
@@ -56,8 +64,333 @@ void extract_flank(
     int flank, int extend
 );
 
+// the pixel kernels of reverse, color_significance, get_bilinear,
+// extract_flank, infect, any, any_right and measure are dispatched at runtime
+// to the best instruction set of the cpu (scalar, sse4.2, avx2 or avx512), or
+// to the one named by --isa. every variant gives the results of the scalar
+// kernels, byte for byte.
+
+bool isa_open(const char* name, bool show_msg = true);
+const char* isa_name();
+
 void show(cv::Mat& matrix, const char* window, int width = 800, int height = 600);
 void hist(cv::Mat& grayscale, cv::Mat mask);
 int quartile(cv::Mat& grayscale, cv::Mat mask, double lower);
 int any(cv::Mat& binary);
 int any_right(cv::Mat& binary, int col);
+
+// measurements of one segmented roi, as written into raw.tsv. the fields are
+// -1 when the segmentation finds no foreground.
+
+typedef struct measure {
+    bool detected;
+    double fore_mean;
+    int fore_size;
+    double back_strict;
+    double back_loose;
+} measure_t;
+
+void measure(
+    cv::Mat& roi, cv::Mat& foreground, cv::Mat& back_strict, cv::Mat& back_loose,
+    bool detected, measure_t& out
+);
+
+// content-addressed segmentation cache. the key is a hash of the roi pixels
+// seeded by a hash of the segmentation parameters, so that any change to the
+// image or the parameters misses the cache.
+
+uint64_t hash_bytes(const void* data, size_t len, uint64_t seed);
+uint64_t hash_mat(cv::Mat& image, uint64_t seed);
+uint64_t hash_file(const char* fname, uint64_t seed);
+uint64_t hash_contents(std::vector<uchar>& bytes, uint64_t seed);
+bool read_file(const char* fname, std::vector<uchar>& bytes);
+
+bool cache_open(const char* datapath);
+bool cache_lookup(
+    uint64_t key, measure_t& entry,
+    std::vector<cv::Mat>& masks, cv::Mat& overlap
+);
+void cache_store(
+    uint64_t key, measure_t& entry,
+    std::vector<cv::Mat>& masks, cv::Mat& overlap
+);
+void cache_close();
+
+// previous results in raw.tsv or stats.tsv, sorted by uid. the lines of uids
+// not segmented in this run are merged back in uid order when rewriting.
+
+typedef struct results {
+    std::vector<char*> lines;
+    std::vector<int> uids;
+    size_t written;
+} results_t;
+
+void read_results(const char* fname, results_t& res);
+char* find_result(results_t& res, int uid);
+void write_previous(FILE* out, results_t& res, int upto, std::set<int>& keep);
+int split_columns(char* line, std::vector<char*>& cols);
+bool result_matches(
+    const char* rawline, const char* fname, int sid, const char* name,
+    bool det_success, bool scale_success, int scale_dark, int scale_light
+);
+uint64_t result_source(const char* rawline);
+
+// one row of the results, the columns of raw.tsv. the foreground flag is
+// measures.detected. source is the content hash of the source image the row
+// is segmented from (hash_file), 0 if unknown.
+
+typedef struct result_row {
+    int uid;
+    const char* fname;
+    int sid;
+    const char* name;
+    bool det_success;
+    bool scale_success;
+    int scale_dark;
+    int scale_light;
+    measure_t measures;
+    uint64_t source;
+} result_row_t;
+
+void write_raw_row(FILE* out, result_row_t& row);
+bool write_stat_row(FILE* out, result_row_t& row);
+bool stat_values(result_row_t& row, double* values);
+
+// the binary columnar results (results.bin, --binary), in place of raw.tsv and
+// stats.tsv. the numeric columns are fixed-width, the file and sample names are
+// indices into a dictionary of strings, and the rows are indexed by uid, so a
+// row is updated in place or appended without rewriting the file. stats.tsv is
+// derived from the same columns. blobtsv converts the file to the two tables.
+
+typedef struct columns {
+    FILE* file;
+    bool writable;
+    uint32_t rows;
+    uint32_t capacity;
+    uint64_t dict_end;
+    std::vector<std::string> dict;
+    std::map<std::string, int> dict_index;
+    std::map<int, uint32_t> index;
+} columns_t;
+
+bool columns_open(columns_t& cols, const char* fname, bool writable);
+void columns_put(columns_t& cols, result_row_t& row);
+void columns_retain(columns_t& cols, std::set<int>& keep);
+void columns_rows(columns_t& cols, std::vector<result_row_t>& rows);
+int columns_range(columns_t& cols, uint32_t begin, uint32_t count, std::vector<result_row_t>& rows);
+bool columns_matches(
+    columns_t& cols, int uid, const char* fname, int sid, const char* name,
+    bool det_success, bool scale_success, int scale_dark, int scale_light
+);
+uint64_t columns_source(columns_t& cols, int uid);
+void columns_close(columns_t& cols);
+
+// a batch of rois to segment, stored column by column. the file and sample
+// names of the rois are kept in one arena, addressed by their offsets. the
+// output columns are sized for the whole batch by batch_outputs, so that the
+// workers on disjoint slices of the batch write their own rows unlocked. the
+// masks of the rois whose detection failed are 3x3 blanks.
+
+typedef struct roi_batch {
+    std::vector<int> uid;
+    std::vector<int> sid;
+    std::vector<size_t> fname_at;
+    std::vector<size_t> name_at;
+    std::vector<char> arena;
+    std::vector<uchar> det_success;
+    std::vector<uchar> scale_success;
+    std::vector<int> scale_dark;
+    std::vector<int> scale_light;
+    std::vector<uint64_t> source;
+    std::vector<cv::Mat> rois;
+
+    // the encoded source files of the rois not decoded yet (with --quick),
+    // empty otherwise.
+
+    std::vector<std::vector<uchar>> encoded;
+
+    // the outputs of the segmentation. prediction is the grayscale output of
+    // the network, only filled by blobnn.
+
+    std::vector<uchar> hit;
+    std::vector<uint64_t> keys;
+    std::vector<measure_t> measures;
+    std::vector<cv::Mat> back_strict;
+    std::vector<cv::Mat> back_loose;
+    std::vector<cv::Mat> foreground;
+    std::vector<cv::Mat> prediction;
+    std::vector<cv::Mat> overlap;
+    std::vector<uchar> has_foreground;
+} roi_batch_t;
+
+// the rows [begin, end) of a batch.
+
+typedef struct roi_slice {
+    int begin;
+    int end;
+} roi_slice_t;
+
+void batch_push(
+    roi_batch_t& batch, int uid, const char* fname, int sid, const char* name,
+    bool det_success, bool scale_success, int scale_dark, int scale_light, cv::Mat& roi,
+    uint64_t source = 0
+);
+int batch_size(roi_batch_t& batch);
+const char* batch_fname(roi_batch_t& batch, int i);
+const char* batch_name(roi_batch_t& batch, int i);
+void batch_outputs(roi_batch_t& batch);
+void batch_slices(roi_batch_t& batch, int workers, std::vector<roi_slice_t>& slices);
+void batch_take(roi_batch_t& dst, roi_batch_t& src, int i);
+void batch_release(roi_batch_t& batch, int i);
+cv::Mat decode_roi(std::vector<uchar>& encoded);
+void batch_clear(roi_batch_t& batch);
+
+// a segmenter fills the output columns of the rows in a slice of a batch,
+// skipping the cache hits. masks is the number of masks it stacks into the
+// cache (strict, loose, foreground, and the prediction if 4), and params seeds
+// its cache keys. a serial segmenter (holding one model) always runs the batch
+// in one slice. the tools pick theirs among the segmenters below, and blobseg
+// runs several over one decode of the rois.
+
+typedef struct segmenter {
+    const char* name;
+    int masks;
+    bool serial;
+    uint64_t (*params)();
+    void (*segment)(bool show_msg, roi_batch_t& batch, roi_slice_t slice);
+} segmenter_t;
+
+extern segmenter_t shed_segmenter;
+
+void segment_batch(segmenter_t& seg, roi_batch_t& batch, int jobs, bool use_cache, bool show_msg);
+void batch_measure(roi_batch_t& batch, bool use_cache);
+
+// the results of a segmenter under one folder: raw.tsv, stats.tsv (or
+// results.bin in binary) and the annots and masks subfolders. the previous
+// lines of the uids not segmented are merged back in uid order, up to
+// sink_close.
+
+typedef struct sink {
+    char datapath[1024];
+    bool binary;
+    columns_t columns;
+    std::set<int> written;
+    FILE* rawfile;
+    FILE* statfile;
+    results_t raws;
+    results_t stats;
+} sink_t;
+
+bool sink_open(sink_t& sink, const char* datapath, bool binary = false);
+bool sink_stale(
+    sink_t& sink, int uid, const char* fname, int sid, const char* name,
+    bool det_success, bool scale_success, int scale_dark, int scale_light,
+    uint64_t source
+);
+void sink_images(sink_t& sink, roi_batch_t& batch, int i);
+void sink_write(
+    sink_t& sink, roi_batch_t& batch, std::set<int>& kept, bool use_cache,
+    bool images = true
+);
+void sink_close(sink_t& sink, std::set<int>& kept);
+
+// stage timings. a stage_timer records the time from its construction to its
+// destruction (or stop) into the latency histogram of the named stage. the
+// histograms are log-linear (hdr-style) over microseconds, with 32 buckets per
+// power of two, so the quantiles are accurate within about 3%.
+
+typedef struct histogram {
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    double sum;
+    double min;
+    double max;
+} histogram_t;
+
+void histogram_add(histogram_t& hist, double us);
+double histogram_quantile(histogram_t& hist, double q);
+
+// hardware performance counters (--counters), read through perf_event_open on
+// linux. each stage timer also takes the cycles, instructions, cache misses and
+// branch misses of its thread between its start and stop. where the counters
+// are not permitted (perf_event_paranoid, containers, other platforms) they are
+// simply left off, and an event the cpu lacks reads as zero.
+
+typedef struct counters {
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t cache_misses;
+    uint64_t branch_misses;
+} counters_t;
+
+bool counters_open();
+bool counters_read(counters_t& out);
+void counters_record(const char* stage, counters_t& begin, counters_t& end);
+void counters_write(const char* datapath, const char* tool);
+
+// pooled matrix buffers. a released buffer is kept in the free list of its
+// size class (four classes per power of two, up to 64 mb) and handed to the
+// next matrix of the class, so that the per-roi and per-photograph temporaries
+// stop going through malloc. the cached bytes are capped by limit, beyond
+// which the buffers are freed. the tools install the pool at the start of the
+// run, with the limit of pool_share. the matrices over the data of the caller
+// are left to opencv.
+
+void pool_open(size_t limit = (size_t) 256 << 20);
+void pool_stats(uint64_t& allocs, uint64_t& reused, uint64_t& cached);
+size_t pool_share(double budget);
+
+// memory accounting (--memory). the matrix buffers are allocated through a
+// tracking allocator that counts the allocations and the live bytes, and each
+// stage timer takes the allocations of its stage, the peak of the live bytes
+// while it runs, and the resident set size of the process at its stop. the
+// peaks of stages running at once on several threads are shared.
+
+typedef struct memory {
+    uint64_t allocs;
+    uint64_t bytes;
+    uint64_t live;
+    uint64_t peak;
+} memory_t;
+
+void memory_open();
+bool memory_begin(memory_t& out);
+void memory_end(const char* stage, memory_t& begin);
+void memory_write(const char* datapath, const char* tool);
+uint64_t memory_rss();
+
+// the width and height of a jpeg or png from its header, without decoding it.
+// used to estimate the footprint of a photograph (or a roi) before loading it
+// under a memory budget (--mem-budget).
+
+bool image_size(const char* fname, int& width, int& height);
+
+typedef struct stage_timer {
+    const char* stage;
+    std::chrono::steady_clock::time_point start;
+    bool running;
+    int uid;
+    int level;
+    bool counting;
+    counters_t begin;
+    bool tracking;
+    memory_t memory;
+
+    stage_timer(const char* stage, int uid = -1, int level = -1);
+    ~stage_timer();
+    double stop();
+} stage_timer_t;
+
+void timing_record(const char* stage, double ms);
+void timing_write(const char* datapath, const char* tool);
+
+// with tracing on (--trace), every stopped timer also emits a span to the
+// chrome trace-event file, tagged with the thread, and the uid and the ladder
+// level when given (-1 if not).
+
+bool trace_open(const char* fname, const char* tool);
+void trace_span(
+    const char* name, std::chrono::steady_clock::time_point start,
+    double ms, int uid, int level
+);
+void trace_close();
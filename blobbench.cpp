@@ -0,0 +1,681 @@
+//    Copyright (C) 2024 Zheng Yang <xornent@outlook.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "blobbench.h"
+
+#include <iostream>
+#include <chrono>
+#include <atomic>
+#include <new>
+
+#ifdef unix
+#include <argp.h>
+#else
+#include "argparse/argparse.hpp"
+#endif
+
+namespace chrono = std::chrono;
+
+#include <opencv2/opencv.hpp>
+
+// ============================================================================
+
+int photo_width = 2048;
+int photo_height = 1536;
+int roi_width = 160;
+int roi_height = 64;
+uint64_t seed = 42;
+double min_time = 0.5;
+char only[128] = "";
+char outpath[1024] = "";
+char isa[128] = ""; // empty for the best the cpu supports.
+bool check_only = false;
+
+// allocations. the heap allocations of c++ (operator new) and the pixel
+// buffers of cv::Mat (through the default mat allocator) are counted apart.
+// the row tables of infect (the vectors of matrix) are heap allocations.
+
+static std::atomic<uint64_t> heap_allocs(0);
+static std::atomic<uint64_t> mat_allocs(0);
+
+void* operator new(size_t size)
+{
+    heap_allocs++;
+    void* ptr = malloc(size > 0 ? size : 1);
+    if (ptr == NULL) throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+
+class counting_allocator : public cv::MatAllocator
+{
+public:
+    cv::UMatData* allocate(
+        int dims, const int* sizes, int type, void* data, size_t* step,
+        cv::AccessFlag flags, cv::UMatUsageFlags usage) const override
+    {
+        mat_allocs++;
+        return cv::Mat::getStdAllocator() -> allocate(dims, sizes, type, data, step, flags, usage);
+    }
+
+    bool allocate(cv::UMatData* data, cv::AccessFlag flags, cv::UMatUsageFlags usage) const override
+    {
+        return cv::Mat::getStdAllocator() -> allocate(data, flags, usage);
+    }
+
+    void deallocate(cv::UMatData* data) const override
+    {
+        cv::Mat::getStdAllocator() -> deallocate(data);
+    }
+};
+
+static counting_allocator allocator;
+
+// ============================================================================
+
+// argument parser
+
+static char doc[] =
+    "blobbench: microbenchmarks of the image primitives shared by the tools, on " soft_br
+    "synthetic photographs and rois generated from a fixed seed. reports the time per " soft_br
+    "call and per pixel, the throughput, and the allocations per call. with --check, " soft_br
+    "compares the results of the dispatched pixel kernels with the scalar ones instead. \n\n"
+    "this software is a free software licensed under gnu gplv3. it comes with absolutely " soft_br
+    "no warranty. for details, see <https://www.gnu.org/licenses/gpl-3.0.html>";
+
+static char args_doc[] =
+    "[-x WIDTH] [-y HEIGHT] [-u ROIW] [-v ROIH] [-e SEED] [-t SECONDS] [-k KERNEL] [-o FILE] [-I NAME] [-c]";
+
+#ifdef unix
+static struct argp_option options[] = {
+    { "width", 'x', "WIDTH", 0, "width of the synthetic photograph (2048)"},
+    { "height", 'y', "HEIGHT", 0, "height of the synthetic photograph (1536)"},
+    { "roi-width", 'u', "ROIW", 0, "width of the synthetic roi (160)"},
+    { "roi-height", 'v', "ROIH", 0, "height of the synthetic roi (64)"},
+    { "seed", 'e', "SEED", 0, "seed of the synthetic images (42)"},
+    { "time", 't', "SECONDS", 0, "minimal time to run each kernel, after one warm-up call. "
+      "at least three calls are timed (0.5)"},
+    { "kernel", 'k', "KERNEL", 0, "run only the named kernel"},
+    { "output", 'o', "FILE", 0, "also write the results as a tab-separated table to FILE"},
+    { "isa", 'I', "NAME", 0, "run the pixel kernels with the instruction set NAME: scalar, "
+      "sse4.2, avx2, avx512, or auto for the best the cpu supports (auto)"},
+    { "check", 'c', 0, 0, "check that the kernels of the instruction set give the results "
+      "of the scalar kernels on the synthetic inputs, instead of timing them"},
+    { 0 }
+};
+
+const char *argp_program_version = "spblob:blobbench 1.5";
+const char *argp_program_bug_address = "yang-z. <xornent@outlook.com>";
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    switch (key) {
+        case 'x': photo_width = atoi(arg); break;
+        case 'y': photo_height = atoi(arg); break;
+        case 'u': roi_width = atoi(arg); break;
+        case 'v': roi_height = atoi(arg); break;
+        case 'e': seed = strtoull(arg, NULL, 10); break;
+        case 't': min_time = atof(arg); break;
+        case 'k': strcpy(only, arg); break;
+        case 'o': strcpy(outpath, arg); break;
+        case 'I': strcpy(isa, arg); break;
+        case 'c': check_only = true; break;
+        case ARGP_KEY_ARG: argp_usage(state); break;
+        default: return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+#endif
+
+// ============================================================================
+
+// the prepared inputs of the kernels.
+
+static cv::Mat roi;          // grayscale roi of a test paper with a dark blob.
+static cv::Mat roi_usm;      // the usm sharpened roi, as infect sees it.
+static cv::Mat roi_binary;   // a thresholded roi.
+static cv::Mat roi_mask;     // all-set mask for quartile.
+static cv::Mat photo_gray;
+static cv::Mat photo_hsv;
+static cv::Mat photo_red;    // the output of color_significance.
+static std::vector<cv::Point2d> samples;
+static cv::Point2d flank_origin, flank_orient, flank_up;
+static volatile int sink = 0;
+
+#define n_samples 65536
+#define n_rays 256
+
+// a roi of a test paper: the paper background with a smooth illumination
+// gradient and sensor noise, a dark blurred blob in the middle, and a few small
+// dark specks of dirt, the same structure blobshed segments.
+
+void synth_roi(cv::Mat& gray, int width, int height, cv::RNG& rng)
+{
+    cv::Mat base(cv::Size(width, height), CV_8U);
+    for (int r = 0; r < height; r++) {
+        uchar* row = base.ptr<uchar>(r);
+        for (int c = 0; c < width; c++)
+            row[c] = cv::saturate_cast<uchar>(185 + 12.0 * c / width - 6.0 * r / height);
+    }
+
+    cv::Mat blob = cv::Mat::zeros(base.size(), CV_8U);
+    cv::ellipse(
+        blob, cv::Point(width / 2, height / 2),
+        cv::Size(width / 5, height / 3), rng.uniform(0.0, 180.0), 0, 360,
+        cv::Scalar(70), -1
+    );
+
+    for (int i = 0; i < 6; i++)
+        cv::circle(
+            blob, cv::Point(rng.uniform(0, width), rng.uniform(0, height)),
+            rng.uniform(1, 3), cv::Scalar(40), -1
+        );
+
+    cv::GaussianBlur(blob, blob, cv::Size(0, 0), 2.5);
+    cv::subtract(base, blob, base);
+
+    cv::Mat noise(base.size(), CV_16S);
+    rng.fill(noise, cv::RNG::NORMAL, cv::Scalar(0), cv::Scalar(5));
+    cv::Mat signed_base;
+    base.convertTo(signed_base, CV_16S);
+    cv::add(signed_base, noise, signed_base);
+    signed_base.convertTo(gray, CV_8U);
+}
+
+// a photograph of a sheet of test papers: the light paper, dark rows of print,
+// and pairs of red positioning triangles along the left, slightly blurred.
+
+void synth_photo(cv::Mat& colored, int width, int height, cv::RNG& rng)
+{
+    colored = cv::Mat(cv::Size(width, height), CV_8UC3, cv::Scalar(205, 208, 210));
+
+    int papers = std::max(1, height / 256);
+    int pitch = height / papers;
+    int edge = std::max(8, pitch / 10);
+
+    for (int p = 0; p < papers; p++) {
+        int top = p * pitch + pitch / 4;
+        int bottom = p * pitch + pitch * 3 / 4;
+        int left = width / 16;
+
+        std::vector<cv::Point> upper = {
+            cv::Point(left, top), cv::Point(left + edge, top), cv::Point(left, top + edge)
+        };
+        std::vector<cv::Point> lower = {
+            cv::Point(left, bottom), cv::Point(left + edge, bottom), cv::Point(left, bottom - edge)
+        };
+
+        cv::fillConvexPoly(colored, upper, cv::Scalar(45, 40, 200));
+        cv::fillConvexPoly(colored, lower, cv::Scalar(45, 40, 200));
+
+        for (int line = top; line < bottom; line += std::max(4, edge / 2))
+            cv::line(
+                colored, cv::Point(left + 2 * edge, line),
+                cv::Point(rng.uniform(width / 2, width - left), line),
+                cv::Scalar(60, 60, 60), 1
+            );
+
+        cv::circle(
+            colored, cv::Point(width / 2, (top + bottom) / 2), edge,
+            cv::Scalar(120, 130, 140), -1
+        );
+    }
+
+    cv::GaussianBlur(colored, colored, cv::Size(0, 0), 1.2);
+    cv::Mat noise(colored.size(), CV_16SC3);
+    rng.fill(noise, cv::RNG::NORMAL, cv::Scalar::all(0), cv::Scalar::all(4));
+    cv::Mat signed_photo;
+    colored.convertTo(signed_photo, CV_16SC3);
+    cv::add(signed_photo, noise, signed_photo);
+    signed_photo.convertTo(colored, CV_8UC3);
+}
+
+void prepare(int photo_width, int photo_height, int roi_width, int roi_height, uint64_t seed)
+{
+    cv::RNG rng(seed);
+
+    synth_roi(roi, roi_width, roi_height, rng);
+    cv::Mat blurred, blur_usm;
+    cv::GaussianBlur(roi, blurred, cv::Size(5, 5), 0);
+    cv::GaussianBlur(blurred, blur_usm, cv::Size(0, 0), 25);
+    cv::addWeighted(blurred, 1.5, blur_usm, -0.5, 0, roi_usm);
+    cv::threshold(roi, roi_binary, 150, 255, cv::THRESH_BINARY);
+    roi_mask = cv::Mat(roi.size(), CV_8U, cv::Scalar(255));
+
+    cv::Mat photo;
+    synth_photo(photo, photo_width, photo_height, rng);
+    cv::cvtColor(photo, photo_gray, cv::COLOR_BGR2GRAY);
+    cv::cvtColor(photo, photo_hsv, cv::COLOR_BGR2HSV);
+    photo_red = cv::Mat::zeros(photo_gray.size(), CV_8U);
+
+    samples.clear();
+    for (int i = 0; i < n_samples; i++)
+        samples.push_back(cv::Point2d(
+            rng.uniform(0.0, photo_width - 1.0), rng.uniform(0.0, photo_height - 1.0)
+        ));
+
+    double angle = 10.0 * CV_PI / 180.0;
+    flank_origin = cv::Point2d(photo_width / 4.0, photo_height / 2.0);
+    flank_orient = cv::Point2d(cos(angle), sin(angle));
+    flank_up = cv::Point2d(sin(angle), -cos(angle));
+}
+
+// ============================================================================
+
+// the kernels. each reproduces how the tools call the primitive.
+
+static int ray_length() { return std::min(photo_width, photo_height) / 2 - 2; }
+
+static void run_infect()
+{
+    cv::Mat out = cv::Mat::zeros(roi_usm.size(), CV_8U);
+    infect(roi_usm, out, cv::Point(1, (roi_usm.rows - 1) / 2 + 1), 0.05);
+    sink += out.at<uchar>(0, 0);
+}
+
+static void run_usm()
+{
+    cv::Mat blurred, blur_usm, usm;
+    cv::GaussianBlur(roi, blurred, cv::Size(5, 5), 0);
+    cv::GaussianBlur(blurred, blur_usm, cv::Size(0, 0), 25);
+    cv::addWeighted(blurred, 1.5, blur_usm, -0.5, 0, usm);
+    sink += usm.at<uchar>(0, 0);
+}
+
+static void run_extract_flank()
+{
+    cv::Mat out;
+    extract_flank(
+        photo_gray, out, flank_origin, flank_orient, flank_up,
+        roi_height / 2, roi_width
+    );
+    sink += out.at<uchar>(0, 0);
+}
+
+static void run_get_bilinear()
+{
+    int sum = 0;
+    for (auto& p : samples) sum += get_bilinear(photo_gray, p.x, p.y);
+    sink += sum;
+}
+
+static void run_color_significance()
+{
+    color_significance(photo_hsv, photo_red, 0.0);
+    sink += photo_red.at<uchar>(0, 0);
+}
+
+static void run_boundary()
+{
+    cv::Point2d center(photo_width / 2.0, photo_height / 2.0);
+    int sum = 0;
+    for (int i = 0; i < n_rays; i++) {
+        double angle = 2 * CV_PI * i / n_rays;
+        sum += boundary(
+            photo_gray, center, cv::Point2d(cos(angle), sin(angle)),
+            ray_length(), 0.05
+        );
+    }
+    sink += sum;
+}
+
+static void run_quartile()
+{
+    sink += quartile(roi, roi_mask, 0.40);
+}
+
+static void run_reverse()
+{
+    reverse(roi_binary);
+    sink += roi_binary.at<uchar>(0, 1);
+}
+
+static void run_any()
+{
+    sink += any(roi_binary);
+}
+
+static void run_any_right()
+{
+    sink += any_right(roi_binary, roi_binary.cols - 20);
+}
+
+static void run_measure()
+{
+    measure_t m;
+    measure(roi, roi_binary, roi_mask, roi_mask, true, m);
+    sink += m.fore_size;
+}
+
+// ============================================================================
+
+// the outputs of the dispatched primitives, compared byte for byte between the
+// selected kernels and the scalar ones. the flanks cover a strip across the
+// photograph and one crossing its corner, where the points fall outside.
+
+typedef struct probe {
+    const char* name;
+    void (*call)(std::vector<uchar>& out);
+} probe_t;
+
+static void append(std::vector<uchar>& out, cv::Mat& mat)
+{
+    for (int r = 0; r < mat.rows; r++)
+        out.insert(out.end(), mat.ptr(r), mat.ptr(r) + mat.cols * mat.elemSize());
+}
+
+static void append(std::vector<uchar>& out, const void* data, size_t len)
+{
+    out.insert(out.end(), (const uchar*) data, (const uchar*) data + len);
+}
+
+static void probe_color_significance(std::vector<uchar>& out)
+{
+    cv::Mat red = cv::Mat::zeros(photo_gray.size(), CV_8U);
+    color_significance(photo_hsv, red, 0.0);
+    append(out, red);
+}
+
+static void probe_extract_flank(std::vector<uchar>& out)
+{
+    cv::Mat inner, corner;
+    extract_flank(
+        photo_gray, inner, flank_origin, flank_orient, flank_up,
+        roi_height / 2, roi_width
+    );
+
+    extract_flank(
+        photo_gray, corner, cv::Point2d(photo_width - roi_width / 2.0, -roi_height / 4.0),
+        flank_orient, flank_up, roi_height / 2, roi_width
+    );
+
+    append(out, inner);
+    append(out, corner);
+}
+
+static void probe_get_bilinear(std::vector<uchar>& out)
+{
+    for (auto& p : samples) out.push_back(get_bilinear(photo_gray, p.x, p.y));
+}
+
+static void probe_reverse(std::vector<uchar>& out)
+{
+    cv::Mat binary = roi_binary.clone();
+    reverse(binary);
+    append(out, binary);
+}
+
+static void probe_any(std::vector<uchar>& out)
+{
+    int counts[2] = { any(roi_binary), any_right(roi_binary, roi_binary.cols - 20) };
+    append(out, counts, sizeof(counts));
+}
+
+static void probe_infect(std::vector<uchar>& out)
+{
+    cv::Mat fill = cv::Mat::zeros(roi_usm.size(), CV_8U);
+    infect(roi_usm, fill, cv::Point(1, (roi_usm.rows - 1) / 2 + 1), 0.05);
+    append(out, fill);
+}
+
+static void probe_measure(std::vector<uchar>& out)
+{
+    measure_t m;
+    measure(roi, roi_binary, roi_mask, roi_binary, true, m);
+    double values[4] = { m.fore_mean, (double) m.fore_size, m.back_strict, m.back_loose };
+    append(out, values, sizeof(values));
+}
+
+// returns the number of primitives whose results differ.
+
+int check()
+{
+    probe_t probes[] = {
+        { "color_significance", probe_color_significance },
+        { "extract_flank", probe_extract_flank },
+        { "get_bilinear", probe_get_bilinear },
+        { "reverse", probe_reverse },
+        { "any", probe_any },
+        { "infect", probe_infect },
+        { "measure", probe_measure },
+    };
+
+    std::string active = isa_name();
+    int differ = 0;
+
+    for (auto& probe : probes) {
+        if (only[0] != 0 && strcmp(only, probe.name) != 0) continue;
+
+        std::vector<uchar> dispatched, scalar;
+        isa_open(active.c_str(), false);
+        probe.call(dispatched);
+        isa_open("scalar", false);
+        probe.call(scalar);
+
+        if (dispatched == scalar)
+            printf("[i] %-20s same as scalar. \n", probe.name);
+        else {
+            printf("[e] %-20s differs from scalar! \n", probe.name);
+            differ += 1;
+        }
+    }
+
+    isa_open(active.c_str(), false);
+    return differ;
+}
+
+// ============================================================================
+
+// run the kernel once to warm up, then at least three times and until
+// min_time seconds are spent.
+
+void bench(kernel_t& kernel, double min_time, FILE* out)
+{
+    kernel.call();
+
+    uint64_t heap_before = heap_allocs;
+    uint64_t mat_before = mat_allocs;
+    int calls = 0;
+    double elapsed = 0;
+
+    auto start = chrono::steady_clock::now();
+    while (calls < 3 || elapsed < min_time) {
+        kernel.call();
+        calls += 1;
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    double ns_call = elapsed * 1e9 / calls;
+    double ns_pixel = ns_call / kernel.pixels;
+    double mpx_s = kernel.pixels * calls / elapsed / 1e6;
+    double mats = (double) (mat_allocs - mat_before) / calls;
+    double heap = (double) (heap_allocs - heap_before) / calls;
+
+    printf(
+        "[i] %-20s %8d %14.0f %10.3f %10.2f %8.1f %8.1f \n",
+        kernel.name, calls, ns_call, ns_pixel, mpx_s, mats, heap
+    );
+
+    if (out != NULL)
+        fprintf(
+            out, "%s\t%.0f\t%d\t%.0f\t%.4f\t%.3f\t%.2f\t%.2f\n",
+            kernel.name, kernel.pixels, calls, ns_call, ns_pixel, mpx_s, mats, heap
+        );
+}
+
+int main(int argc, char* argv[])
+{
+#ifdef unix
+    argp_parse(&argp, argc, argv, 0, 0, NULL);
+#else
+
+    argparse::ArgumentParser program("blobbench", "1.5");
+
+    program.add_argument("-x", "--width")
+        .help("width of the synthetic photograph (2048)")
+        .metavar("WIDTH")
+        .default_value(photo_width)
+        .scan<'i', int>();
+
+    program.add_argument("-y", "--height")
+        .help("height of the synthetic photograph (1536)")
+        .metavar("HEIGHT")
+        .default_value(photo_height)
+        .scan<'i', int>();
+
+    program.add_argument("-u", "--roi-width")
+        .help("width of the synthetic roi (160)")
+        .metavar("ROIW")
+        .default_value(roi_width)
+        .scan<'i', int>();
+
+    program.add_argument("-v", "--roi-height")
+        .help("height of the synthetic roi (64)")
+        .metavar("ROIH")
+        .default_value(roi_height)
+        .scan<'i', int>();
+
+    program.add_argument("-e", "--seed")
+        .help("seed of the synthetic images (42)")
+        .metavar("SEED")
+        .default_value((unsigned long long) 42)
+        .scan<'u', unsigned long long>();
+
+    program.add_argument("-t", "--time")
+        .help("minimal time to run each kernel, after one warm-up call. at least " soft_br
+              "three calls are timed (0.5)")
+        .metavar("SECONDS")
+        .default_value(min_time)
+        .scan<'f', double>();
+
+    program.add_argument("-k", "--kernel")
+        .help("run only the named kernel")
+        .metavar("KERNEL")
+        .default_value(std::string(""));
+
+    program.add_argument("-o", "--output")
+        .help("also write the results as a tab-separated table to FILE")
+        .metavar("FILE")
+        .default_value(std::string(""));
+
+    program.add_argument("-I", "--isa")
+        .help("run the pixel kernels with the instruction set NAME: scalar, sse4.2, " soft_br
+              "avx2, avx512, or auto for the best the cpu supports (auto)")
+        .metavar("NAME")
+        .default_value(std::string(""));
+
+    program.add_argument("-c", "--check")
+        .help("check that the kernels of the instruction set give the results of the " soft_br
+              "scalar kernels on the synthetic inputs, instead of timing them")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_description(doc);
+
+    try { program.parse_args(argc, argv); }
+    catch (const std::exception& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    photo_width = program.get<int>("--width");
+    photo_height = program.get<int>("--height");
+    roi_width = program.get<int>("--roi-width");
+    roi_height = program.get<int>("--roi-height");
+    seed = program.get<unsigned long long>("--seed");
+    min_time = program.get<double>("--time");
+    strcpy(only, program.get("--kernel").c_str());
+    strcpy(outpath, program.get("--output").c_str());
+    strcpy(isa, program.get("--isa").c_str());
+    check_only = program.get<bool>("--check");
+
+#endif
+
+    if (photo_width < 64 || photo_height < 64 || roi_width < 32 || roi_height < 8) {
+        printf("[e] the photograph should be at least 64 x 64, and the roi 32 x 8. \n");
+        return 1;
+    }
+
+    if (!isa_open(isa)) return 1;
+
+    cv::Mat::setDefaultAllocator(&allocator);
+    prepare(photo_width, photo_height, roi_width, roi_height, seed);
+
+    if (check_only) {
+        int differ = check();
+        cv::Mat::setDefaultAllocator(NULL);
+        return differ == 0 ? 0 : 1;
+    }
+
+    double roi_pixels = (double) roi_width * roi_height;
+    double photo_pixels = (double) photo_width * photo_height;
+
+    kernel_t kernels[] = {
+        { "infect", run_infect, roi_pixels },
+        { "usm", run_usm, roi_pixels },
+        { "extract_flank", run_extract_flank, (roi_height / 2 * 2 + 1.0) * roi_width },
+        { "get_bilinear", run_get_bilinear, (double) n_samples },
+        { "color_significance", run_color_significance, photo_pixels },
+        { "boundary", run_boundary, (double) n_rays * (ray_length() + 1) },
+        { "quartile", run_quartile, roi_pixels },
+        { "reverse", run_reverse, roi_pixels },
+        { "any", run_any, roi_pixels },
+        { "any_right", run_any_right, (double) roi_height * 20 },
+        { "measure", run_measure, roi_pixels },
+    };
+
+    FILE* out = NULL;
+    if (outpath[0] != 0) {
+        out = fopen(outpath, "w");
+        if (out == NULL) {
+            printf("[e] cannot open the output file %s! \n", outpath);
+            return 1;
+        }
+
+        fprintf(out, "kernel\tpixels\tcalls\tns_call\tns_pixel\tmpx_s\tmats_call\tnews_call\n");
+    }
+
+    printf(
+        "[i] photograph %d x %d, roi %d x %d, seed %llu. \n",
+        photo_width, photo_height, roi_width, roi_height, (unsigned long long) seed
+    );
+
+    printf(
+        "[i] %-20s %8s %14s %10s %10s %8s %8s \n",
+        "kernel", "calls", "ns/call", "ns/px", "mpx/s", "mats", "news"
+    );
+
+    int ran = 0;
+    for (auto& kernel : kernels) {
+        if (only[0] != 0 && strcmp(only, kernel.name) != 0) continue;
+        bench(kernel, min_time, out);
+        ran += 1;
+    }
+
+    if (out != NULL) fclose(out);
+    cv::Mat::setDefaultAllocator(NULL);
+
+    if (ran == 0) {
+        printf("[e] no kernel named %s. \n", only);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,34 @@
+//    Copyright (C) 2024 Zheng Yang <xornent@outlook.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "blob.h"
+
+// a benchmarked kernel. call runs the kernel once on the prepared inputs, and
+// pixels is the number of pixels (or samples) it processes per call.
+
+typedef struct kernel {
+    const char* name;
+    void (*call)();
+    double pixels;
+} kernel_t;
+
+// synthetic inputs, deterministic for a given seed.
+
+void synth_roi(cv::Mat& gray, int width, int height, cv::RNG& rng);
+void synth_photo(cv::Mat& colored, int width, int height, cv::RNG& rng);
+
+void prepare(int photo_width, int photo_height, int roi_width, int roi_height, uint64_t seed);
+void bench(kernel_t& kernel, double min_time, FILE* out);
+int check();
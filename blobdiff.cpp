@@ -0,0 +1,353 @@
+//    Copyright (C) 2024 Zheng Yang <xornent@outlook.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "blobdiff.h"
+
+#include <iostream>
+#include <filesystem>
+
+#ifdef unix
+#include <argp.h>
+#else
+#include "argparse/argparse.hpp"
+#endif
+
+namespace fs = std::filesystem;
+
+#include <opencv2/opencv.hpp>
+
+// ============================================================================
+
+double min_iou = 0.98;
+double gray_tolerance = 0.5;
+double size_tolerance = 0.01;
+double scale_tolerance = 0;
+double log_tolerance = 0.001;
+char reference[1024] = "";
+char candidate[1024] = "";
+char outpath[1024] = "";
+
+// ============================================================================
+
+// argument parser
+
+static char doc[] =
+    "blobdiff: compare the outputs of blobshed or blobnn (raw.tsv, stats.tsv and the " soft_br
+    "foreground masks) in CANDIDATE with those of a reference build in REFERENCE, run " soft_br
+    "on the same rois. exits with 1 if any value is out of the tolerances. \n\n"
+    "this software is a free software licensed under gnu gplv3. it comes with absolutely " soft_br
+    "no warranty. for details, see <https://www.gnu.org/licenses/gpl-3.0.html>";
+
+static char args_doc[] =
+    "[-i IOU] [-g GRAY] [-s SIZE] [-c SCALE] [-l LOG] [-o FILE] REFERENCE CANDIDATE";
+
+#ifdef unix
+static struct argp_option options[] = {
+    { "iou", 'i', "IOU", 0, "the minimal intersection over union of the foreground masks (0.98)"},
+    { "gray", 'g', "GRAY", 0, "the tolerance of the foreground and background mean grayscales (0.5)"},
+    { "size", 's', "SIZE", 0, "the relative tolerance of the foreground size (0.01)"},
+    { "scale", 'c', "SCALE", 0, "the tolerance of the scale dark and light grayscales (0)"},
+    { "log", 'l', "LOG", 0, "the tolerance of the logarithms in stats.tsv (0.001)"},
+    { "output", 'o', "FILE", 0, "write every value out of the tolerances to FILE"},
+    { 0 }
+};
+
+const char *argp_program_version = "spblob:blobdiff 1.5";
+const char *argp_program_bug_address = "yang-z. <xornent@outlook.com>";
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    switch (key) {
+        case 'i': min_iou = atof(arg); break;
+        case 'g': gray_tolerance = atof(arg); break;
+        case 's': size_tolerance = atof(arg); break;
+        case 'c': scale_tolerance = atof(arg); break;
+        case 'l': log_tolerance = atof(arg); break;
+        case 'o': strcpy(outpath, arg); break;
+        case ARGP_KEY_ARG:
+            if (state -> arg_num == 0) strcpy(reference, arg);
+            else if (state -> arg_num == 1) strcpy(candidate, arg);
+            else argp_usage(state);
+            break;
+        case ARGP_KEY_END:
+            if (state -> arg_num != 2) argp_usage(state);
+            break;
+        default: return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+#endif
+
+// ============================================================================
+
+void check_value(check_t& chk, int uid, double ref, double cand, FILE* out)
+{
+    double dev = fabs(cand - ref);
+    if (chk.relative) dev = ref != 0 ? dev / fabs(ref) : (cand != 0 ? INFINITY : 0);
+
+    chk.compared += 1;
+    if (dev > chk.worst) chk.worst = dev;
+    if (dev <= chk.tolerance) return;
+
+    chk.failed += 1;
+    if (out != NULL) fprintf(out, "%d\t%s\t%.4f\t%.4f\t%.4f\n", uid, chk.name, ref, cand, dev);
+}
+
+// the flags and the presence of the rows are compared exactly.
+
+void check_equal(check_t& chk, int uid, const char* ref, const char* cand, FILE* out)
+{
+    chk.compared += 1;
+    if (strcmp(ref, cand) == 0) return;
+
+    chk.failed += 1;
+    chk.worst = 1;
+    if (out != NULL) fprintf(out, "%d\t%s\t%s\t%s\t.\n", uid, chk.name, ref, cand);
+}
+
+// the intersection over union of two foreground masks, binarized at half
+// the range since they are saved as jpeg. -1 if either is missing.
+
+double mask_iou(const char* ref, const char* cand)
+{
+    cv::Mat a = cv::imread(ref, cv::IMREAD_GRAYSCALE);
+    cv::Mat b = cv::imread(cand, cv::IMREAD_GRAYSCALE);
+    if (a.empty() || b.empty()) return -1;
+    if (a.size() != b.size()) return 0;
+
+    cv::threshold(a, a, 127, 255, cv::THRESH_BINARY);
+    cv::threshold(b, b, 127, 255, cv::THRESH_BINARY);
+
+    cv::Mat both, either;
+    cv::bitwise_and(a, b, both);
+    cv::bitwise_or(a, b, either);
+    int intersection = cv::countNonZero(both);
+    int total = cv::countNonZero(either);
+    return total == 0 ? 1.0 : intersection / (double) total;
+}
+
+static void strip_newline(char* line)
+{
+    line[strcspn(line, "\r\n")] = '\0';
+}
+
+// compare the rows of raw.tsv and stats.tsv by uid, and the mask of every uid
+// segmented in both. returns the number of failed values.
+
+int compare(const char* reference, const char* candidate, FILE* out)
+{
+    check_t rows = { "rows", 0, false, 0, 0, 0 };
+    check_t flags = { "flags", 0, false, 0, 0, 0 };
+    check_t fore_mean = { "fore.mean", gray_tolerance, false, 0, 0, 0 };
+    check_t fore_size = { "fore.size", size_tolerance, true, 0, 0, 0 };
+    check_t back_strict = { "back.strict", gray_tolerance, false, 0, 0, 0 };
+    check_t back_loose = { "back.loose", gray_tolerance, false, 0, 0, 0 };
+    check_t scale = { "scale", scale_tolerance, false, 0, 0, 0 };
+    check_t mask = { "mask.iou", 1 - min_iou, false, 0, 0, 0 };
+    check_t logs = { "stats.log", log_tolerance, false, 0, 0, 0 };
+    check_t* checks[] = {
+        &rows, &flags, &fore_mean, &fore_size, &back_strict, &back_loose,
+        &scale, &mask, &logs
+    };
+
+    std::string refdir(reference), canddir(candidate);
+    results_t refraw, candraw, refstats, candstats;
+    read_results((refdir + "/raw.tsv").c_str(), refraw);
+    read_results((canddir + "/raw.tsv").c_str(), candraw);
+    read_results((refdir + "/stats.tsv").c_str(), refstats);
+    read_results((canddir + "/stats.tsv").c_str(), candstats);
+
+    if (refraw.uids.size() == 0) {
+        printf("[e] no raw.tsv rows under the reference %s. \n", reference);
+        return -1;
+    }
+
+    std::set<int> uids(refraw.uids.begin(), refraw.uids.end());
+    uids.insert(candraw.uids.begin(), candraw.uids.end());
+
+    // raw.tsv: uid, file, sid, name, roi pass, scale pass, foreground found,
+    // fore mean, fore size, strict and loose background, scale dark and light.
+
+    std::vector<char*> rc, cc;
+    for (int uid : uids) {
+        char* refline = find_result(refraw, uid);
+        char* candline = find_result(candraw, uid);
+        check_equal(rows, uid, refline ? "present" : "missing", candline ? "present" : "missing", out);
+        if (refline == NULL || candline == NULL) continue;
+
+        std::vector<char> refcopy(refline, refline + strlen(refline) + 1);
+        std::vector<char> candcopy(candline, candline + strlen(candline) + 1);
+        strip_newline(refcopy.data());
+        strip_newline(candcopy.data());
+        if (split_columns(refcopy.data(), rc) < 13 || split_columns(candcopy.data(), cc) < 13) {
+            check_equal(rows, uid, "complete", "truncated", out);
+            continue;
+        }
+
+        for (int col = 4; col <= 6; col++) check_equal(flags, uid, rc[col], cc[col], out);
+        check_value(fore_mean, uid, atof(rc[7]), atof(cc[7]), out);
+        check_value(fore_size, uid, atof(rc[8]), atof(cc[8]), out);
+        check_value(back_strict, uid, atof(rc[9]), atof(cc[9]), out);
+        check_value(back_loose, uid, atof(rc[10]), atof(cc[10]), out);
+        check_value(scale, uid, atof(rc[11]), atof(cc[11]), out);
+        check_value(scale, uid, atof(rc[12]), atof(cc[12]), out);
+
+        char refmask[1024], candmask[1024];
+        sprintf(refmask, "%s/masks/%d.jpg", reference, uid);
+        sprintf(candmask, "%s/masks/%d.jpg", candidate, uid);
+        bool refhas = fs::exists(refmask), candhas = fs::exists(candmask);
+        if (refhas != candhas)
+            check_equal(mask, uid, refhas ? "present" : "missing", candhas ? "present" : "missing", out);
+        else if (refhas)
+            check_value(mask, uid, 1.0, mask_iou(refmask, candmask), out);
+    }
+
+    // stats.tsv: uid, file, sid, then the eight logarithms, and the sample.
+
+    std::set<int> statuids(refstats.uids.begin(), refstats.uids.end());
+    statuids.insert(candstats.uids.begin(), candstats.uids.end());
+
+    for (int uid : statuids) {
+        char* refline = find_result(refstats, uid);
+        char* candline = find_result(candstats, uid);
+        check_equal(rows, uid, refline ? "present" : "missing", candline ? "present" : "missing", out);
+        if (refline == NULL || candline == NULL) continue;
+
+        std::vector<char> refcopy(refline, refline + strlen(refline) + 1);
+        std::vector<char> candcopy(candline, candline + strlen(candline) + 1);
+        strip_newline(refcopy.data());
+        strip_newline(candcopy.data());
+        if (split_columns(refcopy.data(), rc) < 11 || split_columns(candcopy.data(), cc) < 11) {
+            check_equal(rows, uid, "complete", "truncated", out);
+            continue;
+        }
+
+        for (int col = 3; col <= 10; col++)
+            check_value(logs, uid, atof(rc[col]), atof(cc[col]), out);
+    }
+
+    printf(
+        "[i] %-12s %9s %7s %11s %11s \n",
+        "value", "compared", "failed", "worst", "tolerance"
+    );
+
+    int failed = 0;
+    for (auto chk : checks) {
+        printf(
+            "[i] %-12s %9d %7d %11.4f %11.4f \n",
+            chk -> name, chk -> compared, chk -> failed, chk -> worst, chk -> tolerance
+        );
+        failed += chk -> failed;
+    }
+
+    return failed;
+}
+
+int main(int argc, char* argv[])
+{
+#ifdef unix
+    argp_parse(&argp, argc, argv, 0, 0, NULL);
+#else
+
+    argparse::ArgumentParser program("blobdiff", "1.5");
+
+    program.add_argument("-i", "--iou")
+        .help("the minimal intersection over union of the foreground masks (0.98)")
+        .metavar("IOU")
+        .default_value(min_iou)
+        .scan<'f', double>();
+
+    program.add_argument("-g", "--gray")
+        .help("the tolerance of the foreground and background mean grayscales (0.5)")
+        .metavar("GRAY")
+        .default_value(gray_tolerance)
+        .scan<'f', double>();
+
+    program.add_argument("-s", "--size")
+        .help("the relative tolerance of the foreground size (0.01)")
+        .metavar("SIZE")
+        .default_value(size_tolerance)
+        .scan<'f', double>();
+
+    program.add_argument("-c", "--scale")
+        .help("the tolerance of the scale dark and light grayscales (0)")
+        .metavar("SCALE")
+        .default_value(scale_tolerance)
+        .scan<'f', double>();
+
+    program.add_argument("-l", "--log")
+        .help("the tolerance of the logarithms in stats.tsv (0.001)")
+        .metavar("LOG")
+        .default_value(log_tolerance)
+        .scan<'f', double>();
+
+    program.add_argument("-o", "--output")
+        .help("write every value out of the tolerances to FILE")
+        .metavar("FILE")
+        .default_value(std::string(""));
+
+    program.add_argument("reference")
+        .help("the output directory of the reference build")
+        .metavar("REFERENCE");
+
+    program.add_argument("candidate")
+        .help("the output directory of the build to check")
+        .metavar("CANDIDATE");
+
+    program.add_description(doc);
+
+    try { program.parse_args(argc, argv); }
+    catch (const std::exception& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    min_iou = program.get<double>("--iou");
+    gray_tolerance = program.get<double>("--gray");
+    size_tolerance = program.get<double>("--size");
+    scale_tolerance = program.get<double>("--scale");
+    log_tolerance = program.get<double>("--log");
+    strcpy(outpath, program.get("--output").c_str());
+    strcpy(reference, program.get("reference").c_str());
+    strcpy(candidate, program.get("candidate").c_str());
+
+#endif
+
+    FILE* out = NULL;
+    if (outpath[0] != 0) {
+        out = fopen(outpath, "w");
+        if (out == NULL) {
+            printf("[e] cannot open the output file %s! \n", outpath);
+            return 1;
+        }
+
+        fprintf(out, "uid\tvalue\treference\tcandidate\tdeviation\n");
+    }
+
+    int failed = compare(reference, candidate, out);
+    if (out != NULL) fclose(out);
+
+    if (failed < 0) return 1;
+    if (failed > 0) {
+        printf("[e] %d values of %s are out of the tolerances. \n", failed, candidate);
+        return 1;
+    }
+
+    printf("[i] %s matches the reference within the tolerances. \n", candidate);
+    return 0;
+}
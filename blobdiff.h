@@ -0,0 +1,33 @@
+//    Copyright (C) 2024 Zheng Yang <xornent@outlook.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "blob.h"
+
+// one compared quantity. a value passes if it deviates from the reference by
+// at most the tolerance, relative to the reference if relative is set.
+
+typedef struct check {
+    const char* name;
+    double tolerance;
+    bool relative;
+    int compared;
+    int failed;
+    double worst;
+} check_t;
+
+void check_value(check_t& chk, int uid, double ref, double cand, FILE* out);
+void check_equal(check_t& chk, int uid, const char* ref, const char* cand, FILE* out);
+double mask_iou(const char* ref, const char* cand);
+int compare(const char* reference, const char* candidate, FILE* out);
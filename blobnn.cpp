@@ -33,32 +33,35 @@ namespace chrono = std::chrono;
 #include <opencv2/highgui.hpp>
 #include <opencv2/calib3d.hpp>
 
-#include "torch/script.h"
-#include "torch/torch.h"
-
 // ============================================================================
 
 int start_id = 1;
 int end_id = INT32_MAX - 10; // we will calculate end_id + 1, no overflow then.
-int max_id = 1;
-int pred_cutoff = 180;
+bool incremental = false;
+bool use_cache = false;
+bool binary = false;
+char tracepath[1024] = "";
+bool use_counters = false;
+bool use_memory = false;
+char isa[128] = ""; // empty for the best the cpu supports.
+double mem_budget = 0; // megabytes, 0 for unlimited.
+double quick_width = 0; // 0 for segmenting every roi.
+
+// the estimated bytes per roi pixel held until the results are written: the
+// roi, the float input and prediction tensors, the masks and the colored
+// overlap. under --mem-budget, the rois are segmented in chunks (in uid
+// order) whose estimated footprint fits in the budget.
+
+static double footprint_roi = (20.0);
 
-static FILE* rawfile = NULL;
-static FILE* statfile = NULL;
 static FILE* roifile = NULL;
 
-static std::vector<char*> rawlines;
-static std::vector<char*> statlines;
-static std::vector<int> rawuids;
-static std::vector<int> statuids;
+static sink_t sink;
+static std::set<int> kept; // uids of previous lines to be written back.
 
-static char rawfpath[1024] = "raw.tsv";
-static char statfpath[1024] = "stats.tsv";
 static char datapath[1024] = ".";
 
-static torch::jit::Module model;
 static char modelfpath[1024] = "";
-static bool isgpu = false;
 
 // ============================================================================
 
@@ -94,14 +97,32 @@ static char doc[] =
 "no warranty. for details, see <https://www.gnu.org/licenses/gpl-3.0.html>";
 
 static char args_doc[] =
-"[--start M] [--end N] [--cutoff CUTOFF] [--model PT] [SOURCE]";
+"[--start M] [--end N] [--incremental] [--cutoff CUTOFF] [--model PT] [--cache] [--binary] "
+"[--mem-budget MB] [--quick WIDTH] [--isa NAME] [--trace FILE] [--counters] [--memory] [SOURCE]";
 
 #ifdef unix
 static struct argp_option options[] = {
     { "start", 'm', "M", 0, "starting index (included) of the uid. (0)"},
     { "end", 'n', "N", 0, "ending index (included) of the uid. (int32-max)"},
-    { "cutoff", "c", "CUTOFF", 0, "prediction grayscale cutoff for foreground mask (180)" },
+    { "incremental", 'i', 0, 0, "segment only the uids missing from raw.tsv, or whose rois.tsv row "
+      "or source image changed since, and keep the other previous results"},
+    { "cutoff", 'c', "CUTOFF", 0, "prediction grayscale cutoff for foreground mask (180)" },
     { "model", 't', "PT", 0, "path to the torch script model (*.pt)"},
+    { "cache", 'k', 0, 0, "reuse the segmentation results cached under SOURCE/cache, "
+      "keyed by the roi pixels, the model and the cutoff"},
+    { "binary", 'b', 0, 0, "write the results to the binary columnar SOURCE/results.bin, "
+      "updated in place, instead of raw.tsv and stats.tsv (see blobtsv)"},
+    { "mem-budget", 'B', "MB", 0, "segment the rois in chunks whose estimated footprint, from "
+      "the dimensions of the rois, fits in MB megabytes (0, unlimited)"},
+    { "quick", 'q', "WIDTH", 0, "segment the rois of each sample in a shuffled order, and stop "
+      "once the 95% confidence interval of its mean log.abs is narrower than WIDTH"},
+    { "isa", 'I', "NAME", 0, "run the pixel kernels with the instruction set NAME: scalar, "
+      "sse4.2, avx2, avx512, or auto for the best the cpu supports (auto)"},
+    { "trace", 'T', "FILE", 0, "write the stage spans as chrome trace events to FILE" },
+    { "counters", 'P', 0, 0, "count the cycles, instructions, cache and branch misses of each stage "
+      "with the hardware performance counters, where permitted"},
+    { "memory", 'M', 0, 0, "account the allocations, the peak matrix memory and the resident "
+      "set of each stage, written to memory.tsv under SOURCE"},
     { 0 }
 };
 
@@ -116,12 +137,39 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state) {
     case 'n':
         end_id = atoi(arg);
         break;
+    case 'i':
+        incremental = true;
+        break;
     case 'c':
-        pred_cutoff = atoi(arg);
+        unet_cutoff = atoi(arg);
         break;
     case 't':
         strcpy(modelfpath, arg);
         break;
+    case 'k':
+        use_cache = true;
+        break;
+    case 'b':
+        binary = true;
+        break;
+    case 'B':
+        mem_budget = atof(arg);
+        break;
+    case 'q':
+        quick_width = atof(arg);
+        break;
+    case 'I':
+        strcpy(isa, arg);
+        break;
+    case 'T':
+        strcpy(tracepath, arg);
+        break;
+    case 'P':
+        use_counters = true;
+        break;
+    case 'M':
+        use_memory = true;
+        break;
     case ARGP_KEY_ARG:
         strcpy(datapath, arg);
         break;
@@ -164,18 +212,73 @@ int main(int argc, char* argv[])
         .default_value(end_id)
         .scan<'i', int>();
 
+    program.add_argument("-i", "--incremental")
+        .help("segment only the uids missing from raw.tsv, or whose rois.tsv row " soft_br
+              "or source image changed since, and keep the other previous results")
+        .default_value(false)
+        .implicit_value(true);
+
     program.add_usage_newline();
 
     program.add_argument("-c", "--cutoff")
         .help("prediction grayscale cutoff for foreground mask (180)")
         .metavar("CUTOFF")
-        .default_value(pred_cutoff)
+        .default_value(unet_cutoff)
         .scan<'i', int>();
 
     program.add_argument("-t", "--model")
         .help("path to the torch script model (*.pt)")
         .metavar("PT");
 
+    program.add_argument("-k", "--cache")
+        .help("reuse the segmentation results cached under SOURCE/cache, " soft_br
+              "keyed by the roi pixels, the model and the cutoff")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-b", "--binary")
+        .help("write the results to the binary columnar SOURCE/results.bin, " soft_br
+              "updated in place, instead of raw.tsv and stats.tsv (see blobtsv)")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-B", "--mem-budget")
+        .help("segment the rois in chunks whose estimated footprint, from the dimensions " soft_br
+              "of the rois, fits in MB megabytes (0, unlimited)")
+        .metavar("MB")
+        .default_value(0.0)
+        .scan<'f', double>();
+
+    program.add_argument("-q", "--quick")
+        .help("segment the rois of each sample in a shuffled order, and stop once the 95% " soft_br
+              "confidence interval of its mean log.abs is narrower than WIDTH")
+        .metavar("WIDTH")
+        .default_value(0.0)
+        .scan<'f', double>();
+
+    program.add_argument("-I", "--isa")
+        .help("run the pixel kernels with the instruction set NAME: scalar, sse4.2, " soft_br
+              "avx2, avx512, or auto for the best the cpu supports (auto)")
+        .default_value(std::string(""))
+        .metavar("NAME");
+
+    program.add_argument("-T", "--trace")
+        .help("write the stage spans as chrome trace events to FILE")
+        .default_value(std::string(""))
+        .metavar("FILE");
+
+    program.add_argument("-P", "--counters")
+        .help("count the cycles, instructions, cache and branch misses of each stage " soft_br
+              "with the hardware performance counters, where permitted")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-M", "--memory")
+        .help("account the allocations, the peak matrix memory and the resident set of " soft_br
+              "each stage, written to memory.tsv under SOURCE")
+        .default_value(false)
+        .implicit_value(true);
+
     program.add_usage_newline();
 
     program.add_argument("source")
@@ -213,88 +316,45 @@ int main(int argc, char* argv[])
 
     start_id = program.get<int>("--start");
     end_id = program.get<int>("--end");
-    pred_cutoff = program.get<int>("--cutoff");
+    incremental = program.get<bool>("--incremental");
+    unet_cutoff = program.get<int>("--cutoff");
     strcpy(modelfpath, program.get("--model").c_str());
+    use_cache = program.get<bool>("--cache");
+    binary = program.get<bool>("--binary");
+    strcpy(isa, program.get("--isa").c_str());
+    strcpy(tracepath, program.get("--trace").c_str());
+    mem_budget = program.get<double>("--mem-budget");
+    quick_width = program.get<double>("--quick");
+    use_counters = program.get<bool>("--counters");
+    use_memory = program.get<bool>("--memory");
     strcpy(datapath, program.get("source").c_str());
 
 #endif
 
+    if (strlen(tracepath) > 0 && !trace_open(tracepath, "blobnn")) {
+        printf("[e] cannot open the trace file %s! \n", tracepath);
+        return 1;
+    }
+
+    if (use_counters) counters_open();
+    if (!isa_open(isa)) return 1;
+    pool_open(pool_share(mem_budget * 1024 * 1024));
+    if (use_memory) memory_open();
+
     // make sure the data path exist, and create subdirectories if they are not.
 
     std::string opath(datapath);
     if (fs::is_directory(opath)) {
 
-        if (!fs::is_directory(opath + "/annots")) fs::create_directories(opath + "/annots");
-        if (!fs::is_directory(opath + "/masks")) fs::create_directories(opath + "/masks");
-
-        // open the log file and append.
-        // the log file of the blobroi routine is automatically set to be {out}/rois.tsv
-
-        char rfname[1024] = "\0";
-        char sfname[1024] = "\0";
-        strcpy(rfname, datapath); strcat(rfname, "/"); strcat(rfname, rawfpath);
-        strcpy(rawfpath, rfname);
-        strcpy(sfname, datapath); strcat(sfname, "/"); strcat(sfname, statfpath);
-        strcpy(statfpath, sfname);
-
-        // both the rawfile and statfile are automatically maintained. (newer
-        // detections will overwrite the older ones, and if not previously detected,
-        // then append to the tail of the file. so we will read the old file first,
-        // and modify it in every run.
-
-        // this also suggests that NO TWO INSTANCE OF THIS PROGRAM SHOULD BE RUN
+        // raw.tsv and stats.tsv are rewritten with the previous lines merged
+        // in, see sink_open. NO TWO INSTANCE OF THIS PROGRAM SHOULD BE RUN
         // WITH THE SAME OUTPUT FOLDER! or this will cause edit conflict.
 
-        FILE* read_raw = fopen(rawfpath, "r");
-        FILE* read_stat = fopen(statfpath, "r");
-        char* line = NULL;
-
-        if (read_raw != NULL) {
-            char* line = NULL;
-            size_t len = 0;
-            ssize_t read;
-
-            // every time getline returns a new allocated pointer. we will use
-            // them throughout the program's lifespan, do not free them!
-
-            while ((read = getline(&line, &len, read_raw)) != -1) {
-                char* rline = (char*)malloc(len + 1);
-                strncpy(rline, line, len);
-                rline[len] = '\0';
-                rawlines.push_back(rline);
-
-                char* first_col = strchr(rline, '\t');
-                *first_col = '\0';
-                rawuids.push_back(atoi(rline));
-                *first_col = '\t';
-            }
-
-            fclose(read_raw);
-        }
-
-        if (read_stat != NULL) {
-            char* line = NULL;
-            size_t len = 0;
-            ssize_t read;
-
-            while ((read = getline(&line, &len, read_stat)) != -1) {
-                char* sline = (char*)malloc(len + 1);
-                strncpy(sline, line, len);
-                sline[len] = '\0';
-                statlines.push_back(sline);
-
-                char* first_col = strchr(sline, '\t');
-                *first_col = '\0';
-                statuids.push_back(atoi(sline));
-                *first_col = '\t';
-            }
-
-            fclose(read_stat);
+        if (!sink_open(sink, datapath, binary)) {
+            printf("[e] cannot write the results under the source folder! \n");
+            return 1;
         }
 
-        rawfile = fopen(rawfpath, "w");
-        statfile = fopen(statfpath, "w");
-
     }
     else {
         printf("[e] data output path do not exist! \n");
@@ -314,59 +374,56 @@ int main(int argc, char* argv[])
         return 1;
     }
 
-    if (fs::is_regular_file(modelfpath)) {
-
-        printf("[i] loading model file from: %s ... \n", modelfpath);
-        std::string modelf(modelfpath);
-        model = torch::jit::load(modelf);
-        printf("[i] loading model file successfully. \n");
+    if (!unet_open(modelfpath)) return 1;
 
-        bool gpu = true;
-        if (torch::cuda::is_available()) {
-            printf("[i] cuda available on this device. \n");
-        }
-        else {
-            printf("[i] no gpu or no corrected cuda driver installed. \n");
-            gpu = false;
-        }
+    // processing and reading the rois.tsv from output path.
 
-        if (gpu && torch::cuda::cudnn_is_available()) {
-            printf("[i] cudnn available on this device. \n");
-        }
-        else gpu = false;
+    char* line = NULL;
+    size_t len = 0;
+    ssize_t read;
 
-        if (gpu) {
-            printf("[i] found %ld available gpu(s) installed on this device. \n",
-                   torch::cuda::device_count());
+    roi_batch_t batch;
+    int uptodate = 0;
+    int segmented = 0;
 
-            printf("[i] transporting model to cuda \n");
-            model.eval();
-            model.to(at::kCUDA);
-            isgpu = true;
-        }
-        else {
-            printf("[i] transporting model to cpu \n");
-            model.eval();
-            model.to(at::kCPU);
-            isgpu = false;
-        }
-    }
-    else {
-        printf("[e] pytorch model not found or invalid! \n");
+    if (use_cache && !cache_open(datapath)) {
+        printf("[e] cannot open the cache under the source folder! \n");
         return 1;
     }
 
-    // processing and reading the rois.tsv from output path.
+    // segment the rois read so far, and release them. without a budget, this
+    // runs once for all the rois after reading rois.tsv.
+
+    double budget = mem_budget * 1024 * 1024;
+    if (budget > 0) budget -= pool_share(budget);
+
+    // with --quick, the rois of a sample are segmented until its interval is
+    // narrow enough, and the rois skipped keep their previous results while
+    // those are still current. the rows of rois.tsv and the encoded sources
+    // are all read first, and the rois decoded by segment_quick as its rounds
+    // take them, under the budget.
+
+    double pending = 0;
+    auto flush = [&]() {
+        if (batch_size(batch) == 0) return;
+        if (quick_width > 0) {
+            segmented += segment_quick(
+                unet_segmenter, batch, quick_width, 1, use_cache, budget, footprint_roi,
+                sink, kept, datapath);
+            batch_clear(batch);
+            return;
+        }
 
-    char* line = NULL;
-    size_t len = 0;
-    ssize_t read;
+        if (budget > 0)
+            printf("[i] segmenting %d rois (about %.0f mb). \n",
+                   batch_size(batch), pending / (1024 * 1024));
 
-    std::vector<char*> sample_names; std::vector<char*> fnames;
-    std::vector<int> sid; std::vector<int> uid;
-    std::vector<bool> det_success; std::vector<cv::Mat> rois;
-    std::vector<bool> scale_success;
-    std::vector<int> scale_dark; std::vector<int> scale_light;
+        segment_batch(unet_segmenter, batch, 1, use_cache, true);
+        sink_write(sink, batch, kept, use_cache);
+        segmented += batch_size(batch);
+        pending = 0;
+        batch_clear(batch);
+    };
 
     while ((read = getline(&line, &len, roifile)) != -1) {
 
@@ -378,34 +435,33 @@ int main(int argc, char* argv[])
 
         // read column by column ...
 
+        char* rline = sline;
         char* col = strchr(sline, '\t'); *col = '\0';
-        int uidx = atoi(sline);
+        int uidx = atoi(sline); sline = col + 1;
 
-        if (uidx >= start_id && uidx <= end_id) {}
-        else { if (uidx > max_id) max_id = uidx; continue; }
-
-        uid.push_back(uidx); sline = col + 1;
+        if (uidx >= start_id && uidx <= end_id) {  }
+        else { kept.insert(uidx); free(rline); continue; }
 
         col = strchr(sline, '\t'); *col = '\0';
-        fnames.push_back(sline); sline = col + 1;
+        char* fname = sline; sline = col + 1;
 
         col = strchr(sline, '\t'); *col = '\0';
-        sid.push_back(atoi(sline)); sline = col + 1;
+        int sidx = atoi(sline); sline = col + 1;
 
         col = strchr(sline, '\t'); *col = '\0';
-        sample_names.push_back(sline); sline = col + 1;
+        char* name = sline; sline = col + 1;
 
         col = strchr(sline, '\t'); *col = '\0';
-        det_success.push_back(*sline == 'x'); sline = col + 1;
+        bool det = *sline == 'x'; sline = col + 1;
 
         col = strchr(sline, '\t'); *col = '\0';
-        scale_success.push_back(*sline == 'x'); sline = col + 1;
+        bool scale = *sline == 'x'; sline = col + 1;
 
         col = strchr(sline, '\t'); *col = '\0';
-        scale_dark.push_back(atoi(sline)); sline = col + 1;
+        int dark = atoi(sline); sline = col + 1;
 
         col = strchr(sline, '\t'); *col = '\0';
-        scale_light.push_back(atoi(sline)); sline = col + 1;
+        int light = atoi(sline); sline = col + 1;
 
         char fmtstring_src[1024] = "";
         char savefname[1024] = "";
@@ -413,312 +469,66 @@ int main(int argc, char* argv[])
         strcat(fmtstring_src, "/sources/%d.jpg");
         sprintf(savefname, fmtstring_src, uidx);
 
-        cv::Mat src = cv::imread(savefname, cv::IMREAD_GRAYSCALE);
-        rois.push_back(src);
-    }
-
-    fclose(roifile);
-
-    process(
-        true, sample_names, fnames, sid, uid, det_success,
-        rois, scale_success, scale_dark, scale_light
-    );
+        // in incremental mode, skip the uids with a previous result derived
+        // from the same rois.tsv row and the same source image. the hash of
+        // the source is recorded with the results.
 
-    // finalize.
+        std::vector<uchar> encoded;
+        read_file(savefname, encoded);
+        uint64_t source = hash_contents(encoded, 0);
 
-    fclose(rawfile);
-    fclose(statfile);
-    return 0;
-}
-
-int process(bool show_msg,
-    std::vector<char*> sample_names, std::vector<char*> fnames,
-    std::vector<int> sid, std::vector<int> uid,
-    std::vector<bool> det_success, std::vector<cv::Mat> rois,
-    std::vector<bool> scale_success,
-    std::vector<int> scale_dark, std::vector<int> scale_light)
-{
-    std::vector< cv::Mat > back_strict;
-    std::vector< cv::Mat > back_loose;
-    std::vector< cv::Mat > foreground;
-    std::vector< cv::Mat > graymask;
-    std::vector< cv::Mat > overlap;
-    std::vector< bool > has_foreground;
-    
-    int croi = 0;
-    for (auto roi : rois)
-    {
-        if (!det_success.at(croi)) {
-            back_strict.push_back(cv::Mat(cv::Size(3, 3), CV_8U, cv::Scalar(0)));
-            back_loose.push_back(cv::Mat(cv::Size(3, 3), CV_8U, cv::Scalar(0)));
-            foreground.push_back(cv::Mat(cv::Size(3, 3), CV_8U, cv::Scalar(0)));
-            overlap.push_back(cv::Mat(cv::Size(3, 3), CV_8U, cv::Scalar(0)));
-            graymask.push_back(cv::Mat(cv::Size(3, 3), CV_8U, cv::Scalar(0)));
-            has_foreground.push_back(false);
-            printf("[!] detection %d failed.                                \r",
-                uid.at(croi));
-            croi += 1;
-            continue;
-        }
+        if (incremental) {
+            bool stale = sink_stale(
+                sink, uidx, fname, sidx, name, det, scale, dark, light, source);
 
-        croi += 1;
-        cv::Mat bgstrict, bgloose, fg, ol;
-        cv::cvtColor(roi, ol, cv::COLOR_GRAY2BGR);
-        cv::Mat red(roi.size(), CV_8UC3, cv::Scalar(0, 0, 255));
-        cv::Mat green(roi.size(), CV_8UC3, cv::Scalar(0, 255, 0));
-        cv::Mat blue(roi.size(), CV_8UC3, cv::Scalar(255, 0, 0));
-        bool detected = false;
-        
-        // TODO: ...
-
-        auto start = chrono::system_clock::now();
-
-        // we first need to reverse the source image. since in our neural network, blobs
-        // with reversed pixel values are generated for training, to make the blob regions
-        // have higher values.
-
-        cv::Mat roirev;
-        roi.copyTo(roirev);
-        reverse(roirev);
-
-        torch::Tensor tensor_image = torch::from_blob(
-            roirev.data, { roi.rows, roi.cols, 1 }, torch::kByte);
-        tensor_image = tensor_image.permute({ 2, 0, 1 });
-        tensor_image = tensor_image.toType(torch::kFloat);
-        tensor_image = tensor_image.unsqueeze(0);
-
-        if (isgpu) tensor_image = tensor_image.to(at::kCUDA);
-        else tensor_image = tensor_image.to(at::kCPU);
-
-        at::Tensor output = model.forward({ tensor_image }).toTensor();
-
-        // here, we assume that the first two dimensions of the image is both 1. meaning
-        // that we explicitly disables batch processing in the forwarding step. the classes
-        // (dimension 2) is always zero because the model gives one-channel prediction.
-
-        output = output.squeeze(0).squeeze(0).detach();
-        output = output.mul(255).clamp(0, 255).to(torch::kU8);
-        output = output.to(torch::kCPU);
-
-        // cv::Mat outcv(roi.rows, roi.cols, CV_8U);
-        // std::memcpy(
-        //     (void *) outcv.data, output.data_ptr(),
-        //     sizeof(torch::kU8) * output.numel()
-        // );
-
-        cv::Mat outcv(cv::Size(roi.cols, roi.rows), CV_8U, output.data_ptr());
-        cv::Mat copycv;
-        outcv.copyTo(copycv);
-        graymask.push_back(copycv);
-
-        cv::Mat binary;
-        cv::threshold(outcv, binary, 180, 255, cv::THRESH_BINARY);
-        std::vector<std::vector<cv::Point>> contours;
-        cv::findContours(binary, contours, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
-
-        int idc = 0;
-
-        // initialized to be blanked black.
-
-        fg = cv::Mat::zeros(roi.size(), CV_8U);
-        bgloose = cv::Mat::zeros(roi.size(), CV_8U);
-
-        std::vector<std::vector<cv::Point>> bginits;
-        std::vector<cv::Point> bginit1;
-        int padding = 5;
-
-        bginit1.push_back(cv::Point(padding, padding));
-        bginit1.push_back(cv::Point(roi.cols - padding, padding));
-        bginit1.push_back(cv::Point(roi.cols - padding, roi.rows - padding));
-        bginit1.push_back(cv::Point(padding, roi.rows - padding));
-        bginits.push_back(bginit1);
-        
-        cv::drawContours(bgloose, bginits, 0, cv::Scalar(255), cv::FILLED);
-
-        for (auto cont : contours) {
-            
-            double lenconts = cv::arcLength(cont, true);
-            double area = cv::contourArea(cont, false);
-            double ratio = lenconts * lenconts / area;
-
-            if (area > 1000 && area < 50000) {
-                
-                cv::drawContours(fg, contours, idc, cv::Scalar(255), cv::FILLED);
-                cv::drawContours(ol, contours, idc, cv::Scalar(0, 0, 255), 2);
-                detected = true;
-
-                // draw the background masks.
-                // neural network model does not produce a background detection,
-                // we should just have the left and surrounding part of the surface
-                // only to avoid inclusion of the righter dark lines.
-
-                cv::Rect bounds = cv::boundingRect(cont);
-                std::vector<std::vector<cv::Point>> bgcont;
-                std::vector<cv::Point> bgcont1;
-                
-                bgcont1.push_back(cv::Point(bounds.x + bounds.width, 0));
-                bgcont1.push_back(cv::Point(roi.cols, 0));
-                bgcont1.push_back(cv::Point(roi.cols, roi.rows));
-                bgcont1.push_back(cv::Point(bounds.x + bounds.width, roi.rows));
-                bgcont.push_back(bgcont1);
-
-                cv::drawContours(bgloose, bgcont, 0, cv::Scalar(0), cv::FILLED);
-                cv::drawContours(bgloose, contours, idc, cv::Scalar(0), cv::FILLED);
-
-                // we noticed that some neural network modules may be trained
-                // to report hollow circles with two (inner and outer) boundaries,
-                // however, these models seldom report excess detections, we may just
-                // stack these detections together (likely union). so we do not break.
-                
-                // break;
+            if (!stale) {
+                kept.insert(uidx);
+                uptodate += 1;
+                free(rline);
+                continue;
             }
-            else cv::drawContours(ol, contours, idc, cv::Scalar(0, 0, 0), 1);
-            idc++;
         }
 
-        cv::Mat kernel_full = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
-        cv::morphologyEx(
-            bgloose, bgstrict,
-            cv::MORPH_ERODE, kernel_full,
-            cv::Point(-1, -1), padding
-        );
-
-        // draw the visualization map.
-
-        cv::Mat temp1, temp2, temp3;
-        cv::bitwise_and(blue, blue, temp1, bgloose);
-        cv::bitwise_and(green, green, temp2, bgstrict);
-        cv::bitwise_and(red, red, temp3, fg);
-        cv::addWeighted(temp1, 0.3, ol, 0.7, 0, ol);
-        cv::addWeighted(temp2, 0.3, ol, 0.7, 0, ol);
-        cv::addWeighted(temp3, 0.3, ol, 0.7, 0, ol);
-
-        back_strict.push_back(bgstrict);
-        back_loose.push_back(bgloose);
-        foreground.push_back(fg);
-        overlap.push_back(ol);
-        has_foreground.push_back(detected);
-
-        auto end = chrono::system_clock::now();
-        auto duration = chrono::duration_cast<chrono::milliseconds>(end - start);
-        double ms = double(duration.count()) * chrono::milliseconds::period::num /
-            chrono::milliseconds::period::den;
-
-        printf("[i] processing detection %d ... %.2f s \r", uid.at(croi - 1), ms);
-    }
-
-    printf("\n");
-
-    // logging generatrion. in this step, we should merge the previous file
-    // content (in the order of uids) and overwrite duplicated lines. in fact,
-    // the rois vector is ordered by uid (inherited from the ordered rois.tsv)
-    // so we just test the duplicated items.
-
-    for (int i = 1; i < start_id; i++) {
-        for (int j = 0; j < rawuids.size(); j++) if (rawuids.at(j) == i)
-            fprintf(rawfile, "%s", rawlines.at(j));
-
-        for (int j = 0; j < statuids.size(); j++) if (statuids.at(j) == i)
-            fprintf(statfile, "%s", statlines.at(j));
-    }
-
-    for (int i = 0; i < rois.size(); i++) {
-
-        char name[512] = { 0 };
-        strcpy(name, sample_names.at(i));
-
-        char strpass1[2] = ".";
-        if (det_success.at(i)) strpass1[0] = 'x';
-        else strpass1[0] = '.';
-
-        char strpass2[2] = ".";
-        if (scale_success.at(i)) strpass2[0] = 'x';
-        else strpass2[0] = '.';
-
-        char strpass3[3] = ".";
-        if (has_foreground.at(i)) strpass3[0] = 'x';
-        else strpass3[0] = '.';
-
-        double fm = -1; int fsz = -1;
-        if (has_foreground.at(i)) {
-            cv::Mat kernel_full = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
-            cv::Mat morph;
-
-            // dilate the foreground mask twice.
-
-            cv::morphologyEx(
-                foreground.at(i), morph,
-                cv::MORPH_DILATE, kernel_full,
-                cv::Point(-1, -1), 2
-            );
-
-            auto foremean = cv::mean(rois.at(i), morph);
-            auto masksum = any(morph);
-            fm = foremean[0]; fsz = masksum;
+        if (quick_width > 0) {
+            cv::Mat pending_roi;
+            batch_push(batch, uidx, fname, sidx, name, det, scale, dark, light, pending_roi, source);
+            batch.encoded.push_back(std::move(encoded));
+            free(rline);
+            continue;
         }
 
-        auto backsmean = cv::mean(rois.at(i), back_strict.at(i));
-        auto backlmean = cv::mean(rois.at(i), back_loose.at(i));
-
-        fprintf(
-            rawfile, "%d\t%s\t%d\t%s\t%s\t%s\t%s\t" "%.2f\t%d\t%.2f\t%.2f\t%d\t%d\n",
-            uid.at(i), fnames.at(i), sid.at(i), name, strpass1, strpass2, strpass3,
-            fm, fsz, backsmean[0], backlmean[0], scale_dark.at(i), scale_light.at(i)
-        );
-
-        // those with defected detection will not occur in stats.tsv. thus the
-        // number of rows may be smaller than the raw.tsv. and we should filter out
-        // any values that may crash the application when calculating log(0).
-
-        if (det_success.at(i) && scale_success.at(i) && has_foreground.at(i) &&
-            fsz > 0 && fm > 0 && (backsmean[0] - fm) > 0 &&
-            scale_light.at(i) > 0 && scale_dark.at(i) > 0 &&
-            scale_light.at(i) > scale_dark.at(i) &&
-            backlmean[0] > 0 && backsmean[0] > 0) {
-
-            fprintf(
-                statfile, "%d\t%s\t%d\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%s\n",
-                uid.at(i), fnames.at(i), sid.at(i),
-                log((backsmean[0] - fm) * fsz),              // log.abs
-                log(scale_light.at(i) - scale_dark.at(i)),   // log.delta
-                log(scale_light.at(i)),                      // log.light
-                log(scale_dark.at(i)),                       // log.dark
-                log(backlmean[0]),                           // log.back
-                log(backsmean[0]),                           // log.back.strict
-                log(fm),                                     // log.mean
-                log(fsz),                                    // log.sz
-                name                                         // sample
-            );
+        if (budget > 0) {
+            int width = 0, height = 0;
+            double footprint = image_size(savefname, width, height) ?
+                (double) width * height * footprint_roi : 0;
+            if (pending + footprint > budget) flush();
+            pending += footprint;
         }
 
-        fflush(rawfile);
-        fflush(statfile);
+        stage_timer_t timer("decode", uidx);
+        cv::Mat src = decode_roi(encoded);
+        timer.stop();
 
-        char savefname[1024] = "";
-        char fmtstring_annot[1024] = "";
-        char fmtstring_mask[1024] = "";
-        strcpy(fmtstring_annot, datapath);
-        strcpy(fmtstring_mask, datapath);
+        batch_push(batch, uidx, fname, sidx, name, det, scale, dark, light, src, source);
+        free(rline);
+    }
 
-        strcat(fmtstring_annot, "/annots/%d.jpg");
-        strcat(fmtstring_mask, "/masks/%d.jpg");
+    fclose(roifile);
+    flush();
 
-        sprintf(savefname, fmtstring_annot, uid.at(i));
-        cv::imwrite(savefname, overlap.at(i));
+    if (incremental)
+        printf("[i] incremental: %d uids up to date, %d segmented. \n",
+               uptodate, segmented);
 
-        sprintf(savefname, fmtstring_mask, uid.at(i));
-        cv::imwrite(savefname, graymask.at(i));
-    }
+    // finalize. the previous lines after the last segmented uid are merged
+    // back at the tail.
 
-    for (int i = end_id + 1; i <= max_id; i++) {
-        for (int j = 0; j < rawuids.size(); j++) if (rawuids.at(j) == i)
-            fprintf(rawfile, "%s", rawlines.at(j));
-
-        for (int j = 0; j < statuids.size(); j++) if (statuids.at(j) == i)
-            fprintf(statfile, "%s", statlines.at(j));
-    }
+    sink_close(sink, kept);
+    if (use_cache) cache_close();
 
-    fflush(rawfile);
-    fflush(statfile);
+    trace_close();
+    counters_write(datapath, "blobnn");
+    memory_write(datapath, "blobnn");
+    timing_write(datapath, "blobnn");
     return 0;
 }
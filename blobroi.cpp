@@ -77,6 +77,13 @@ static FILE* logfile = NULL;
 static int save_count = 1;
 static char logfpath[1024] = "rois.tsv";
 static char datapath[1024] = ".";
+static std::vector<config_t> configs;
+static FILE* gatefile = NULL;
+
+// the positioning triangles of the last photograph, for --track.
+
+static anchors_t tracked = { 0, {}, 0 };
+static cv::Size tracked_size;
 
 // ============================================================================
 
@@ -106,6 +113,53 @@ static double c_scale_width = (60.0 * c_scale_factor);
 static double c_proximal = (270.0);
 static double c_distal = (300.0);
 
+// the zoom of the first round detection of the positioning triangles.
+
+static double zoom_first_round = 1;
+
+// the fold changes of -z and -y tried in order, when the positioning triangles
+// could not be paired with the given thresholds.
+
+#define retry_count 6
+static double retry_red[retry_count] = { 1.0, 0.75, 1.25, 0.75, 0.5, 0.5 };
+static double retry_size[retry_count] = { 1.0, 1.0, 1.0, 0.5, 1.0, 0.5 };
+
+// pre-flight gate thresholds, measured on the 1/8 preview. the sharpness is the
+// variance of the laplacian, and the clipped fractions count the pixels with
+// grayscale <= 5 (dark) or >= 250 (bright). photographs with a red fraction
+// below gate_red have nothing to form the positioning triangles.
+
+static double gate_blur_reject = (8.0);
+static double gate_blur_flag = (25.0);
+static double gate_clip_reject = (0.5);
+static double gate_clip_flag = (0.1);
+static double gate_red = (1e-5);
+
+// the rows extended on both sides of the bands in --band mode. should exceed
+// the height of the positioning triangles in the photograph.
+
+static int band_extent = (256);
+
+// the estimated bytes per pixel of a photograph detected on the full frame (the
+// decoded gray and color planes, the hsv planes, the redness and its
+// sharpening, and the annotated copy), and of the decoded planes alone, which
+// are kept whole in band mode. under --mem-budget, a photograph that does not
+// fit on the full frame is detected in bands of the rows that fit. budget_band
+// is the band rows chosen for the current photograph, 0 for the full frame.
+
+static double footprint_full = (13.0);
+static double footprint_decoded = (4.0);
+static int budget_band = 0;
+
+// the bounding box fill ratios of the candidate components for the anchors,
+// and the counts of the candidates passing each stage of the cascade.
+
+static double cascade_fill_min = (0.2);
+static double cascade_fill_max = (0.75);
+static int cascade_components = 0;
+static int cascade_contours = 0;
+static int cascade_triangles = 0;
+
 #ifdef debug
 #define verbose
 #endif
@@ -130,7 +184,10 @@ static char args_doc[] =
     "[--save-start N] "
     "[--scale SCALE] [--size SIZE] [--proximal PROX] [--distal DIST] "
     "[--posang-size PSIZE] [--posang-thresh PTHRESH] "
-    "[-o OUTPUT] [-d] [-f] INPUT";
+    "[-o OUTPUT] [-d] [-f] [-g] [-k DRIFT] [-b ROWS] [-B MB] [-I NAME] [-T FILE] [-P] [-M] INPUT\n"
+    "[--scale SCALE] [--size SIZE] [--proximal PROX] [--distal DIST] "
+    "[-o OUTPUT] [-I NAME] [-T FILE] [-P] [-M] --replay\n"
+    "[--save-start N] [-o OUTPUT] [-d] [-B MB] [-I NAME] [-T FILE] [-P] [-M] --sweep CONFIG INPUT";
 
 #ifdef unix
 static struct argp_option options[] = {
@@ -150,6 +207,31 @@ static struct argp_option options[] = {
     { "dir", 'd', 0, 0, "input be a directory of images in *.jpg"}, 
     { "fas", 'f', 0, 0, "filename as sample, accept the file name of the image as the sample name "
       "without prompting the user to enter the sample names manually"}, 
+    { "gate", 'g', 0, 0, "check the sharpness, exposure and red marks on a small preview of "
+      "each photograph before processing, and skip the bad captures. the measurements are "
+      "logged to preflight.tsv in the output directory"},
+    { "track", 'k', "DRIFT", 0, "track the positioning triangles of the last photograph, for photographs "
+      "taken from a fixed rig. the triangles are searched within DRIFT px around their last positions, "
+      "and detected on the full frame if lost (0, disabled)"},
+    { "band", 'b', "ROWS", 0, "detect the positioning triangles in horizontal bands of ROWS rows, "
+      "instead of the full frame, to bound the memory for very large scans (0, disabled)"},
+    { "mem-budget", 'B', "MB", 0, "keep the estimated footprint of each photograph within MB "
+      "megabytes, from its dimensions, by detecting the positioning triangles in bands "
+      "when the full frame does not fit (0, unlimited)"},
+    { "replay", 'r', 0, 0, "re-extract the rois recorded in the output rois.tsv with the current "
+      "--size, --proximal and --distal from their recorded geometry, without detecting the "
+      "positioning triangles again. no input is needed"},
+    { "sweep", 'w', "CONFIG", 0, "run every configuration listed in the CONFIG table on the input, "
+      "decoding each photograph once. the outputs of each configuration go to a subfolder of "
+      "the output directory named after the configuration. implies --fas"},
+    { "isa", 'I', "NAME", 0, "run the pixel kernels with the instruction set NAME: scalar, "
+      "sse4.2, avx2, avx512, or auto for the best the cpu supports (auto)"},
+    { "trace", 'T', "FILE", 0, "write the spans of the photographs, papers and stages as chrome "
+      "trace events to FILE"},
+    { "counters", 'P', 0, 0, "count the cycles, instructions, cache and branch misses of each stage "
+      "with the hardware performance counters, where permitted"},
+    { "memory", 'M', 0, 0, "account the allocations, the peak matrix memory and the resident "
+      "set of each stage, written to memory.tsv in the output directory"},
     { 0 }
 };
 
@@ -191,18 +273,50 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
         case 'f':
             arguments -> fname_as_sample = true;
             break;
+        case 'g':
+            arguments -> gate = true;
+            break;
+        case 'k':
+            arguments -> track = atof(arg);
+            break;
+        case 'b':
+            arguments -> band = atoi(arg);
+            break;
+        case 'B':
+            arguments -> mem_budget = atof(arg);
+            break;
         case 'y':
             size_thresh = atoi(arg);
             break;
         case 'z':
             red_thresh = atoi(arg);
             break;
+        case 'r':
+            arguments -> replay = true;
+            break;
+        case 'w':
+            strcpy(arguments -> sweep, arg);
+            arguments -> fname_as_sample = true;
+            break;
+        case 'I':
+            strcpy(arguments -> isa, arg);
+            break;
+        case 'T':
+            strcpy(arguments -> trace, arg);
+            break;
+        case 'P':
+            arguments -> counters = true;
+            break;
+        case 'M':
+            arguments -> memory = true;
+            break;
         case ARGP_KEY_ARG:
             strcpy(arguments -> input, arg);
             break;
         case ARGP_KEY_END:
-            if (state -> arg_num != 1) argp_usage(state);
-            if (arguments -> input[0] == 0) argp_usage(state);
+            if (arguments -> replay && state -> arg_num == 0) { }
+            else if (state -> arg_num != 1) argp_usage(state);
+            else if (arguments -> input[0] == 0) argp_usage(state);
             if (set_scale_width)
                 c_scale_width = arguments -> scale_width * c_scale_factor;
             break;
@@ -226,6 +340,16 @@ int main(int argc, char *argv[])
     arguments.distal = c_distal;
     arguments.directory = false;
     arguments.fname_as_sample = false;
+    arguments.replay = false;
+    strcpy(arguments.sweep, "\0");
+    arguments.gate = false;
+    arguments.track = 0;
+    arguments.band = 0;
+    arguments.mem_budget = 0;
+    strcpy(arguments.trace, "\0");
+    arguments.counters = false;
+    arguments.memory = false;
+    strcpy(arguments.isa, "\0");
     strcpy(arguments.input, "\0");
 
 #ifdef unix
@@ -304,9 +428,79 @@ int main(int argc, char *argv[])
         .default_value(false)
         .implicit_value(true);
 
+    program.add_argument("-g", "--gate")
+        .help("check the sharpness, exposure and red marks on a small preview of each " soft_br
+              "photograph before processing, and skip the bad captures. the measurements " soft_br
+              "are logged to preflight.tsv in the output directory")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-k", "--track")
+        .help("track the positioning triangles of the last photograph, for photographs " soft_br
+              "taken from a fixed rig. the triangles are searched within DRIFT px around " soft_br
+              "their last positions, and detected on the full frame if lost (0, disabled)")
+        .metavar("DRIFT")
+        .default_value(0.0)
+        .scan<'f', double>();
+
+    program.add_argument("-b", "--band")
+        .help("detect the positioning triangles in horizontal bands of ROWS rows, instead " soft_br
+              "of the full frame, to bound the memory for very large scans (0, disabled)")
+        .metavar("ROWS")
+        .default_value(0)
+        .scan<'i', int>();
+
+    program.add_argument("-B", "--mem-budget")
+        .help("keep the estimated footprint of each photograph within MB megabytes, from " soft_br
+              "its dimensions, by detecting the positioning triangles in bands when the " soft_br
+              "full frame does not fit (0, unlimited)")
+        .metavar("MB")
+        .default_value(0.0)
+        .scan<'f', double>();
+
+    program.add_argument("-r", "--replay")
+        .help("re-extract the rois recorded in the output rois.tsv with the current " soft_br
+              "--size, --proximal and --distal from their recorded geometry, without " soft_br
+              "detecting the positioning triangles again. no input is needed")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-w", "--sweep")
+        .help("run every configuration listed in the CONFIG table on the input, decoding " soft_br
+              "each photograph once. the outputs of each configuration go to a subfolder " soft_br
+              "of the output directory named after the configuration. implies --fas")
+        .metavar("CONFIG")
+        .default_value(std::string(""));
+
+    program.add_argument("-I", "--isa")
+        .help("run the pixel kernels with the instruction set NAME: scalar, sse4.2, " soft_br
+              "avx2, avx512, or auto for the best the cpu supports (auto)")
+        .metavar("NAME")
+        .default_value(std::string(""));
+
+    program.add_argument("-T", "--trace")
+        .help("write the spans of the photographs, papers and stages as chrome trace " soft_br
+              "events to FILE")
+        .metavar("FILE")
+        .default_value(std::string(""));
+
+    program.add_argument("-P", "--counters")
+        .help("count the cycles, instructions, cache and branch misses of each stage " soft_br
+              "with the hardware performance counters, where permitted")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-M", "--memory")
+        .help("account the allocations, the peak matrix memory and the resident set of " soft_br
+              "each stage, written to memory.tsv in the output directory")
+        .default_value(false)
+        .implicit_value(true);
+
     program.add_argument("input")
         .help("the input image, or a directory of images (when specifying -d)")
-        .metavar("input");
+        .metavar("input")
+        .nargs(argparse::nargs_pattern::optional)
+        .default_value(std::string(""));
 
     program.add_description(doc);
 
@@ -340,9 +534,36 @@ int main(int argc, char *argv[])
 
     arguments.directory = program.get<bool>("--dir");
     arguments.fname_as_sample = program.get<bool>("--fas");
+    arguments.replay = program.get<bool>("--replay");
+    arguments.gate = program.get<bool>("--gate");
+    arguments.track = program.get<double>("--track");
+    arguments.band = program.get<int>("--band");
+    arguments.mem_budget = program.get<double>("--mem-budget");
+    strcpy(arguments.sweep, program.get("--sweep").c_str());
+    if (arguments.sweep[0] != 0) arguments.fname_as_sample = true;
+    strcpy(arguments.isa, program.get("--isa").c_str());
+    strcpy(arguments.trace, program.get("--trace").c_str());
+    arguments.counters = program.get<bool>("--counters");
+    arguments.memory = program.get<bool>("--memory");
     strcpy(arguments.input, program.get("input").c_str());
 
+    if (!arguments.replay && arguments.input[0] == 0) {
+        std::cerr << "input is required unless --replay" << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
 #endif
+
+    if (arguments.trace[0] != 0 && !trace_open(arguments.trace, "blobroi")) {
+        printf("[e] cannot open the trace file %s! \n", arguments.trace);
+        return 1;
+    }
+
+    if (arguments.counters) counters_open();
+    if (!isa_open(arguments.isa)) return 1;
+    pool_open(pool_share(arguments.mem_budget * 1024 * 1024));
+    if (arguments.memory) memory_open();
     
     // make sure the data path exist, and create subdirectories if they are not.
 
@@ -353,21 +574,49 @@ int main(int argc, char *argv[])
         if (!fs::is_directory(opath + "/scales")) fs::create_directories(opath + "/scales");
         if (!fs::is_directory(opath + "/scales.annot")) fs::create_directories(opath + "/scales.annot");
 
-        // open the log file and append.
-        // the log file of the blobroi routine is automatically set to be {out}/rois.tsv
+        if (arguments.replay) {
+            int ret = replay(&arguments);
+            trace_close();
+            counters_write(arguments.data_output_path, "blobroi");
+            memory_write(arguments.data_output_path, "blobroi");
+            timing_write(arguments.data_output_path, "blobroi");
+            return ret;
+        }
+
+        if (arguments.gate) {
+            char gatefname[1024] = "";
+            strcpy(gatefname, datapath);
+            strcat(gatefname, "/preflight.tsv");
+            gatefile = fopen(gatefname, "a+");
+        }
+
+        if (arguments.sweep[0] != 0) {
+            if (read_sweep(arguments.sweep, &arguments) != 0) return 1;
+
+        } else {
+
+            // open the log file and append.
+            // the log file of the blobroi routine is automatically set to be {out}/rois.tsv
     
-        char logfname[1024] = "\0";
-        strcpy(logfname, datapath);
-        strcat(logfname, "/");
-        strcat(logfname, logfpath);
-        strcpy(logfpath, logfname);
-        logfile = fopen(logfpath, "a+");
+            char logfname[1024] = "\0";
+            strcpy(logfname, datapath);
+            strcat(logfname, "/");
+            strcat(logfname, logfpath);
+            strcpy(logfpath, logfname);
+            logfile = fopen(logfpath, "a+");
+        }
 
     } else {
         printf("[e] data output path do not exist! \n");
         return 1;
     }
 
+    // in a sweep, each photograph is decoded once and processed with all of
+    // the configurations.
+
+    double (*run)(char*, char*, bool, struct arguments*) = process;
+    if (arguments.sweep[0] != 0) run = sweep;
+
     if (arguments.directory)
     {
         char *dir = arguments.input;
@@ -381,14 +630,14 @@ int main(int argc, char *argv[])
 
 #ifdef unix
                 printf("processing %s ... \n", (char *)(entry.path().filename().c_str()));
-                double dur = process(
+                double dur = run(
                     (char*) (entry.path().c_str()),
                     (char*) (entry.path().filename().replace_extension().c_str()),
                     true, &arguments
                 );
 #else
                 printf("processing %s ... \n", (char *)(entry.path().filename().string().c_str()));
-                double dur = process(
+                double dur = run(
                     (char*) (entry.path().string().c_str()),
                     (char*) (entry.path().filename().replace_extension().string().c_str()),
                     true, &arguments
@@ -406,14 +655,14 @@ int main(int argc, char *argv[])
 
 #ifdef unix
         printf("processing %s ... \n", (char*) entry.filename().replace_extension().c_str());
-        double dur = process(
+        double dur = run(
             arguments.input,
             (char*) entry.filename().replace_extension().c_str(),
             true, &arguments
         );
 #else
         printf("processing %s ... \n", (char*) entry.filename().replace_extension().string().c_str());
-        double dur = process(
+        double dur = run(
             arguments.input,
             (char*) entry.filename().replace_extension().string().c_str(),
             true, &arguments
@@ -423,41 +672,314 @@ int main(int argc, char *argv[])
         printf("< %.3f s\n", dur);
     }
 
-    fclose(logfile);
+    if (arguments.sweep[0] != 0) {
+        for (auto& conf : configs) fclose(conf.logfile);
+    } else fclose(logfile);
+
+    if (gatefile != NULL) fclose(gatefile);
+
+    trace_close();
+    counters_write(arguments.data_output_path, "blobroi");
+    memory_write(arguments.data_output_path, "blobroi");
+    timing_write(arguments.data_output_path, "blobroi");
 
     return 0;
 }
 
-double process(char *file, char* purefname, bool show_msg, struct arguments* args)
+// decode the photograph in different color spaces, from its file read once
+// (read_file). the planes for the anchor detection that do not depend on the
+// geometric settings are prepared by prepare_frame.
+
+void decode_frame(std::vector<uchar>& encoded, frame_t& frame)
 {
-    // read the specified image in different color spaces.
+    stage_timer_t timer("decode");
+    if (encoded.empty()) return;
+    frame.grayscale = cv::imdecode(encoded, cv::IMREAD_GRAYSCALE);
+    frame.colored = cv::imdecode(encoded, cv::IMREAD_COLOR);
+}
+
+// the full-frame planes are only needed when the anchors are detected on the
+// full frame, that is, not tracked. they are computed once for a frame.
 
-    cv::Mat grayscale = cv::imread(file, cv::IMREAD_GRAYSCALE);
-    cv::Mat colored = cv::imread(file, cv::IMREAD_COLOR);
+void prepare_frame(frame_t& frame)
+{
+    if (!frame.usm.empty()) return;
 
+    stage_timer_t redness("redness");
     cv::Mat colored_hsv;
-    cv::cvtColor(colored, colored_hsv, cv::COLOR_BGR2HSV);
+    cv::cvtColor(frame.colored, colored_hsv, cv::COLOR_BGR2HSV);
 
     cv::Mat component_red;
-    grayscale.copyTo(component_red);
+    frame.grayscale.copyTo(component_red);
+    stage_timer_t significance("significance");
     color_significance(colored_hsv, component_red, 0.0);
+    significance.stop();
+    redness.stop();
 
 #ifdef verbose
     show(component_red, "red");
 #endif
 
-    cv::Mat annot;
-    colored.copyTo(annot);
+    stage_timer_t usm("usm");
+    sharpen(component_red, frame.usm, zoom_first_round);
+    usm.stop();
+
+    if (zoom_first_round == 1) frame.hsv = colored_hsv;
+    else {
+        cv::Mat smaller;
+        cv::resize(frame.colored, smaller, cv::Size(0, 0), zoom_first_round, zoom_first_round);
+        cv::cvtColor(smaller, frame.hsv, cv::COLOR_BGR2HSV);
+    }
+}
+
+// pre-flight quality gate. the preview is decoded at 1/8 of the size, which
+// for jpeg photographs comes directly from the dct coefficients without the
+// full decode. returns false if the photograph should be rejected. softer
+// problems only raise the flag.
+
+bool inspect_preview(std::vector<uchar>& encoded, preview_t& out)
+{
+    auto start = chrono::system_clock::now();
+
+    out.sharpness = 0;
+    out.dark = 0;
+    out.bright = 0;
+    out.red = 0;
+    out.reject = false;
+    out.flag = false;
+    strcpy(out.reasons, "");
+
+    auto note = [&](bool reject, const char* reason) {
+        if (reject) out.reject = true;
+        else out.flag = true;
+        if (out.reasons[0] != '\0') strcat(out.reasons, ",");
+        strcat(out.reasons, reason);
+    };
+
+    cv::Mat preview;
+    if (!encoded.empty()) preview = cv::imdecode(encoded, cv::IMREAD_REDUCED_COLOR_8);
+    if (preview.empty()) note(true, "unreadable");
+    else {
+
+        cv::Mat gray, hsv, laplacian;
+        cv::cvtColor(preview, gray, cv::COLOR_BGR2GRAY);
+        cv::cvtColor(preview, hsv, cv::COLOR_BGR2HSV);
+
+        cv::Laplacian(gray, laplacian, CV_64F);
+        cv::Scalar mean, stddev;
+        cv::meanStdDev(laplacian, mean, stddev);
+        out.sharpness = stddev[0] * stddev[0];
+
+        int dark = 0, bright = 0;
+        for (int line = 0; line < gray.rows; line++) {
+            uchar* rgray = gray.ptr<uchar>(line);
+            for (int col = 0; col < gray.cols; col++) {
+                if (rgray[col] <= 5) dark += 1;
+                else if (rgray[col] >= 250) bright += 1;
+            }
+        }
+
+        double total = double(gray.rows) * gray.cols;
+        out.dark = dark / total;
+        out.bright = bright / total;
+
+        // the same redness projection as the anchor detection.
+
+        cv::Mat red(gray.size(), CV_8U, cv::Scalar(0));
+        color_significance(hsv, red, 0.0);
+        cv::threshold(red, red, red_thresh, 255, cv::THRESH_BINARY);
+        out.red = cv::countNonZero(red) / total;
+
+        if (out.sharpness < gate_blur_reject) note(true, "blurry");
+        else if (out.sharpness < gate_blur_flag) note(false, "soft");
+        if (out.dark > gate_clip_reject) note(true, "underexposed");
+        else if (out.dark > gate_clip_flag) note(false, "dark");
+        if (out.bright > gate_clip_reject) note(true, "overexposed");
+        else if (out.bright > gate_clip_flag) note(false, "bright");
+        if (out.red < gate_red) note(true, "no-red-marks");
+    }
+
+    auto end = chrono::system_clock::now();
+    out.ms = chrono::duration_cast<chrono::microseconds>(end - start).count() / 1000.0;
+    return !out.reject;
+}
+
+// run the pre-flight gate on a photograph, and log the verdict to
+// preflight.tsv with columns: file, verdict (pass, flag or reject), sharpness,
+// dark and bright fractions, red fraction, milliseconds and reasons.
+
+bool preflight(char* file, std::vector<uchar>& encoded)
+{
+    preview_t pv;
+    bool pass = inspect_preview(encoded, pv);
+    timing_record("preflight", pv.ms);
+    const char* verdict = pv.reject ? "reject" : (pv.flag ? "flag" : "pass");
+
+    if (pv.reject)
+        printf("  [e] pre-flight rejected (%s) in %.1f ms. skipped. \n", pv.reasons, pv.ms);
+    else if (pv.flag)
+        printf("  [!] pre-flight flagged (%s) in %.1f ms. \n", pv.reasons, pv.ms);
+
+    if (gatefile != NULL) {
+        fprintf(
+            gatefile, "%s\t%s\t%.2f\t%.4f\t%.4f\t%.6f\t%.2f\t%s\n",
+            file, verdict, pv.sharpness, pv.dark, pv.bright, pv.red, pv.ms,
+            pv.reasons[0] == '\0' ? "." : pv.reasons
+        );
+        fflush(gatefile);
+    }
 
-    double zoom_first_round = 1;
+    return pass;
+}
+
+// choose the band rows of a photograph under the memory budget, from the
+// dimensions in its header. the full frame is used when it fits, otherwise the
+// bands are as tall as the rest of the budget allows after the decoded planes.
+
+void plan_budget(char* file, struct arguments* args)
+{
+    budget_band = 0;
+    if (args -> mem_budget <= 0 || args -> band > 0) return;
+
+    int width = 0, height = 0;
+    if (!image_size(file, width, height)) {
+        printf("  [!] cannot read the dimensions, assuming the full frame fits. \n");
+        return;
+    }
+
+    double budget = args -> mem_budget * 1024 * 1024;
+    budget -= pool_share(budget);
+    double pixels = (double) width * height;
+    if (pixels * footprint_full <= budget) return;
+
+    double spare = budget - pixels * footprint_decoded;
+    int rows = (int) (spare / (width * (footprint_full - footprint_decoded))) - 2 * band_extent;
+    if (rows < band_extent) {
+        rows = band_extent;
+        printf(
+            "  [!] the photograph exceeds the budget even in bands of %d rows. \n", rows
+        );
+    } else printf(
+        "  [i] %.0f mb on the full frame, detecting in bands of %d rows. \n",
+        pixels * footprint_full / (1024 * 1024), rows
+    );
+
+    budget_band = std::min(rows, height);
+}
+
+double process(char *file, char* purefname, bool show_msg, struct arguments* args)
+{
+    stage_timer_t timer("photo");
+    std::vector<uchar> encoded;
+    read_file(file, encoded);
+    if (args -> gate && !preflight(file, encoded)) return 0;
+    plan_budget(file, args);
+
+    frame_t frame;
+    decode_frame(encoded, frame);
+    return process_frame(frame, file, purefname, args);
+}
+
+double process_frame(frame_t& frame, char *file, char* purefname, struct arguments* args)
+{
+    cv::Mat& grayscale = frame.grayscale;
+    cv::Mat& colored = frame.colored;
+
+    // the annotated photograph is only shown when prompting for the names.
+
+    bool annotate = !args -> fname_as_sample;
+    cv::Mat annot;
+    if (annotate) colored.copyTo(annot);
 
     auto start = chrono::system_clock::now();
 
+    // search the -z and -y thresholds on the shared planes, and stop at the
+    // first setting that pairs some of the positioning triangles. the thresholds
+    // given by a sweep configuration are not searched.
+
+    int given_red = red_thresh;
+    int given_size = size_thresh;
+    int attempts = args -> sweep[0] != 0 ? 1 : retry_count;
+
     anchors_t anch;
-    anchor(component_red, anch, zoom_first_round);
-    filter_mean_color(colored, anch);
+    anch.detections = 0;
+    double zoom = -1;
+
+    std::vector<std::pair<int, cv::Point2d>> meeting_points;
+    std::vector<std::pair<int, int>> paired;
+    std::vector<cv::Point2d> base_vertice;
+    std::vector<cv::Point2d> base_meeting;
+
+    // with --track, first look for the triangles of the last photograph near
+    // their last positions. fall back to the full frame if any of them is lost,
+    // drifted too far, or they no longer pair.
+
+    cascade_components = cascade_contours = cascade_triangles = 0;
+
+    bool tracking = args -> track > 0 && args -> sweep[0] == 0 &&
+        tracked.detections > 0 && tracked_size == colored.size();
+
+    if (tracking) {
+        stage_timer_t timer("anchor");
+        bool found = track_anchors(frame, tracked, anch, args -> track);
+        timer.stop();
+
+        if (found &&
+            pair_anchors(anch, meeting_points, paired, base_vertice, base_meeting) > 0) {
+            zoom = anch.zoom;
+            attempts = 0;
+            printf("  [i] tracked %d positioning triangles. \n", anch.detections);
+        } else {
+            printf("  [!] tracking lost, detecting on the full frame. \n");
+            anch.vertices.clear();
+            meeting_points.clear();
+            paired.clear();
+            base_vertice.clear();
+            base_meeting.clear();
+        }
+    }
+
+    int band = args -> band > 0 ? args -> band : budget_band;
+    if (attempts > 0 && band == 0) prepare_frame(frame);
+
+    for (int attempt = 0; attempt < attempts; attempt++) {
+        red_thresh = (int) lround(given_red * retry_red[attempt]);
+        size_thresh = (int) lround(given_size * retry_size[attempt]);
+
+        anch.vertices.clear();
+        meeting_points.clear();
+        paired.clear();
+        base_vertice.clear();
+        base_meeting.clear();
+        cascade_components = cascade_contours = cascade_triangles = 0;
+
+        stage_timer_t timer("anchor");
+        if (band > 0) anchor_bands(frame, anch, band);
+        else {
+            anchor(frame.usm, anch, zoom_first_round);
+            filter_mean_color(frame.hsv, anch);
+        }
+        timer.stop();
+
+        zoom = anch.zoom;
+
+        if (!isnan(zoom) && zoom >= 0)
+            pair_anchors(anch, meeting_points, paired, base_vertice, base_meeting);
+        if (paired.size() > 0) break;
+
+        if (attempt + 1 < attempts)
+            printf(
+                "  [!] no paired positioning triangles with -z %d -y %d, retrying. \n",
+                red_thresh, size_thresh
+            );
+    }
 
-    if (anch.detections > 0)
+    int used_red = red_thresh;
+    int used_size = size_thresh;
+    red_thresh = given_red;
+    size_thresh = given_size;
+
+    if (annotate && anch.detections > 0)
     {
         std::vector<std::vector<cv::Point>> contours;
         for (int i = 0; i < anch.detections; i++)
@@ -477,79 +999,52 @@ double process(char *file, char* purefname, bool show_msg, struct arguments* arg
             cv::Scalar(255, 0, 0, 0), 2, 8);
     }
 
+    printf(
+        "  [i] anchor candidates: %d components, %d contours, %d triangles, %d colored. \n",
+        cascade_components, cascade_contours, cascade_triangles, anch.detections
+    );
+
     // here, we will scale the image to a relatively uniform size. and infer
     // the relative center for each detection.
 
-    double zoom = anch.zoom;
     printf("zoom: %.4f \n", zoom);
 
     if (isnan(zoom) || zoom < 0) {
+        printf("  [e] no valid positioning angle passed for the color filter\n");
+        printf("  [e] this probably because the image is too small, or the redness of triangle being \n");
+        printf("  [e] influcenced by the photographing conditions. consider -y and -z options. \n");
         printf("  [e] aborting. \n");
         return 0;
     }
 
-    std::vector<std::pair<int, cv::Point2d>> meeting_points;
-    std::vector<std::pair<int, int>> paired;
-    std::vector<cv::Point2d> base_vertice;
-    std::vector<cv::Point2d> base_meeting;
-
-    for (int i = 0; i < anch.detections; i++)
-    {
-        cv::Point2d p1(anch.vertices[6 * i + 0] * zoom, anch.vertices[6 * i + 1] * zoom);
-        cv::Point2d p2(anch.vertices[6 * i + 2] * zoom, anch.vertices[6 * i + 3] * zoom);
-        cv::Point2d p3(anch.vertices[6 * i + 4] * zoom, anch.vertices[6 * i + 5] * zoom);
-
-        cv::Point2d vert, hei;
+    if (paired.size() == 0) {
+        printf("  [e] no paired positioning triangles detected. \n");
+        printf("  [e] aborting. \n");
+        return 0;
+    }
 
-        if (distance(p1, p2) < distance(p2, p3) && distance(p1, p3) < distance(p2, p3))
-        {
-            vert = p1;
-            hei = cv::Point2d((p2.x + p3.x) / 2, (p2.y + p3.y) / 2);
-        }
+    printf("  [i] positioning triangles: -z %d -y %d \n", used_red, used_size);
 
-        if (distance(p2, p1) < distance(p1, p3) && distance(p2, p3) < distance(p1, p3))
-        {
-            vert = p2;
-            hei = cv::Point2d((p1.x + p3.x) / 2, (p1.y + p3.y) / 2);
-        }
+    // only the triangles that made it into a pair are tracked, strays that
+    // passed the colour filter but found no partner would drift the search.
 
-        if (distance(p3, p2) < distance(p1, p2) && distance(p3, p1) < distance(p1, p2))
-        {
-            vert = p3;
-            hei = cv::Point2d((p1.x + p2.x) / 2, (p1.y + p2.y) / 2);
+    if (args -> track > 0) {
+        std::vector<bool> keep(anch.detections, false);
+        for (int i = 0; i < paired.size(); i++) {
+            keep[paired[i].first] = true;
+            keep[paired[i].second] = true;
         }
 
-        std::pair<int, cv::Point2d> temp;
-        temp.first = i;
-        temp.second = cv::Point2d(
-            vert.x + (hei.x - vert.x) * 5.02,
-            vert.y + (hei.y - vert.y) * 5.02);
-        meeting_points.push_back(temp);
-        base_vertice.push_back(vert);
-    }
-
-    // approximate pairs by adjacent meeting points
-    // (tolerate a range within 20px range)
-
-    for (int i = 0; i < meeting_points.size(); i++)
-    {
-        for (int j = i + 1; j < meeting_points.size(); j++)
-        {
-            if (distance(meeting_points[i].second, meeting_points[j].second) < c_pair_distance_threshold)
-            { // FIXME. CHANGE
-                paired.push_back(std::pair<int, int>(
-                    meeting_points[i].first, meeting_points[j].first));
-                base_meeting.push_back(cv::Point2d(
-                    (meeting_points[i].second.x + meeting_points[j].second.x) * 0.5,
-                    (meeting_points[i].second.y + meeting_points[j].second.y) * 0.5));
-            }
+        tracked.detections = 0;
+        tracked.vertices.clear();
+        tracked.zoom = anch.zoom;
+        for (int i = 0; i < anch.detections; i++) {
+            if (!keep[i]) continue;
+            tracked.vertices.insert(tracked.vertices.end(),
+                anch.vertices.begin() + 6 * i, anch.vertices.begin() + 6 * i + 6);
+            tracked.detections += 1;
         }
-    }
-
-    if (paired.size() == 0) {
-        printf("  [e] no paired positioning triangles detected. \n");
-        printf("  [e] aborting. \n");
-        return 0;
+        tracked_size = colored.size();
     }
 
     // correct the scale factor zoom
@@ -574,9 +1069,10 @@ double process(char *file, char* purefname, bool show_msg, struct arguments* arg
         return 0;
     }
 
-    cv::Mat scaled_gray, scaled_color;
+    stage_timer_t rescale("rescale");
+    cv::Mat scaled_gray;
     cv::resize(grayscale, scaled_gray, cv::Size(0, 0), zoom, zoom);
-    cv::resize(colored, scaled_color, cv::Size(0, 0), zoom, zoom);
+    rescale.stop();
 
     for(int i = 0; i < meeting_points.size(); i++)
         meeting_points[i].second = cv::Point2d(
@@ -601,14 +1097,13 @@ double process(char *file, char* purefname, bool show_msg, struct arguments* arg
     std::vector<cv::Mat> rois;
     std::vector<cv::Mat> scales;
     std::vector<bool> pass1;
-
-    std::vector< cv::Vec2d > dorigins;
-    std::vector< cv::Vec2d > dorients;
-    std::vector< cv::Vec2d > dbases;
-    std::vector< int > dwidths;
+    std::vector<geometry_t> geos;
+    std::vector<double> spans;
 
     for (int i = 0; i < paired.size(); i++)
     {
+        // the span of a paper is tagged with the uid it will be saved as.
+        stage_timer_t paper("paper", save_count + (int) rois.size());
         cv::Point2d v1 = base_vertice[paired[i].first];
         cv::Point2d v2 = base_vertice[paired[i].second];
         cv::Point2d vtop, vbottom;
@@ -651,108 +1146,33 @@ double process(char *file, char* purefname, bool show_msg, struct arguments* arg
         double unify = dx * signx / sqrt(pow(dx, 2) + pow(dy, 2));
         double unifx = dy * signy / sqrt(pow(dx, 2) + pow(dy, 2));
 
-        cv::line(
-            annot, cv::Point2d(origin.x / zoom, origin.y / zoom),
-            cv::Point2d(end.x / zoom, end.y / zoom),
-            cv::Scalar(0, 0, 255, 0), 2, 8);
+        if (annotate)
+            cv::line(
+                annot, cv::Point2d(origin.x / zoom, origin.y / zoom),
+                cv::Point2d(end.x / zoom, end.y / zoom),
+                cv::Scalar(0, 0, 255, 0), 2, 8);
 
-        double downx = -unify;
-        double downy = +unifx;
-        double upx = +unify;
-        double upy = -unifx;
+        geometry_t geo;
+        geo.origin = origin;
+        geo.unif = cv::Point2d(unifx, unify);
+        geo.zoom = zoom;
 
         cv::Mat scale_bar;
+        double span = distance(vtop, vbottom);
+        extract_scale(scaled_gray, geo, span, scale_bar);
 
-        extract_flank(
-            scaled_gray, scale_bar, origin, cv::Point2d(unifx, unify),
-            cv::Point2d(upx, upy), (distance(vtop, vbottom) / 2 - 3), distance(vtop, vbottom) * 354 / 325.0
-            // for a short version. 125.
-        );
-
-        scales.push_back(scale_bar);
-        
-        // search for meeting boundary
-
-        int maximal_search_length = int(100. / zoom);
-
-        // here, the 160 and 180 is associated with the default zoom constant
-        // 68.28 (in filter_color) which indicated the zoomed image is set to
-        // a uniform length of 20px of the scale bar.
-
-        cv::Point2d orig_b1((origin.x + unifx * c_proximal) / zoom, (origin.y + unify * c_proximal) / zoom); // FIXME: CHANGE
-        cv::Point2d orig_b2((origin.x + unifx * c_distal) / zoom, (origin.y + unify * c_distal) / zoom); // FIXME: CHANGE
-        
-        // for a short version 160 and 180.
-
-        int ub1 = boundary(grayscale, orig_b1, cv::Point2d(upx, upy), maximal_search_length, 0.05);
-        int ub2 = boundary(grayscale, orig_b2, cv::Point2d(upx, upy), maximal_search_length, 0.05);
-        int db1 = boundary(grayscale, orig_b1, cv::Point2d(downx, downy), maximal_search_length, 0.05);
-        int db2 = boundary(grayscale, orig_b2, cv::Point2d(downx, downy), maximal_search_length, 0.05);
-
-        auto ub1p = cv::Point2d((orig_b1.x + upx * ub1), (orig_b1.y + upy * ub1));
-        auto db1p = cv::Point2d((orig_b1.x + downx * db1), (orig_b1.y + downy * db1));
-        auto cp1 = cv::Point2d((ub1p.x + db1p.x) * 0.5 * zoom, (ub1p.y + db1p.y) * 0.5 * zoom);
-
-        auto ub2p = cv::Point2d((orig_b2.x + upx * ub2), (orig_b2.y + upy * ub2));
-        auto db2p = cv::Point2d((orig_b2.x + downx * db2), (orig_b2.y + downy * db2));
-        auto cp2 = cv::Point2d((ub2p.x + db2p.x) * 0.5 * zoom, (ub2p.y + db2p.y) * 0.5 * zoom);
-
-        cv::line(
-            annot, cv::Point2d((orig_b1.x + upx * ub1), (orig_b1.y + upy * ub1)),
-            cv::Point2d((orig_b1.x + downx * db1), (orig_b1.y + downy * db1)),
-            cv::Scalar(0, 0, 255, 0), 3);
-
-        cv::line(
-            annot, cv::Point2d((orig_b2.x + upx * ub2), (orig_b2.y + upy * ub2)),
-            cv::Point2d((orig_b2.x + downx * db2), (orig_b2.y + downy * db2)),
-            cv::Scalar(0, 255, 0, 0), 3);
-
-        // remap and construct regions of interest
-
-        // corrected orientation.
-
-        double corrorientx = cp2.x - cp1.x;
-        double corrorienty = cp2.y - cp1.y;
-        corrorientx /= distance(cp1, cp2);
-        corrorienty /= distance(cp1, cp2);
-
-        double corrupx = +corrorienty;
-        double corrupy = -corrorientx;
-        double corrdownx = -corrorienty;
-        double corrdowny = +corrorientx;
-
-        double width = (upx * corrupx + upy * corrupy) * ((ub1 + db1 + ub2 + db2) * zoom * 0.25);
-        width -= 5; // remove the 5px boundary.
-        double corratio = fabs((ub1 + db1 - ub2 - db2) / fmax(ub1 + db1, ub2 + db2));
-
-        if (width > 1)
+        cv::Mat roi;
+        bool pass;
+        if (extract_roi(grayscale, scaled_gray, geo, roi, pass, annotate ? &annot : NULL))
         {
-            dorigins.push_back(cv::Point2d(origin.x / zoom, origin.y / zoom));
-            dbases.push_back(orig_b1);
-            dorients.push_back(cv::Point2d(corrorientx, corrorienty));
-            dwidths.push_back(int(width) * 2 + 1);
-
-            if (corratio < 0.1) { pass1.push_back(true); }
-            else { 
-                pass1.push_back(false);
-
-                // placeholder to ensure the length of vector
-                rois.push_back(cv::Mat(cv::Size(3, 3), CV_8U, cv::Scalar(0)));
-                continue;
-            }
-
-            int roih = int(width);
-            int roiw = 350;
-
-            cv::Mat roi;
-            extract_flank(
-                scaled_gray, roi, cv::Point2d(cp1.x, cp1.y),
-                cv::Point2d(corrorientx, corrorienty), cv::Point2d(corrupx, corrupy),
-                roih, roiw
-            );
-
+            scales.push_back(scale_bar);
+            geos.push_back(geo);
+            spans.push_back(span);
+            pass1.push_back(pass);
             rois.push_back(roi);
 
+            if (!pass || !annotate) continue;
+
             char roiid[12];
             sprintf(roiid, "%d", rois.size());
             cv::putText(
@@ -774,92 +1194,28 @@ double process(char *file, char* purefname, bool show_msg, struct arguments* arg
 
     for (auto sc : scales)
     {
-        cv::Mat blurred;
-        cv::GaussianBlur(sc, blurred, cv::Size(5, 5), 0);
-
-        cv::Mat blur_usm, usm;
-        cv::GaussianBlur(blurred, blur_usm, cv::Size(0, 0), 25);
-        cv::addWeighted(blurred, 1.5, blur_usm, -0.5, 0, usm);
-        blur_usm.release();
-
-        cv::threshold(usm, usm, 0, 255, cv::THRESH_OTSU);
-        reverse(usm);
-        std::vector<std::vector<cv::Point>> contours;
-        cv::findContours(usm, contours, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+        uchar dark, light;
+        double size;
+        bool success;
+        cv::Mat view;
+
+        analyze_scale(sc, dark, light, size, success, view);
+        scale_dark.push_back(dark);
+        scale_light.push_back(light);
+        scale_size.push_back(size);
+        scale_success.push_back(success);
+        scale_view.push_back(view);
+    }
 
-        cv::Mat darker_mask(sc.size(), CV_8U, cv::Scalar(0));
-        cv::Mat lighter_mask(sc.size(), CV_8U, cv::Scalar(255));
+    // by now, all the detection works are done. and we will pretty-print the
+    // data for further analysis by other software
 
-        int cid = 0;
-        int select_id = -1;
-        bool det = false;
-        cv::Mat view; sc.copyTo(view);
+    // here we have, in lengths of total scale detections:
 
-        for (auto cont : contours) {
-            double lenconts = cv::arcLength(cont, true);
-            double area = cv::contourArea(cont, false);
-            double ratio = lenconts * lenconts / area;
-
-            if (area > 1500) { // TODO: THIS 1000 IS UNSTABLE!
-                
-                det = true;
-                select_id = cid;
-
-                // the contour circles the darker part of the image,
-                // but need to keep out the red triangles.
-
-                cv::drawContours(
-                    view, contours, cid,
-                    cv::Scalar(0), 3
-                );
-
-                cv::drawContours(
-                    darker_mask,
-
-                    // relatively shrink the circle to make the darker area more pure.
-
-                    contours, cid,
-                    cv::Scalar(255), cv::FILLED
-                );
-
-                cv::drawContours(
-                    lighter_mask,
-
-                    // relatively extends the circle, note that the two small red
-                    // triangle marks lies within lighter mask but with distinct
-                    // grayscale compared to the background. we may just use the 
-                    // median filter to ignore them.
-
-                    contours, cid,
-                    cv::Scalar(0), cv::FILLED
-                );
-            }
-
-            cid ++;
-        }
-       
-        scale_dark.push_back(quartile(sc, darker_mask, 0.40));
-        scale_light.push_back(quartile(sc, lighter_mask, 0.60));
-        scale_view.push_back(view);
-
-        if (det) {
-            scale_success.push_back(true);
-            scale_size.push_back(cv::contourArea(contours[select_id], false));
-        } else {
-            scale_success.push_back(false);
-            scale_size.push_back(1);
-        }
-    }
-
-    // by now, all the detection works are done. and we will pretty-print the
-    // data for further analysis by other software
-
-    // here we have, in lengths of total scale detections:
-
-    // std::vector<cv::Mat> rois;            raw image
-    // std::vector<cv::Mat> scales;          raw scale image
-    // std::vector<cv::Mat> usms;            sharpened raw image *
-    // std::vector<bool> pass1;              pass for clipping flank orientation
+    // std::vector<cv::Mat> rois;            raw image
+    // std::vector<cv::Mat> scales;          raw scale image
+    // std::vector<cv::Mat> usms;            sharpened raw image *
+    // std::vector<bool> pass1;              pass for clipping flank orientation
 
     // std::vector< uchar > scale_dark;      darker principle grayscale
     // std::vector< uchar > scale_light;     lighter principle grayscale
@@ -920,7 +1276,9 @@ double process(char *file, char* purefname, bool show_msg, struct arguments* arg
             "%d\t%s\t%d\t%s\t%s\t%s\t"
             "%d\t%d\t%.2f\t"
             "%.1f\t%.1f\t%.1f\t%.1f\t%d\t%.4f\t"
-            "%.4f\t%.4f\n",
+            "%.4f\t%.4f\t"
+            "%.1f\t%.1f\t%.1f\t"
+            "%d\t%d\t%.2f\n",
             
             // file catalog
 
@@ -937,14 +1295,25 @@ double process(char *file, char* purefname, bool show_msg, struct arguments* arg
             // fm, fsz, backsmean[0], backlmean[0],
 
             scale_dark.at(i), scale_light.at(i), scale_size.at(i),
-            dorigins.at(i)[0], dorigins.at(i)[1],
-            dbases.at(i)[0], dbases.at(i)[1],
-            dwidths.at(i), zoom,
-            dorients.at(i)[0], dorients.at(i)[1]
+            geos.at(i).origin.x / zoom, geos.at(i).origin.y / zoom,
+            geos.at(i).base.x, geos.at(i).base.y,
+            geos.at(i).width, zoom,
+            geos.at(i).orient.x, geos.at(i).orient.y,
+
+            // the settings these geometries are extracted with, for the replay.
+
+            c_scale_width, c_proximal, c_distal,
+
+            // the positioning triangle thresholds (-y and -z) that succeeded,
+            // and the span of the triangle pair in the photograph, which
+            // sizes the scale card.
+
+            used_size, used_red, spans.at(i) / zoom
         );
 
         fflush(logfile);
         
+        stage_timer_t timer("write", save_count);
         char savefname[1024] = "";
 
         // write the sources (face of the test paper) and scales images.
@@ -975,7 +1344,743 @@ double process(char *file, char* purefname, bool show_msg, struct arguments* arg
     return ms;
 }
 
-void anchor(cv::Mat &image, anchors_t &anchors, double prepzoom)
+// read the configurations of a parameter sweep. the table is tab-separated
+// with columns: name, --scale, --size, --proximal, --distal, --posang-size
+// and --posang-thresh. a '.' or a missing column takes the value from the
+// command line. lines starting with '#' and a header line starting with
+// 'name' are ignored.
+
+int read_sweep(const char* fname, struct arguments* args)
+{
+    FILE* conffile = fopen(fname, "r");
+    if (conffile == NULL) {
+        printf("[e] cannot read the sweep configuration %s! \n", fname);
+        return 1;
+    }
+
+    std::vector<char> buffer(4096);
+    while (fgets(buffer.data(), buffer.size(), conffile) != NULL) {
+        buffer[strcspn(buffer.data(), "\r\n")] = '\0';
+        if (buffer[0] == '\0' || buffer[0] == '#') continue;
+
+        std::vector<char*> cols;
+        split_columns(buffer.data(), cols);
+        if (strcmp(cols[0], "name") == 0) continue;
+        if (cols[0][0] == '\0') {
+            printf("[e] configuration without a name in %s! \n", fname);
+            fclose(conffile);
+            return 1;
+        }
+
+        config_t conf;
+        strcpy(conf.name, cols[0]);
+        conf.scale_factor = c_scale_factor;
+        conf.scale_width = c_scale_width / c_scale_factor;
+        conf.proximal = c_proximal;
+        conf.distal = c_distal;
+        conf.posang_size = size_thresh;
+        conf.posang_thresh = red_thresh;
+
+        auto given = [&](int c) { return cols.size() > c && strcmp(cols[c], ".") != 0; };
+        if (given(1)) conf.scale_factor = atof(cols[1]);
+        if (given(2)) conf.scale_width = atof(cols[2]);
+        if (given(3)) conf.proximal = atof(cols[3]);
+        if (given(4)) conf.distal = atof(cols[4]);
+        if (given(5)) conf.posang_size = atoi(cols[5]);
+        if (given(6)) conf.posang_thresh = atoi(cols[6]);
+
+        // each configuration has its own output subtree.
+
+        std::string opath = std::string(datapath) + "/" + conf.name;
+        fs::create_directories(opath + "/sources");
+        fs::create_directories(opath + "/scales");
+        fs::create_directories(opath + "/scales.annot");
+
+        strcpy(conf.datapath, opath.c_str());
+        conf.logfile = fopen((opath + "/rois.tsv").c_str(), "a+");
+        conf.save_count = args -> save_count;
+
+        printf(
+            "[i] configuration %s: scale %.2f, size %.1f, proximal %.1f, distal %.1f, "
+            "posang-size %d, posang-thresh %d. \n",
+            conf.name, conf.scale_factor, conf.scale_width, conf.proximal, conf.distal,
+            conf.posang_size, conf.posang_thresh
+        );
+
+        configs.push_back(conf);
+    }
+
+    fclose(conffile);
+
+    if (configs.size() == 0) {
+        printf("[e] no configuration found in %s! \n", fname);
+        return 1;
+    }
+
+    return 0;
+}
+
+// switch the geometric settings and the output to a configuration.
+
+void use_config(config_t& conf)
+{
+    c_scale_factor = conf.scale_factor;
+    c_scale_width = conf.scale_width * conf.scale_factor;
+    c_proximal = conf.proximal;
+    c_distal = conf.distal;
+    size_thresh = conf.posang_size;
+    red_thresh = conf.posang_thresh;
+
+    strcpy(datapath, conf.datapath);
+    logfile = conf.logfile;
+    save_count = conf.save_count;
+}
+
+// the decoding, the redness plane and its sharpening are shared, only the
+// anchor detection and the extraction run once per configuration.
+
+double sweep(char *file, char* purefname, bool show_msg, struct arguments* args)
+{
+    stage_timer_t timer("photo");
+    std::vector<uchar> encoded;
+    read_file(file, encoded);
+    if (args -> gate && !preflight(file, encoded)) return 0;
+    plan_budget(file, args);
+
+    frame_t frame;
+    decode_frame(encoded, frame);
+
+    double total = 0;
+    for (auto& conf : configs) {
+        printf("  configuration %s: \n", conf.name);
+        use_config(conf);
+        total += process_frame(frame, file, purefname, args);
+        conf.save_count = save_count;
+    }
+
+    return total;
+}
+
+// the scale card lies between the two positioning triangles, starting from
+// the origin along the axis. span is the distance of the two triangle vertices
+// in the scaled image.
+
+void extract_scale(cv::Mat& scaled_gray, geometry_t& geo, double span, cv::Mat& scale_bar)
+{
+    stage_timer_t timer("flank");
+    double upx = +geo.unif.y;
+    double upy = -geo.unif.x;
+
+    extract_flank(
+        scaled_gray, scale_bar, geo.origin, geo.unif,
+        cv::Point2d(upx, upy), (span / 2 - 3), span * 354 / 325.0
+        // for a short version. 125.
+    );
+}
+
+// search the boundaries of the test paper at the proximal and distal positions
+// along the axis, correct the orientation, and extract the uniformed face of
+// the paper from the scaled image. geo.origin, geo.unif and geo.zoom should be
+// set by the caller. returns false if the paper is too narrow to extract.
+
+bool extract_roi(
+    cv::Mat& grayscale, cv::Mat& scaled_gray, geometry_t& geo,
+    cv::Mat& roi, bool& pass, cv::Mat* annot)
+{
+    double zoom = geo.zoom;
+    cv::Point2d origin = geo.origin;
+    double unifx = geo.unif.x;
+    double unify = geo.unif.y;
+
+    double downx = -unify;
+    double downy = +unifx;
+    double upx = +unify;
+    double upy = -unifx;
+
+    // search for meeting boundary
+
+    int maximal_search_length = int(100. / zoom);
+
+    // here, the 160 and 180 is associated with the default zoom constant
+    // 68.28 (in filter_color) which indicated the zoomed image is set to
+    // a uniform length of 20px of the scale bar.
+
+    cv::Point2d orig_b1((origin.x + unifx * c_proximal) / zoom, (origin.y + unify * c_proximal) / zoom); // FIXME: CHANGE
+    cv::Point2d orig_b2((origin.x + unifx * c_distal) / zoom, (origin.y + unify * c_distal) / zoom); // FIXME: CHANGE
+    
+    // for a short version 160 and 180.
+
+    stage_timer_t search("boundary");
+    int ub1 = boundary(grayscale, orig_b1, cv::Point2d(upx, upy), maximal_search_length, 0.05);
+    int ub2 = boundary(grayscale, orig_b2, cv::Point2d(upx, upy), maximal_search_length, 0.05);
+    int db1 = boundary(grayscale, orig_b1, cv::Point2d(downx, downy), maximal_search_length, 0.05);
+    int db2 = boundary(grayscale, orig_b2, cv::Point2d(downx, downy), maximal_search_length, 0.05);
+    search.stop();
+
+    auto ub1p = cv::Point2d((orig_b1.x + upx * ub1), (orig_b1.y + upy * ub1));
+    auto db1p = cv::Point2d((orig_b1.x + downx * db1), (orig_b1.y + downy * db1));
+    auto cp1 = cv::Point2d((ub1p.x + db1p.x) * 0.5 * zoom, (ub1p.y + db1p.y) * 0.5 * zoom);
+
+    auto ub2p = cv::Point2d((orig_b2.x + upx * ub2), (orig_b2.y + upy * ub2));
+    auto db2p = cv::Point2d((orig_b2.x + downx * db2), (orig_b2.y + downy * db2));
+    auto cp2 = cv::Point2d((ub2p.x + db2p.x) * 0.5 * zoom, (ub2p.y + db2p.y) * 0.5 * zoom);
+
+    if (annot != NULL) {
+        cv::line(
+            *annot, cv::Point2d((orig_b1.x + upx * ub1), (orig_b1.y + upy * ub1)),
+            cv::Point2d((orig_b1.x + downx * db1), (orig_b1.y + downy * db1)),
+            cv::Scalar(0, 0, 255, 0), 3);
+
+        cv::line(
+            *annot, cv::Point2d((orig_b2.x + upx * ub2), (orig_b2.y + upy * ub2)),
+            cv::Point2d((orig_b2.x + downx * db2), (orig_b2.y + downy * db2)),
+            cv::Scalar(0, 255, 0, 0), 3);
+    }
+
+    // remap and construct regions of interest
+
+    // corrected orientation.
+
+    double corrorientx = cp2.x - cp1.x;
+    double corrorienty = cp2.y - cp1.y;
+    corrorientx /= distance(cp1, cp2);
+    corrorienty /= distance(cp1, cp2);
+
+    double corrupx = +corrorienty;
+    double corrupy = -corrorientx;
+    double corrdownx = -corrorienty;
+    double corrdowny = +corrorientx;
+
+    double width = (upx * corrupx + upy * corrupy) * ((ub1 + db1 + ub2 + db2) * zoom * 0.25);
+    width -= 5; // remove the 5px boundary.
+    double corratio = fabs((ub1 + db1 - ub2 - db2) / fmax(ub1 + db1, ub2 + db2));
+
+    if (width <= 1) return false;
+
+    geo.base = orig_b1;
+    geo.orient = cv::Point2d(corrorientx, corrorienty);
+    geo.width = int(width) * 2 + 1;
+    pass = corratio < 0.1;
+
+    if (!pass) {
+
+        // placeholder to ensure the length of vector
+        roi = cv::Mat(cv::Size(3, 3), CV_8U, cv::Scalar(0));
+        return true;
+    }
+
+    int roih = int(width);
+    int roiw = 350;
+
+    stage_timer_t timer("flank");
+    extract_flank(
+        scaled_gray, roi, cv::Point2d(cp1.x, cp1.y),
+        cv::Point2d(corrorientx, corrorienty), cv::Point2d(corrupx, corrupy),
+        roih, roiw
+    );
+
+    return true;
+}
+
+// read the darker foreground circle and the lighter background of the scale
+// card, for correcting the luminance and contrast of the photograph.
+
+void analyze_scale(
+    cv::Mat& sc, uchar& dark, uchar& light, double& size,
+    bool& success, cv::Mat& view)
+{
+    stage_timer_t timer("scale");
+    cv::Mat blurred;
+    cv::GaussianBlur(sc, blurred, cv::Size(5, 5), 0);
+
+    cv::Mat blur_usm, usm;
+    cv::GaussianBlur(blurred, blur_usm, cv::Size(0, 0), 25);
+    cv::addWeighted(blurred, 1.5, blur_usm, -0.5, 0, usm);
+    blur_usm.release();
+
+    cv::threshold(usm, usm, 0, 255, cv::THRESH_OTSU);
+    reverse(usm);
+    std::vector<std::vector<cv::Point>> contours;
+    cv::findContours(usm, contours, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+
+    cv::Mat darker_mask(sc.size(), CV_8U, cv::Scalar(0));
+    cv::Mat lighter_mask(sc.size(), CV_8U, cv::Scalar(255));
+
+    int cid = 0;
+    int select_id = -1;
+    bool det = false;
+    sc.copyTo(view);
+
+    for (auto cont : contours) {
+        double lenconts = cv::arcLength(cont, true);
+        double area = cv::contourArea(cont, false);
+        double ratio = lenconts * lenconts / area;
+
+        if (area > 1500) { // TODO: THIS 1000 IS UNSTABLE!
+            
+            det = true;
+            select_id = cid;
+
+            // the contour circles the darker part of the image,
+            // but need to keep out the red triangles.
+
+            cv::drawContours(
+                view, contours, cid,
+                cv::Scalar(0), 3
+            );
+
+            cv::drawContours(
+                darker_mask,
+
+                // relatively shrink the circle to make the darker area more pure.
+
+                contours, cid,
+                cv::Scalar(255), cv::FILLED
+            );
+
+            cv::drawContours(
+                lighter_mask,
+
+                // relatively extends the circle, note that the two small red
+                // triangle marks lies within lighter mask but with distinct
+                // grayscale compared to the background. we may just use the 
+                // median filter to ignore them.
+
+                contours, cid,
+                cv::Scalar(0), cv::FILLED
+            );
+        }
+
+        cid ++;
+    }
+   
+    dark = quartile(sc, darker_mask, 0.40);
+    light = quartile(sc, lighter_mask, 0.60);
+    success = det;
+    size = det ? cv::contourArea(contours[select_id], false) : 1;
+}
+
+// geometry replay. every row of rois.tsv records the origin, the proximal
+// base point, the zoom and the settings it is extracted with. the axis before
+// the boundary correction points from the origin to the base point, so we can
+// search the boundaries at the new --proximal and --distal positions and
+// re-sample the roi without decoding the colors or detecting the anchors.
+// a changed --size or --scale rescales the recorded zoom and re-reads the
+// scale card. the rows extracted with the current settings are untouched.
+
+int replay(struct arguments* args)
+{
+    char roifname[1024] = "";
+    strcpy(roifname, datapath);
+    strcat(roifname, "/rois.tsv");
+
+    FILE* roifile = fopen(roifname, "r");
+    if (roifile == NULL) {
+        printf("[e] do not find rois.tsv under the output folder! \n");
+        return 1;
+    }
+
+    std::vector<std::vector<std::string>> rows;
+    std::vector<char> buffer(65536);
+    while (fgets(buffer.data(), buffer.size(), roifile) != NULL) {
+        buffer[strcspn(buffer.data(), "\r\n")] = '\0';
+        if (buffer[0] == '\0') continue;
+
+        std::vector<char*> cols;
+        split_columns(buffer.data(), cols);
+        if (cols.size() < 17) {
+            printf("[!] malformed line in rois.tsv: %s \n", buffer.data());
+            continue;
+        }
+
+        rows.push_back(std::vector<std::string>(cols.begin(), cols.end()));
+    }
+
+    fclose(roifile);
+
+    // group the affected rows by their source photograph, so that each of
+    // the photographs is decoded only once.
+
+    std::map<std::string, std::vector<int>> photos;
+    int affected = 0;
+
+    for (int i = 0; i < rows.size(); i++) {
+        auto& row = rows.at(i);
+        bool changed = row.size() < 20 ||
+            fabs(atof(row[17].c_str()) - c_scale_width) > 0.05 ||
+            fabs(atof(row[18].c_str()) - c_proximal) > 0.05 ||
+            fabs(atof(row[19].c_str()) - c_distal) > 0.05;
+
+        if (!changed) continue;
+        photos[row[1]].push_back(i);
+        affected += 1;
+    }
+
+    printf(
+        "[i] replay: %d of %zu rois affected, from %zu photographs. \n",
+        affected, rows.size(), photos.size()
+    );
+
+    char fmtstring_src[1024] = "";
+    char fmtstring_scale[1024] = "";
+    char fmtstring_scale_annot[1024] = "";
+    strcpy(fmtstring_src, datapath);
+    strcpy(fmtstring_scale, datapath);
+    strcpy(fmtstring_scale_annot, datapath);
+    strcat(fmtstring_src, "/sources/%d.jpg");
+    strcat(fmtstring_scale, "/scales/%d.jpg");
+    strcat(fmtstring_scale_annot, "/scales.annot/%d.jpg");
+
+    char field[64] = "";
+    char savefname[1024] = "";
+
+    for (auto& photo : photos) {
+
+        printf("replaying %s ... \n", photo.first.c_str());
+        auto start = chrono::system_clock::now();
+
+        stage_timer_t decode("decode");
+        cv::Mat grayscale = cv::imread(photo.first, cv::IMREAD_GRAYSCALE);
+        decode.stop();
+        if (grayscale.empty()) {
+            printf("  [e] cannot read the source photograph. skipped. \n");
+            continue;
+        }
+
+        cv::Mat scaled_gray;
+        double scaled_zoom = -1;
+
+        for (int i : photo.second) {
+            auto& row = rows.at(i);
+            int uid = atoi(row[0].c_str());
+
+            // rows written before the settings are recorded keep their zoom,
+            // only the boundary positions are replayed.
+
+            double zoom = atof(row[14].c_str());
+            bool rescale = row.size() >= 20 &&
+                fabs(atof(row[17].c_str()) - c_scale_width) > 0.05;
+            if (rescale) zoom *= c_scale_width / atof(row[17].c_str());
+
+            if (zoom != scaled_zoom) {
+                cv::resize(grayscale, scaled_gray, cv::Size(0, 0), zoom, zoom);
+                scaled_zoom = zoom;
+            }
+
+            cv::Point2d origin(atof(row[9].c_str()), atof(row[10].c_str()));
+            cv::Point2d base(atof(row[11].c_str()), atof(row[12].c_str()));
+            double length = distance(origin, base);
+            if (length <= 0) {
+                printf("  [!] %d has no recorded axis. skipped. \n", uid);
+                continue;
+            }
+
+            geometry_t geo;
+            geo.origin = cv::Point2d(origin.x * zoom, origin.y * zoom);
+            geo.unif = cv::Point2d((base.x - origin.x) / length, (base.y - origin.y) / length);
+            geo.zoom = zoom;
+
+            cv::Mat roi;
+            bool pass = false;
+            if (!extract_roi(grayscale, scaled_gray, geo, roi, pass, NULL)) {
+                printf("  [!] %d is too narrow at the new positions. skipped. \n", uid);
+                continue;
+            }
+
+            row[4] = pass ? "x" : ".";
+            sprintf(field, "%.1f", geo.base.x); row[11] = field;
+            sprintf(field, "%.1f", geo.base.y); row[12] = field;
+            sprintf(field, "%d", geo.width); row[13] = field;
+            sprintf(field, "%.4f", zoom); row[14] = field;
+            sprintf(field, "%.4f", geo.orient.x); row[15] = field;
+            sprintf(field, "%.4f", geo.orient.y); row[16] = field;
+
+            stage_timer_t timer("write", uid);
+            sprintf(savefname, fmtstring_src, uid);
+            cv::imwrite(savefname, roi);
+            timer.stop();
+
+            if (rescale) {
+                cv::Mat scale_bar, view;
+                uchar dark, light;
+                double size;
+                bool success;
+
+                // the scale card is sized by the recorded span of the triangle
+                // pair, as in a fresh run. the rows without it take the scale
+                // width, which is what the span approximates.
+
+                double span = c_scale_width;
+                if (row.size() >= 23 && atof(row[22].c_str()) > 0)
+                    span = atof(row[22].c_str()) * zoom;
+
+                extract_scale(scaled_gray, geo, span, scale_bar);
+                analyze_scale(scale_bar, dark, light, size, success, view);
+
+                sprintf(field, "%d", dark); row[6] = field;
+                sprintf(field, "%d", light); row[7] = field;
+                sprintf(field, "%.2f", size); row[8] = field;
+
+                sprintf(savefname, fmtstring_scale, uid);
+                cv::imwrite(savefname, scale_bar);
+                sprintf(savefname, fmtstring_scale_annot, uid);
+                cv::imwrite(savefname, view);
+            }
+
+            if (row.size() < 20) row.resize(20);
+            sprintf(field, "%.1f", c_scale_width); row[17] = field;
+            sprintf(field, "%.1f", c_proximal); row[18] = field;
+            sprintf(field, "%.1f", c_distal); row[19] = field;
+        }
+
+        auto end = chrono::system_clock::now();
+        auto duration = chrono::duration_cast<chrono::milliseconds>(end - start);
+        double ms = double(duration.count()) * chrono::milliseconds::period::num /
+                    chrono::milliseconds::period::den;
+        printf("< %.3f s\n", ms);
+    }
+
+    // rewrite the rois.tsv through a temporary file, so that an interrupted
+    // replay does not lose the dataset index.
+
+    char tmpfname[1024] = "";
+    strcpy(tmpfname, roifname);
+    strcat(tmpfname, ".tmp");
+
+    FILE* tmpfile = fopen(tmpfname, "w");
+    if (tmpfile == NULL) {
+        printf("[e] cannot write to the output folder! \n");
+        return 1;
+    }
+
+    for (auto& row : rows) {
+        for (int c = 0; c < row.size(); c++)
+            fprintf(tmpfile, c == 0 ? "%s" : "\t%s", row[c].c_str());
+        fprintf(tmpfile, "\n");
+    }
+
+    fclose(tmpfile);
+    fs::rename(tmpfname, roifname);
+    return 0;
+}
+
+// detect the positioning triangles within a window of the photograph. the
+// redness plane and its sharpening are computed on the window padded by 3
+// sigma of the unsharp mask, instead of the full frame. the first round zoom
+// is 1, so the found triangles are in the coordinates of the photograph.
+
+void anchor_window(frame_t& frame, cv::Rect window, std::vector<std::vector<cv::Point>>& found)
+{
+    cv::Rect bounds(0, 0, frame.colored.cols, frame.colored.rows);
+    int padding = 75;
+
+    window = window & bounds;
+    if (window.area() == 0) return;
+
+    cv::Rect padded = cv::Rect(
+        window.x - padding, window.y - padding,
+        window.width + 2 * padding, window.height + 2 * padding) & bounds;
+
+    cv::Mat hsv, usm;
+    cv::cvtColor(frame.colored(padded), hsv, cv::COLOR_BGR2HSV);
+    cv::Mat red(hsv.size(), CV_8U, cv::Scalar(0));
+    stage_timer_t significance("significance");
+    color_significance(hsv, red, 0.0);
+    significance.stop();
+    sharpen(red, usm, 1);
+    red.release();
+
+    cv::Rect inner(window.x - padded.x, window.y - padded.y, window.width, window.height);
+    cv::Mat usm_window = usm(inner);
+    cv::Mat hsv_window = hsv(inner);
+
+    anchors_t anch;
+    anchor(usm_window, anch, 1);
+    filter_mean_color(hsv_window, anch);
+
+    for (int j = 0; j < anch.detections; j++) {
+        std::vector<cv::Point> tri;
+        for (int k = 0; k < 3; k++)
+            tri.push_back(cv::Point(
+                anch.vertices[6 * j + 2 * k + 0] + window.x,
+                anch.vertices[6 * j + 2 * k + 1] + window.y));
+        found.push_back(tri);
+    }
+}
+
+// fill the anchors with the given triangles, and estimate the zoom the same
+// way as filter_mean_color.
+
+void collect_anchors(std::vector<std::vector<cv::Point>>& triangles, anchors_t& anchors)
+{
+    std::vector<int> array(6 * triangles.size());
+    double total_length = 0;
+    for (int j = 0; j < triangles.size(); j++)
+    {
+        for (int k = 0; k < 3; k++) {
+            array[j * 6 + 2 * k + 0] = triangles[j][k].x;
+            array[j * 6 + 2 * k + 1] = triangles[j][k].y;
+        }
+
+        total_length += cv::arcLength(triangles[j], true);
+    }
+
+    total_length /= triangles.size();
+
+    anchors.detections = triangles.size();
+    anchors.vertices.swap(array);
+    anchors.zoom = ((34.14 * c_scale_factor) / total_length) * zoom_first_round;
+    if (triangles.size() == 0) anchors.zoom = -1;
+}
+
+// temporal tracking (--track). photographs from a fixed capture rig have the
+// positioning triangles nearly in place, so each triangle of the last
+// photograph is searched only in a window around its last position, extended
+// by drift. returns false if any of the triangles is lost.
+
+bool track_anchors(frame_t& frame, anchors_t& previous, anchors_t& anchors, double drift)
+{
+    std::vector<std::vector<cv::Point>> triangles;
+    int margin = int(drift) + 10;
+
+    for (int i = 0; i < previous.detections; i++)
+    {
+        int* v = previous.vertices.data() + 6 * i;
+        std::vector<cv::Point> tri = {
+            cv::Point(v[0], v[1]), cv::Point(v[2], v[3]), cv::Point(v[4], v[5]) };
+        cv::Point2d center((v[0] + v[2] + v[4]) / 3.0, (v[1] + v[3] + v[5]) / 3.0);
+
+        cv::Rect window = cv::boundingRect(tri);
+        window = cv::Rect(
+            window.x - margin, window.y - margin,
+            window.width + 2 * margin, window.height + 2 * margin);
+
+        std::vector<std::vector<cv::Point>> found;
+        anchor_window(frame, window, found);
+
+        // the candidate closest to the last position, within the drift.
+
+        int best = -1;
+        double best_distance = drift;
+        for (int j = 0; j < found.size(); j++) {
+            cv::Point2d c(
+                (found[j][0].x + found[j][1].x + found[j][2].x) / 3.0,
+                (found[j][0].y + found[j][1].y + found[j][2].y) / 3.0);
+            if (distance(center, c) <= best_distance) {
+                best = j;
+                best_distance = distance(center, c);
+            }
+        }
+
+        if (best < 0) return false;
+        triangles.push_back(found[best]);
+    }
+
+    collect_anchors(triangles, anchors);
+    return true;
+}
+
+// band streaming (--band). for very large scans, the redness plane, its
+// sharpening and the contours are computed in horizontal bands of the given
+// rows rather than on the full frame. each band is extended by band_extent
+// rows on both sides, so that a triangle crossing a seam lies whole in both
+// of the neighboring bands. the triangle is kept only by the band holding its
+// centroid, which stitches the duplicates across the seams.
+
+void anchor_bands(frame_t& frame, anchors_t& anchors, int rows)
+{
+    int width = frame.colored.cols;
+    int height = frame.colored.rows;
+    std::vector<std::vector<cv::Point>> triangles;
+
+    for (int top = 0; top < height; top += rows) {
+        std::vector<std::vector<cv::Point>> found;
+        anchor_window(
+            frame, cv::Rect(0, top - band_extent, width, rows + 2 * band_extent),
+            found);
+
+        for (auto& tri : found) {
+            double cy = (tri[0].y + tri[1].y + tri[2].y) / 3.0;
+            if (cy >= top && cy < top + rows) triangles.push_back(tri);
+        }
+    }
+
+    collect_anchors(triangles, anchors);
+}
+
+// infer the meeting point of the two legs of each triangle, and pair the
+// triangles with adjacent meeting points. the coordinates are scaled by the
+// anchors' zoom.
+
+int pair_anchors(
+    anchors_t& anch,
+    std::vector<std::pair<int, cv::Point2d>>& meeting_points,
+    std::vector<std::pair<int, int>>& paired,
+    std::vector<cv::Point2d>& base_vertice,
+    std::vector<cv::Point2d>& base_meeting)
+{
+    stage_timer_t timer("pairing");
+    double zoom = anch.zoom;
+
+    for (int i = 0; i < anch.detections; i++)
+    {
+        cv::Point2d p1(anch.vertices[6 * i + 0] * zoom, anch.vertices[6 * i + 1] * zoom);
+        cv::Point2d p2(anch.vertices[6 * i + 2] * zoom, anch.vertices[6 * i + 3] * zoom);
+        cv::Point2d p3(anch.vertices[6 * i + 4] * zoom, anch.vertices[6 * i + 5] * zoom);
+
+        cv::Point2d vert, hei;
+
+        if (distance(p1, p2) < distance(p2, p3) && distance(p1, p3) < distance(p2, p3))
+        {
+            vert = p1;
+            hei = cv::Point2d((p2.x + p3.x) / 2, (p2.y + p3.y) / 2);
+        }
+
+        if (distance(p2, p1) < distance(p1, p3) && distance(p2, p3) < distance(p1, p3))
+        {
+            vert = p2;
+            hei = cv::Point2d((p1.x + p3.x) / 2, (p1.y + p3.y) / 2);
+        }
+
+        if (distance(p3, p2) < distance(p1, p2) && distance(p3, p1) < distance(p1, p2))
+        {
+            vert = p3;
+            hei = cv::Point2d((p1.x + p2.x) / 2, (p1.y + p2.y) / 2);
+        }
+
+        std::pair<int, cv::Point2d> temp;
+        temp.first = i;
+        temp.second = cv::Point2d(
+            vert.x + (hei.x - vert.x) * 5.02,
+            vert.y + (hei.y - vert.y) * 5.02);
+        meeting_points.push_back(temp);
+        base_vertice.push_back(vert);
+    }
+
+    // approximate pairs by adjacent meeting points
+    // (tolerate a range within 20px range)
+
+    for (int i = 0; i < meeting_points.size(); i++)
+    {
+        for (int j = i + 1; j < meeting_points.size(); j++)
+        {
+            if (distance(meeting_points[i].second, meeting_points[j].second) < c_pair_distance_threshold)
+            { // FIXME. CHANGE
+                paired.push_back(std::pair<int, int>(
+                    meeting_points[i].first, meeting_points[j].first));
+                base_meeting.push_back(cv::Point2d(
+                    (meeting_points[i].second.x + meeting_points[j].second.x) * 0.5,
+                    (meeting_points[i].second.y + meeting_points[j].second.y) * 0.5));
+            }
+        }
+    }
+
+    return paired.size();
+}
+
+// the unsharp-masked redness plane, resized by prepzoom.
+
+void sharpen(cv::Mat &image, cv::Mat &usm, double prepzoom)
 {
     cv::Mat smaller;
     cv::resize(image, smaller, cv::Size(0, 0), prepzoom, prepzoom);
@@ -983,15 +2088,56 @@ void anchor(cv::Mat &image, anchors_t &anchors, double prepzoom)
     cv::Mat blurred;
     cv::GaussianBlur(smaller, blurred, cv::Size(5, 5), 0);
 
-    cv::Mat blur_usm, usm;
+    cv::Mat blur_usm;
     cv::GaussianBlur(blurred, blur_usm, cv::Size(0, 0), 25);
     cv::addWeighted(blurred, 1.5, blur_usm, -0.5, 0, usm);
+}
+
+// detect the triangles from the sharpened redness plane (see sharpen) that is
+// already resized by prepzoom.
+
+void anchor(cv::Mat &usm, anchors_t &anchors, double prepzoom)
+{
+#ifdef verbose
+    cv::Mat smaller;
+    usm.copyTo(smaller);
+#endif
 
     cv::Mat morph = cv::Mat::zeros(usm.size(), CV_8UC1);
     cv::threshold(usm, morph, red_thresh, 255, cv::THRESH_BINARY);
 
+    // candidate cascade. the area and the bounding box of every connected
+    // component come from one labelling pass. a triangle fills at most a half
+    // of its bounding box (plus the pixels on its edges), and the perimeter
+    // test below rejects the slim ones, so components too small, or filling
+    // too little or too much of the box are rejected before their contours
+    // are traced for the polygon approximation.
+
+    cv::Mat labels, stats, centroids;
+    int ncomponents = cv::connectedComponentsWithStats(morph, labels, stats, centroids, 8, CV_32S);
+
     std::vector<std::vector<cv::Point>> contours;
-    cv::findContours(morph, contours, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+    for (int c = 1; c < ncomponents; c++)
+    {
+        int* stat = stats.ptr<int>(c);
+        cv::Rect box(
+            stat[cv::CC_STAT_LEFT], stat[cv::CC_STAT_TOP],
+            stat[cv::CC_STAT_WIDTH], stat[cv::CC_STAT_HEIGHT]);
+        double fill = stat[cv::CC_STAT_AREA] / double(box.area());
+
+        if (stat[cv::CC_STAT_AREA] < 10 || fill < cascade_fill_min || fill > cascade_fill_max)
+            continue;
+
+        cv::Mat component;
+        cv::compare(labels(box), c, component, cv::CMP_EQ);
+        std::vector<std::vector<cv::Point>> outer;
+        cv::findContours(component, outer, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE, box.tl());
+        for (auto& cont : outer) contours.push_back(cont);
+    }
+
+    cascade_components += ncomponents - 1;
+    cascade_contours += contours.size();
+
     std::vector<std::vector<cv::Point>> vertices(contours.size());
     std::vector<int> filter_indices;
 
@@ -1026,7 +2172,7 @@ void anchor(cv::Mat &image, anchors_t &anchors, double prepzoom)
         }
     }
 
-    int *array = (int *)malloc(sizeof(int) * 6 * filter_indices.size());
+    std::vector<int> array(6 * filter_indices.size());
     for (int j = 0; j < filter_indices.size(); j++)
     {
         array[j * 6 + 0] = (int)(vertices[filter_indices[j]][0].x / prepzoom);
@@ -1041,17 +2187,25 @@ void anchor(cv::Mat &image, anchors_t &anchors, double prepzoom)
     show(smaller, "annotated", 800, 600);
 #endif
 
-    anchors.vertices = array;
+    cascade_triangles += filter_indices.size();
+
+    anchors.vertices.swap(array);
     anchors.detections = filter_indices.size();
     anchors.zoom = prepzoom;
 }
 
-void filter_mean_color(cv::Mat &colored, anchors_t &anchors)
+// filter the triangles by their mean colors. hsv is the colored photograph
+// resized by the anchors' zoom, in hsv color space.
+
+void filter_mean_color(cv::Mat &hsv, anchors_t &anchors)
 {
-    cv::Mat smaller, hsv;
     double zoom = anchors.zoom;
-    cv::resize(colored, smaller, cv::Size(0, 0), zoom, zoom);
-    cv::cvtColor(smaller, hsv, cv::COLOR_BGR2HSV);
+
+#ifdef verbose
+    cv::Mat smaller;
+    cv::cvtColor(hsv, smaller, cv::COLOR_HSV2BGR);
+#endif
+
     std::vector<std::vector<cv::Point>> contours;
 
     for (int i = 0; i < anchors.detections; i++)
@@ -1093,7 +2247,7 @@ void filter_mean_color(cv::Mat &colored, anchors_t &anchors)
 
     // by now, generate the valid reference red triangles.
 
-    int *array = (int *)malloc(sizeof(int) * 6 * filter_indices.size());
+    std::vector<int> array(6 * filter_indices.size());
     double total_length = 0;
     for (int j = 0; j < filter_indices.size(); j++)
     {
@@ -1115,18 +2269,12 @@ void filter_mean_color(cv::Mat &colored, anchors_t &anchors)
         total_length += cv::arcLength(contours[filter_indices[j]], true);
     }
 
-    if (filter_indices.size() == 0) {
-        printf("  [e] no valid positioning angle passed for the color filter\n");
-        printf("  [e] this probably because the image is too small, or the redness of triangle being \n");
-        printf("  [e] influcenced by the photographing conditions. consider -y and -z options. \n");
-        anchors.zoom = -1;
-    }
+    if (filter_indices.size() == 0) anchors.zoom = -1;
 
     total_length /= filter_indices.size();
-    free(anchors.vertices);
 
     anchors.detections = filter_indices.size();
-    anchors.vertices = array;
+    anchors.vertices.swap(array);
     anchors.zoom = ((34.14 * c_scale_factor) / total_length) * zoom;
 
 #ifdef verbose
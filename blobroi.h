@@ -27,14 +27,112 @@ struct arguments {
     char input[1024];
     bool directory;
     bool fname_as_sample;
+    bool replay;
+    char sweep[1024];
+    bool gate;
+    double track;
+    int band;
+    double mem_budget;
+    char trace[1024];
+    bool counters;
+    bool memory;
+    char isa[128];
 };
 
+// the vertices of the detected triangles, six coordinates (three points) per
+// triangle.
+
 typedef struct anchors {
     int detections;
-    int* vertices;
+    std::vector<int> vertices;
     double zoom;
 } anchors_t;
 
+// the geometry of one test paper. origin and unif (the unit vector of the
+// axis) are in the scaled image, base (the proximal point on the axis) is in
+// the original photograph, orient is the corrected orientation.
+
+typedef struct geometry {
+    cv::Point2d origin;
+    cv::Point2d unif;
+    cv::Point2d base;
+    cv::Point2d orient;
+    int width;
+    double zoom;
+} geometry_t;
+
+// the decoded photograph, with the planes prepared for the anchor detection
+// (resized by the first round zoom, see prepare_frame). none of them depends
+// on the geometric settings, so a sweep shares them among all configurations.
+
+typedef struct frame {
+    cv::Mat grayscale;
+    cv::Mat colored;
+    cv::Mat usm;
+    cv::Mat hsv;
+} frame_t;
+
+// one configuration of a parameter sweep (--sweep). each configuration writes
+// to its own subfolder of the output folder, with its own rois.tsv and uids.
+
+typedef struct config {
+    char name[256];
+    double scale_factor;
+    double scale_width;
+    double proximal;
+    double distal;
+    int posang_size;
+    int posang_thresh;
+    char datapath[1024];
+    FILE* logfile;
+    int save_count;
+} config_t;
+
+// measurements of the pre-flight gate (--gate) on the preview of a photograph.
+
+typedef struct preview {
+    double sharpness;
+    double dark;
+    double bright;
+    double red;
+    double ms;
+    bool reject;
+    bool flag;
+    char reasons[256];
+} preview_t;
+
 double process(char *file, char* purefname, bool show_msg, struct arguments* args);
-void anchor(cv::Mat &image, anchors_t &anchors, double prepzoom);
-void filter_mean_color(cv::Mat &colored, anchors_t &anchors);
+void decode_frame(std::vector<uchar>& encoded, frame_t& frame);
+void prepare_frame(frame_t& frame);
+bool inspect_preview(std::vector<uchar>& encoded, preview_t& out);
+bool preflight(char* file, std::vector<uchar>& encoded);
+void plan_budget(char* file, struct arguments* args);
+double process_frame(frame_t& frame, char *file, char* purefname, struct arguments* args);
+void anchor_window(frame_t& frame, cv::Rect window, std::vector<std::vector<cv::Point>>& found);
+void collect_anchors(std::vector<std::vector<cv::Point>>& triangles, anchors_t& anchors);
+void anchor_bands(frame_t& frame, anchors_t& anchors, int rows);
+bool track_anchors(frame_t& frame, anchors_t& previous, anchors_t& anchors, double drift);
+int pair_anchors(
+    anchors_t& anch,
+    std::vector<std::pair<int, cv::Point2d>>& meeting_points,
+    std::vector<std::pair<int, int>>& paired,
+    std::vector<cv::Point2d>& base_vertice,
+    std::vector<cv::Point2d>& base_meeting
+);
+void sharpen(cv::Mat &image, cv::Mat &usm, double prepzoom);
+void anchor(cv::Mat &usm, anchors_t &anchors, double prepzoom);
+void filter_mean_color(cv::Mat &hsv, anchors_t &anchors);
+
+void extract_scale(cv::Mat& scaled_gray, geometry_t& geo, double span, cv::Mat& scale_bar);
+bool extract_roi(
+    cv::Mat& grayscale, cv::Mat& scaled_gray, geometry_t& geo,
+    cv::Mat& roi, bool& pass, cv::Mat* annot
+);
+void analyze_scale(
+    cv::Mat& sc, uchar& dark, uchar& light, double& size,
+    bool& success, cv::Mat& view
+);
+int replay(struct arguments* args);
+int read_sweep(const char* fname, struct arguments* args);
+void use_config(config_t& conf);
+double sweep(char *file, char* purefname, bool show_msg, struct arguments* args);
@@ -0,0 +1,541 @@
+
+//    Copyright (C) 2024 Zheng Yang <xornent@outlook.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "blobseg.h"
+
+#include <iostream>
+#include <filesystem>
+#include <chrono>
+#include <thread>
+
+#ifdef unix
+#include <argp.h>
+#else
+#include "argparse/argparse.hpp"
+#endif
+
+namespace fs = std::filesystem;
+namespace chrono = std::chrono;
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/highgui.hpp>
+#include <opencv2/calib3d.hpp>
+
+// ============================================================================
+
+int start_id = 1;
+int end_id = INT32_MAX - 10; // we will calculate end_id + 1, no overflow then.
+bool incremental = false;
+bool use_cache = false;
+bool binary = false;
+char tracepath[1024] = "";
+bool use_counters = false;
+bool use_memory = false;
+char isa[128] = ""; // empty for the best the cpu supports.
+double mem_budget = 0; // megabytes, 0 for unlimited.
+int jobs = 1;
+
+// the estimated bytes per roi pixel held until the results are written, the
+// larger of the segmenters selected. see blobshed and blobnn.
+
+static double footprint_shed = (12.0);
+static double footprint_unet = (20.0);
+
+static FILE* roifile = NULL;
+
+// the selected segmenters, and the results of each under SOURCE/<name>.
+
+static std::vector<segmenter_t*> selected;
+static std::vector<sink_t> sinks;
+static std::set<int> kept; // uids of previous lines to be written back.
+
+static char datapath[1024] = ".";
+static char segmenters[1024] = "";
+static char modelfpath[1024] = "";
+
+// ============================================================================
+
+// windows do not support the glibc's getline function, we need to write our
+// own version to use it:
+
+#ifndef unix
+
+#define max_line_len 65535
+
+ssize_t getline(char **lineptr, size_t *n, FILE *stream) {
+    char* line = (char*) malloc(max_line_len);
+    char* result = fgets(line, max_line_len - 1, stream);
+    
+    if (result == NULL) return -1;
+    line[max_line_len - 1] = '\0';
+    *n = strlen(line);
+    *lineptr = line;
+    return strlen(line);
+}
+
+#endif
+
+// ============================================================================
+
+// argument parser
+
+static char doc[] = 
+    "blobseg: segment the extracted rois with several segmenters over one decode. " soft_br
+    "the watershed-like segmenter of blobshed (shed) and the neural network of blobnn " soft_br
+    "(unet) each write their results to a folder of their name under the source. \n\n"
+    "this software is a free software licensed under gnu gplv3. it comes with absolutely " soft_br
+    "no warranty. for details, see <https://www.gnu.org/licenses/gpl-3.0.html>";
+
+static char args_doc[] = 
+    "[--start M] [--end N] [--incremental] [--segmenters LIST] [--cutoff CUTOFF] [--model PT] "
+    "[--cache] [--binary] [--jobs N] [--mem-budget MB] [--isa NAME] [--trace FILE] [--counters] [--memory] [SOURCE]";
+
+#ifdef unix
+static struct argp_option options[] = {
+    { "start", 'm', "M", 0, "starting index (included) of the uid. (0)"},
+    { "end", 'n', "N", 0, "ending index (included) of the uid. (int32-max)"},
+    { "incremental", 'i', 0, 0, "segment only the uids missing from any raw.tsv, or whose rois.tsv "
+      "row or source image changed since, and keep the other previous results"},
+    { "segmenters", 's', "LIST", 0, "comma separated segmenters to run, of shed and unet "
+      "(shed, and unet if a model is given)"},
+    { "cutoff", 'c', "CUTOFF", 0, "prediction grayscale cutoff for foreground mask of unet (180)" },
+    { "model", 't', "PT", 0, "path to the torch script model (*.pt) of unet"},
+    { "cache", 'k', 0, 0, "reuse the segmentation results cached under SOURCE/cache, "
+      "keyed by the roi pixels and the parameters of each segmenter"},
+    { "binary", 'b', 0, 0, "write the results to the binary columnar SOURCE/results.bin, "
+      "updated in place, instead of raw.tsv and stats.tsv (see blobtsv)"},
+    { "jobs", 'j', "N", 0, "segment the rois on N threads, each taking a contiguous slice "
+      "of the rois, for the segmenters without a model (1)"},
+    { "mem-budget", 'B', "MB", 0, "segment the rois in chunks whose estimated footprint, from "
+      "the dimensions of the rois, fits in MB megabytes (0, unlimited)"},
+    { "isa", 'I', "NAME", 0, "run the pixel kernels with the instruction set NAME: scalar, "
+      "sse4.2, avx2, avx512, or auto for the best the cpu supports (auto)"},
+    { "trace", 'T', "FILE", 0, "write the stage spans as chrome trace events to FILE" },
+    { "counters", 'P', 0, 0, "count the cycles, instructions, cache and branch misses of each stage "
+      "with the hardware performance counters, where permitted"},
+    { "memory", 'M', 0, 0, "account the allocations, the peak matrix memory and the resident "
+      "set of each stage, written to memory.tsv under SOURCE"},
+    { 0 }
+};
+
+const char *argp_program_version = "spblob:blobseg 1.5";
+const char *argp_program_bug_address = "yang-z. <xornent@outlook.com>";
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    
+    switch (key) {
+        case 'm':
+            start_id = atoi(arg);
+            break;
+        case 'n': 
+            end_id = atoi(arg);
+            break;
+        case 'i':
+            incremental = true;
+            break;
+        case 's':
+            strcpy(segmenters, arg);
+            break;
+        case 'c':
+            unet_cutoff = atoi(arg);
+            break;
+        case 't':
+            strcpy(modelfpath, arg);
+            break;
+        case 'k':
+            use_cache = true;
+            break;
+        case 'b':
+            binary = true;
+            break;
+        case 'j':
+            jobs = atoi(arg);
+            break;
+        case 'B':
+            mem_budget = atof(arg);
+            break;
+        case 'I':
+            strcpy(isa, arg);
+            break;
+        case 'T':
+            strcpy(tracepath, arg);
+            break;
+        case 'P':
+            use_counters = true;
+            break;
+        case 'M':
+            use_memory = true;
+            break;
+        case ARGP_KEY_ARG:
+            strcpy(datapath, arg);
+            break;
+        case ARGP_KEY_END:
+            if (state -> arg_num != 1) argp_usage(state);
+            break;
+        default: return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+#endif
+
+// pick the segmenters by their names in the comma separated list. without a
+// list, shed runs, and unet too when a model is given.
+
+static bool select_segmenters(char* list)
+{
+    if (strlen(list) == 0) {
+        selected.push_back(&shed_segmenter);
+        if (strlen(modelfpath) > 0) selected.push_back(&unet_segmenter);
+        return true;
+    }
+
+    char* name = strtok(list, ",");
+    while (name != NULL) {
+        segmenter_t* seg = NULL;
+        if (strcmp(name, shed_segmenter.name) == 0) seg = &shed_segmenter;
+        else if (strcmp(name, unet_segmenter.name) == 0) seg = &unet_segmenter;
+        else {
+            printf("[e] unknown segmenter %s! \n", name);
+            return false;
+        }
+
+        bool dup = false;
+        for (auto s : selected) dup = dup || s == seg;
+        if (!dup) selected.push_back(seg);
+        name = strtok(NULL, ",");
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[]) 
+{
+    // read the program parameters
+
+#ifdef unix
+    argp_parse(&argp, argc, argv, 0, 0, NULL);
+#else
+
+    argparse::ArgumentParser program("blobseg", "1.5");
+
+    program.add_argument("-m", "--start")
+        .help("starting index (included) of the uid. (0)")
+        .metavar("M")
+        .default_value(start_id)
+        .scan<'i', int>();
+
+    program.add_argument("-n", "--end")
+        .help("ending index (included) of the uid. (int32-max)")
+        .metavar("N")
+        .default_value(end_id)
+        .scan<'i', int>();
+
+    program.add_argument("-i", "--incremental")
+        .help("segment only the uids missing from any raw.tsv, or whose rois.tsv " soft_br
+              "row or source image changed since, and keep the other previous results")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-s", "--segmenters")
+        .help("comma separated segmenters to run, of shed and unet " soft_br
+              "(shed, and unet if a model is given)")
+        .default_value(std::string(""))
+        .metavar("LIST");
+
+    program.add_argument("-c", "--cutoff")
+        .help("prediction grayscale cutoff for foreground mask of unet (180)")
+        .metavar("CUTOFF")
+        .default_value(unet_cutoff)
+        .scan<'i', int>();
+
+    program.add_argument("-t", "--model")
+        .help("path to the torch script model (*.pt) of unet")
+        .default_value(std::string(""))
+        .metavar("PT");
+
+    program.add_argument("-k", "--cache")
+        .help("reuse the segmentation results cached under SOURCE/cache, " soft_br
+              "keyed by the roi pixels and the parameters of each segmenter")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-b", "--binary")
+        .help("write the results to the binary columnar SOURCE/results.bin, " soft_br
+              "updated in place, instead of raw.tsv and stats.tsv (see blobtsv)")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-j", "--jobs")
+        .help("segment the rois on N threads, each taking a contiguous slice of the rois, " soft_br
+              "for the segmenters without a model (1)")
+        .metavar("N")
+        .default_value(jobs)
+        .scan<'i', int>();
+
+    program.add_argument("-B", "--mem-budget")
+        .help("segment the rois in chunks whose estimated footprint, from the dimensions " soft_br
+              "of the rois, fits in MB megabytes (0, unlimited)")
+        .metavar("MB")
+        .default_value(0.0)
+        .scan<'f', double>();
+
+    program.add_argument("-I", "--isa")
+        .help("run the pixel kernels with the instruction set NAME: scalar, sse4.2, " soft_br
+              "avx2, avx512, or auto for the best the cpu supports (auto)")
+        .default_value(std::string(""))
+        .metavar("NAME");
+
+    program.add_argument("-T", "--trace")
+        .help("write the stage spans as chrome trace events to FILE")
+        .default_value(std::string(""))
+        .metavar("FILE");
+
+    program.add_argument("-P", "--counters")
+        .help("count the cycles, instructions, cache and branch misses of each stage " soft_br
+              "with the hardware performance counters, where permitted")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-M", "--memory")
+        .help("account the allocations, the peak matrix memory and the resident set of " soft_br
+              "each stage, written to memory.tsv under SOURCE")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("source")
+        .help("the directory of blobroi's output, as the input")
+        .metavar("SOURCE");
+
+    program.add_description(doc);
+
+    try { program.parse_args(argc, argv); }
+    catch (const std::exception& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    start_id = program.get<int>("--start");
+    end_id = program.get<int>("--end");
+    incremental = program.get<bool>("--incremental");
+    strcpy(segmenters, program.get("--segmenters").c_str());
+    unet_cutoff = program.get<int>("--cutoff");
+    strcpy(modelfpath, program.get("--model").c_str());
+    use_cache = program.get<bool>("--cache");
+    binary = program.get<bool>("--binary");
+    strcpy(isa, program.get("--isa").c_str());
+    strcpy(tracepath, program.get("--trace").c_str());
+    jobs = program.get<int>("--jobs");
+    mem_budget = program.get<double>("--mem-budget");
+    use_counters = program.get<bool>("--counters");
+    use_memory = program.get<bool>("--memory");
+    strcpy(datapath, program.get("source").c_str());
+
+#endif
+
+    if (!select_segmenters(segmenters)) return 1;
+
+    if (strlen(tracepath) > 0 && !trace_open(tracepath, "blobseg")) {
+        printf("[e] cannot open the trace file %s! \n", tracepath);
+        return 1;
+    }
+
+    if (use_counters) counters_open();
+    if (!isa_open(isa)) return 1;
+    pool_open(pool_share(mem_budget * 1024 * 1024));
+    if (use_memory) memory_open();
+
+    std::string opath(datapath);
+    if (!fs::is_directory(opath)) {
+        printf("[e] data output path do not exist! \n");
+        return 1;
+    }
+
+    char logfname[1024] = "\0";
+    strcpy(logfname, datapath);
+    strcat(logfname, "/rois.tsv");
+    std::string roifpath(logfname);
+
+    if (fs::is_regular_file(roifpath)) {
+        roifile = fopen(logfname, "r");
+    } else {
+        printf("[e] do not find rois.tsv under the source folder! \n");
+        return 1;
+    }
+
+    // open the folder of each segmenter. NO TWO INSTANCE OF THESE PROGRAMS
+    // SHOULD BE RUN WITH THE SAME OUTPUT FOLDER! or this will cause edit
+    // conflict.
+
+    double footprint_roi = footprint_shed;
+    sinks.resize(selected.size());
+    for (int k = 0; k < selected.size(); k++) {
+        if (selected[k] == &unet_segmenter) {
+            if (!unet_open(modelfpath)) return 1;
+            footprint_roi = footprint_unet;
+        }
+
+        std::string spath = opath + "/" + selected[k]->name;
+        if (!sink_open(sinks[k], spath.c_str(), binary)) {
+            printf("[e] cannot write the results under %s! \n", spath.c_str());
+            return 1;
+        }
+    }
+
+    // processing and reading the rois.tsv from output path.
+
+    char* line = NULL;
+    size_t len = 0;
+    ssize_t read;
+
+    roi_batch_t batch;
+    int uptodate = 0;
+    int segmented = 0;
+
+    if (use_cache && !cache_open(datapath)) {
+        printf("[e] cannot open the cache under the source folder! \n");
+        return 1;
+    }
+
+    // segment the rois read so far, and release them. without a budget, this
+    // runs once for all the rois after reading rois.tsv.
+
+    double budget = mem_budget * 1024 * 1024;
+    if (budget > 0) budget -= pool_share(budget);
+    double pending = 0;
+    auto flush = [&]() {
+        if (batch_size(batch) == 0) return;
+        if (budget > 0)
+            printf("[i] segmenting %d rois (about %.0f mb). \n",
+                   batch_size(batch), pending / (1024 * 1024));
+
+        // the segmenters take turns on the decoded batch, each refilling the
+        // output columns and writing them to its own folder.
+
+        for (int k = 0; k < selected.size(); k++) {
+            printf("[i] segmenting with %s ... \n", selected[k]->name);
+            segment_batch(*selected[k], batch, jobs, use_cache, true);
+            sink_write(sinks[k], batch, kept, use_cache);
+        }
+        segmented += batch_size(batch);
+        pending = 0;
+        batch_clear(batch);
+    };
+
+    while ((read = getline(&line, &len, roifile)) != -1) {
+        
+        if(len <= 1) continue;
+
+        char* sline = (char*) malloc(len + 1);
+        strncpy(sline, line, len);
+        sline[len] = '\0';
+
+        // read column by column ...
+
+        char* rline = sline;
+        char* col = strchr(sline, '\t'); *col = '\0';
+        int uidx = atoi(sline); sline = col + 1;
+
+        if (uidx >= start_id && uidx <= end_id) {  }
+        else { kept.insert(uidx); free(rline); continue; }
+
+        col = strchr(sline, '\t'); *col = '\0';
+        char* fname = sline; sline = col + 1;
+
+        col = strchr(sline, '\t'); *col = '\0';
+        int sidx = atoi(sline); sline = col + 1;
+
+        col = strchr(sline, '\t'); *col = '\0';
+        char* name = sline; sline = col + 1;
+
+        col = strchr(sline, '\t'); *col = '\0';
+        bool det = *sline == 'x'; sline = col + 1;
+
+        col = strchr(sline, '\t'); *col = '\0';
+        bool scale = *sline == 'x'; sline = col + 1;
+
+        col = strchr(sline, '\t'); *col = '\0';
+        int dark = atoi(sline); sline = col + 1;
+
+        col = strchr(sline, '\t'); *col = '\0';
+        int light = atoi(sline); sline = col + 1;
+
+        char fmtstring_src[1024] = "";
+        char savefname[1024] = "";
+        strcpy(fmtstring_src, datapath);
+        strcat(fmtstring_src, "/sources/%d.jpg");
+        sprintf(savefname, fmtstring_src, uidx);
+
+        // in incremental mode, skip the uids with a previous result derived
+        // from the same rois.tsv row and the same source image, in the folders
+        // of all the segmenters. a uid stale in any of them is segmented again
+        // by all. the hash of the source is recorded with the results.
+
+        std::vector<uchar> encoded;
+        read_file(savefname, encoded);
+        uint64_t source = hash_contents(encoded, 0);
+
+        if (incremental) {
+            bool stale = false;
+            for (auto& sk : sinks)
+                stale = stale || sink_stale(
+                    sk, uidx, fname, sidx, name, det, scale, dark, light, source);
+
+            if (!stale) {
+                kept.insert(uidx);
+                uptodate += 1;
+                free(rline);
+                continue;
+            }
+        }
+
+        if (budget > 0) {
+            int width = 0, height = 0;
+            double footprint = image_size(savefname, width, height) ?
+                (double) width * height * footprint_roi : 0;
+            if (pending + footprint > budget) flush();
+            pending += footprint;
+        }
+
+        stage_timer_t timer("decode", uidx);
+        cv::Mat src = decode_roi(encoded);
+        timer.stop();
+
+        batch_push(batch, uidx, fname, sidx, name, det, scale, dark, light, src, source);
+        free(rline);
+    }
+
+    fclose(roifile);
+    flush();
+
+    if (incremental)
+        printf("[i] incremental: %d uids up to date, %d segmented. \n",
+               uptodate, segmented);
+
+    // finalize. the previous lines after the last segmented uid are merged
+    // back at the tail.
+
+    for (auto& sk : sinks) sink_close(sk, kept);
+    if (use_cache) cache_close();
+
+    trace_close();
+    counters_write(datapath, "blobseg");
+    memory_write(datapath, "blobseg");
+    timing_write(datapath, "blobseg");
+    return 0;
+}
@@ -0,0 +1,579 @@
+//    Copyright (C) 2024 Zheng Yang <xornent@outlook.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "blobstat.h"
+
+#include <iostream>
+#include <filesystem>
+#include <unordered_map>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#ifdef unix
+#include <argp.h>
+#else
+#include "argparse/argparse.hpp"
+#endif
+
+namespace fs = std::filesystem;
+namespace chrono = std::chrono;
+
+extern "C" {
+#include "dpq/distrib.h"
+}
+
+// ============================================================================
+
+double level = 0.95;
+bool binary = false;
+char datapath[1024] = "";
+char outpath[1024] = "";
+int resamples = 0;
+int jobs = 1;
+uint64_t seed = 42;
+
+static const char* measure_names[8] = {
+    "log.abs", "log.delta", "log.light", "log.dark",
+    "log.back", "log.back.strict", "log.mean", "log.sz"
+};
+
+static std::vector<sample_t> samples;
+static std::unordered_map<std::string, int> sample_index;
+static std::unordered_map<std::string, int> file_index;
+
+// ============================================================================
+
+// argument parser
+
+static char doc[] =
+    "blobstat: aggregate the stats.tsv (or results.bin) of blobshed, blobnn or blobseg " soft_br
+    "in SOURCE by sample in one pass, with the mean, the standard deviation and the " soft_br
+    "confidence interval of every measure, and the f test of the consistency of the " soft_br
+    "replicates across the photographs. with -r, the percentile and bca bootstrap " soft_br
+    "intervals of the means of log.abs and log.delta are added. \n\n"
+    "this software is a free software licensed under gnu gplv3. it comes with absolutely " soft_br
+    "no warranty. for details, see <https://www.gnu.org/licenses/gpl-3.0.html>";
+
+static char args_doc[] =
+    "[-b] [-l LEVEL] [-o FILE] [-r N] [-j N] [-e SEED] SOURCE";
+
+#ifdef unix
+static struct argp_option options[] = {
+    { "binary", 'b', 0, 0, "read the binary columnar results.bin instead of stats.tsv"},
+    { "level", 'l', "LEVEL", 0, "the confidence level of the intervals (0.95)"},
+    { "output", 'o', "FILE", 0, "write the table to FILE (SOURCE/samples.tsv)"},
+    { "resamples", 'r', "N", 0, "bootstrap the means of log.abs and log.delta of each sample "
+      "with N resamples of its replicates (0, no bootstrap)"},
+    { "jobs", 'j', "N", 0, "bootstrap the samples on N threads (1)"},
+    { "seed", 'e', "SEED", 0, "seed of the resamples (42). the intervals depend only on the "
+      "seed and the input, not on the threads"},
+    { 0 }
+};
+
+const char *argp_program_version = "spblob:blobstat 1.5";
+const char *argp_program_bug_address = "yang-z. <xornent@outlook.com>";
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    switch (key) {
+        case 'b': binary = true; break;
+        case 'l': level = atof(arg); break;
+        case 'o': strcpy(outpath, arg); break;
+        case 'r': resamples = atoi(arg); break;
+        case 'j': jobs = atoi(arg); break;
+        case 'e': seed = strtoull(arg, NULL, 10); break;
+        case ARGP_KEY_ARG:
+            if (state -> arg_num == 0) strcpy(datapath, arg);
+            else argp_usage(state);
+            break;
+        case ARGP_KEY_END:
+            if (state -> arg_num != 1) argp_usage(state);
+            break;
+        default: return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+#endif
+
+// ============================================================================
+
+// welford's online mean and variance. m2 is the sum of the squared
+// deviations from the running mean.
+
+void welford_add(welford_t& acc, double x)
+{
+    acc.n += 1;
+    double delta = x - acc.mean;
+    acc.mean += delta / acc.n;
+    acc.m2 += delta * (x - acc.mean);
+}
+
+// add one stats.tsv row of a sample, taken on the photograph fname. the
+// sample and the photograph of the previous row are remembered, since the rows
+// of a photograph, and mostly of a sample, come together.
+
+void sample_add(const char* fname, const char* name, const double* values)
+{
+    static int last = -1;
+    static int last_file = -1;
+    static std::string last_fname;
+    static std::array<welford_t, 8>* replicate = NULL;
+
+    bool same_file = last_file >= 0 && last_fname == fname;
+    if (!same_file) {
+        last_fname = fname;
+        auto found = file_index.find(last_fname);
+        if (found == file_index.end()) {
+            last_file = file_index.size();
+            file_index[last_fname] = last_file;
+        } else last_file = found->second;
+    }
+
+    if (last < 0 || samples[last].name != name) {
+        auto found = sample_index.find(name);
+        if (found == sample_index.end()) {
+            sample_t sample = {};
+            sample.name = name;
+            samples.push_back(sample);
+            last = samples.size() - 1;
+            sample_index[name] = last;
+        } else last = found->second;
+        replicate = NULL;
+    }
+
+    sample_t& sample = samples[last];
+    if (replicate == NULL || !same_file) replicate = &sample.files[last_file];
+    for (int m = 0; m < 8; m++) {
+        welford_add(sample.measures[m], values[m]);
+        welford_add((*replicate)[m], values[m]);
+    }
+
+    if (resamples > 0)
+        for (int m = 0; m < 2; m++) sample.replicates[m].push_back(values[m]);
+}
+
+// parse a decimal as written by %.5f in stats.tsv. with at most 15 digits and
+// 22 decimals, the integer of the digits and the power of ten are exact, and
+// the one division is rounded as strtod rounds. any other form goes to strtod.
+
+static double parse_decimal(const char* str)
+{
+    static const double powers[23] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char* p = str;
+    bool negative = *p == '-';
+    if (negative) p++;
+
+    uint64_t digits = 0;
+    int ndigits = 0, decimals = 0;
+    bool point = false;
+    for (;; p++) {
+        if (*p >= '0' && *p <= '9') {
+            digits = digits * 10 + (*p - '0');
+            ndigits += 1;
+            if (point) decimals += 1;
+        } else if (*p == '.' && !point) point = true;
+        else break;
+    }
+
+    if (ndigits == 0 || ndigits > 15 || decimals > 22 ||
+        (*p != '\0' && *p != '\t' && *p != '\r' && *p != '\n'))
+        return strtod(str, NULL);
+
+    double x = (double) digits / powers[decimals];
+    return negative ? -x : x;
+}
+
+// stream stats.tsv: uid, file, sid, the eight logarithms and the sample name.
+
+long read_stats(const char* fname)
+{
+    FILE* f = fopen(fname, "r");
+    if (f == NULL) return -1;
+
+    long rows = 0;
+    std::vector<char> buffer(65536);
+    double values[8];
+
+    while (fgets(buffer.data(), buffer.size(), f) != NULL) {
+        char* cols[12];
+        char* start = buffer.data();
+        int ncol = 0;
+        while (ncol < 12) {
+            cols[ncol++] = start;
+            char* tab = strchr(start, '\t');
+            if (tab == NULL) break;
+            *tab = '\0';
+            start = tab + 1;
+        }
+
+        if (ncol < 12) continue;
+        cols[11][strcspn(cols[11], "\r\n")] = '\0';
+        for (int m = 0; m < 8; m++) values[m] = parse_decimal(cols[3 + m]);
+
+        sample_add(cols[1], cols[11], values);
+        rows += 1;
+    }
+
+    fclose(f);
+    return rows;
+}
+
+// pass over results.bin in ranges of rows, taking the rows that would be in
+// stats.tsv.
+
+long read_binary(const char* fname)
+{
+    columns_t cols;
+    if (!columns_open(cols, fname, false)) return -1;
+
+    long rows = 0;
+    std::vector<result_row_t> range;
+    double values[8];
+
+    for (uint32_t begin = 0; begin < cols.rows; begin += 65536) {
+        if (columns_range(cols, begin, 65536, range) == 0) break;
+        for (auto& row : range) {
+            if (!stat_values(row, values)) continue;
+            sample_add(row.fname, row.name, values);
+            rows += 1;
+        }
+    }
+
+    columns_close(cols);
+    return rows;
+}
+
+// the quantiles p of the t distributions with the degrees of freedom df.
+
+void t_quantiles(double p, std::vector<double>& df, std::vector<double>& out)
+{
+    out.resize(df.size());
+    for (size_t i = 0; i < df.size(); i++) out[i] = qt(p, df[i], 1, 0);
+}
+
+// splitmix64, the generator of the resamples. each sample has its own stream,
+// seeded by the seed and the index of the sample, so the draws of a sample do
+// not depend on which thread takes it, or in which order.
+
+static inline uint64_t splitmix(uint64_t& state)
+{
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// the p quantile of the values, interpolated between the order statistics as
+// the default of r. the values are partially reordered.
+
+static double quantile(std::vector<double>& values, double p)
+{
+    double h = (values.size() - 1) * std::min(std::max(p, 0.0), 1.0);
+    size_t low = (size_t) h;
+    std::nth_element(values.begin(), values.begin() + low, values.end());
+    double at = values[low];
+    if (low + 1 >= values.size()) return at;
+    double next = *std::min_element(values.begin() + low + 1, values.end());
+    return at + (h - low) * (next - at);
+}
+
+// resample the replicates of a sample, the two measures by the same draws,
+// and take the percentile and the bca intervals of their means. the bias
+// correction z0 is the normal quantile of the share of the resampled means
+// below the mean, and the acceleration is from the jackknife of the mean,
+// sum(d^3) / (6 sum(d^2)^1.5) with d the deviations of the replicates.
+
+void bootstrap_sample(sample_t& sample, uint64_t index, std::vector<double>* draws)
+{
+    size_t n = sample.replicates[0].size();
+    if (n < 2) return;
+
+    uint64_t state = seed ^ (index * 0xd1b54a32d192ed03ULL);
+
+    const double* x0 = sample.replicates[0].data();
+    const double* x1 = sample.replicates[1].data();
+    draws[0].resize(resamples);
+    draws[1].resize(resamples);
+
+    for (int b = 0; b < resamples; b++) {
+        double sum0 = 0, sum1 = 0;
+        for (size_t k = 0; k < n; k++) {
+            size_t j = ((splitmix(state) >> 32) * n) >> 32;
+            sum0 += x0[j];
+            sum1 += x1[j];
+        }
+        draws[0][b] = sum0 / n;
+        draws[1][b] = sum1 / n;
+    }
+
+    double alpha = (1 - level) / 2;
+    double zlow = qnorm(alpha, 0, 1, 1, 0);
+    double zhigh = qnorm(1 - alpha, 0, 1, 1, 0);
+
+    for (int m = 0; m < 2; m++) {
+        const double* x = sample.replicates[m].data();
+        double mean = 0;
+        for (size_t k = 0; k < n; k++) mean += x[k];
+        mean /= n;
+
+        double d2 = 0, d3 = 0;
+        for (size_t k = 0; k < n; k++) {
+            double d = x[k] - mean;
+            d2 += d * d;
+            d3 += d * d * d;
+        }
+
+        double below = 0;
+        for (double draw : draws[m])
+            below += draw < mean ? 1 : (draw == mean ? 0.5 : 0);
+
+        double z0 = qnorm(below / resamples, 0, 1, 1, 0);
+        double accel = d2 > 0 ? d3 / (6 * pow(d2, 1.5)) : 0;
+        double plow = pnorm(z0 + (z0 + zlow) / (1 - accel * (z0 + zlow)), 0, 1, 1, 0);
+        double phigh = pnorm(z0 + (z0 + zhigh) / (1 - accel * (z0 + zhigh)), 0, 1, 1, 0);
+
+        boot_t& boot = sample.boot[m];
+        boot.low = quantile(draws[m], alpha);
+        boot.high = quantile(draws[m], 1 - alpha);
+        boot.bca_low = quantile(draws[m], ISNAN(plow) ? alpha : plow);
+        boot.bca_high = quantile(draws[m], ISNAN(phigh) ? 1 - alpha : phigh);
+        boot.valid = true;
+    }
+}
+
+// the samples are taken one at a time by the threads, each with its own
+// buffers of the resampled means.
+
+void bootstrap(int threads)
+{
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        std::vector<double> draws[2];
+        for (size_t s = next++; s < samples.size(); s = next++)
+            bootstrap_sample(samples[s], s, draws);
+    };
+
+    if (threads <= 1) worker();
+    else {
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) workers.push_back(std::thread(worker));
+        for (auto& w : workers) w.join();
+    }
+}
+
+static void write_number(FILE* out, double x, bool valid)
+{
+    if (valid) fprintf(out, "\t%.5f", x);
+    else fprintf(out, "\tNA");
+}
+
+// one row per sample and measure. the interval needs two replicates, and the
+// f test two photographs with more replicates than photographs.
+
+void write_samples(FILE* out)
+{
+    // the t quantiles, one per distinct degrees of freedom.
+
+    std::vector<double> dfs;
+    std::map<uint64_t, int> df_at;
+    for (auto& sample : samples) {
+        uint64_t n = sample.measures[0].n;
+        if (n >= 2 && df_at.count(n - 1) == 0) {
+            df_at[n - 1] = dfs.size();
+            dfs.push_back(n - 1);
+        }
+    }
+
+    std::vector<double> quantiles;
+    t_quantiles(1 - (1 - level) / 2, dfs, quantiles);
+
+    // the f statistics of all the samples and measures, and their upper tail
+    // probabilities.
+
+    size_t tests = samples.size() * 8;
+    std::vector<double> fstat(tests, 0), df1(tests, 1), df2(tests, 1), pvalue(tests, 0);
+    std::vector<uchar> tested(tests, false);
+
+    for (size_t s = 0; s < samples.size(); s++) {
+        sample_t& sample = samples[s];
+        double groups = sample.files.size();
+        for (int m = 0; m < 8; m++) {
+            welford_t& all = sample.measures[m];
+            double between = 0, within = 0;
+            for (auto& file : sample.files) {
+                welford_t& g = file.second[m];
+                between += g.n * (g.mean - all.mean) * (g.mean - all.mean);
+                within += g.m2;
+            }
+
+            size_t t = s * 8 + m;
+            if (groups >= 2 && all.n > groups && within > 0) {
+                tested[t] = true;
+                df1[t] = groups - 1;
+                df2[t] = all.n - groups;
+                fstat[t] = (between / df1[t]) / (within / df2[t]);
+            }
+        }
+    }
+
+    pf_v(fstat.data(), df1.data(), df2.data(), pvalue.data(), tests, 0, 0);
+
+    fprintf(out, "sample\tmeasure\tn\tphotos\tmean\tsd\tci.low\tci.high\tf\tdf1\tdf2\tp.f"
+                 "\tboot.low\tboot.high\tbca.low\tbca.high\n");
+    for (size_t s = 0; s < samples.size(); s++) {
+        sample_t& sample = samples[s];
+        for (int m = 0; m < 8; m++) {
+            welford_t& all = sample.measures[m];
+            bool spread = all.n >= 2;
+            double sd = spread ? sqrt(all.m2 / (all.n - 1)) : 0;
+            double half = spread ? quantiles[df_at[all.n - 1]] * sd / sqrt((double) all.n) : 0;
+            size_t t = s * 8 + m;
+
+            fprintf(out, "%s\t%s\t%llu\t%zu\t%.5f", sample.name.c_str(), measure_names[m],
+                    (unsigned long long) all.n, sample.files.size(), all.mean);
+            write_number(out, sd, spread);
+            write_number(out, all.mean - half, spread);
+            write_number(out, all.mean + half, spread);
+            write_number(out, fstat[t], tested[t]);
+            if (tested[t]) fprintf(out, "\t%.0f\t%.0f", df1[t], df2[t]);
+            else fprintf(out, "\tNA\tNA");
+            if (tested[t]) fprintf(out, "\t%.4g", pvalue[t]);
+            else fprintf(out, "\tNA");
+
+            bool booted = m < 2 && sample.boot[m].valid;
+            write_number(out, booted ? sample.boot[m].low : 0, booted);
+            write_number(out, booted ? sample.boot[m].high : 0, booted);
+            write_number(out, booted ? sample.boot[m].bca_low : 0, booted);
+            write_number(out, booted ? sample.boot[m].bca_high : 0, booted);
+            fprintf(out, "\n");
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+#ifdef unix
+    argp_parse(&argp, argc, argv, 0, 0, NULL);
+#else
+
+    argparse::ArgumentParser program("blobstat", "1.5");
+
+    program.add_argument("-b", "--binary")
+        .help("read the binary columnar results.bin instead of stats.tsv")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-l", "--level")
+        .help("the confidence level of the intervals (0.95)")
+        .metavar("LEVEL")
+        .default_value(level)
+        .scan<'f', double>();
+
+    program.add_argument("-o", "--output")
+        .help("write the table to FILE (SOURCE/samples.tsv)")
+        .metavar("FILE")
+        .default_value(std::string(""));
+
+    program.add_argument("-r", "--resamples")
+        .help("bootstrap the means of log.abs and log.delta of each sample with N resamples " soft_br
+              "of its replicates (0, no bootstrap)")
+        .metavar("N")
+        .default_value(resamples)
+        .scan<'i', int>();
+
+    program.add_argument("-j", "--jobs")
+        .help("bootstrap the samples on N threads (1)")
+        .metavar("N")
+        .default_value(jobs)
+        .scan<'i', int>();
+
+    program.add_argument("-e", "--seed")
+        .help("seed of the resamples (42). the intervals depend only on the seed and the " soft_br
+              "input, not on the threads")
+        .metavar("SEED")
+        .default_value((unsigned long long) 42)
+        .scan<'u', unsigned long long>();
+
+    program.add_argument("source")
+        .help("the output directory of blobshed, blobnn or a segmenter of blobseg")
+        .metavar("SOURCE");
+
+    program.add_description(doc);
+
+    try { program.parse_args(argc, argv); }
+    catch (const std::exception& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    binary = program.get<bool>("--binary");
+    level = program.get<double>("--level");
+    resamples = program.get<int>("--resamples");
+    jobs = program.get<int>("--jobs");
+    seed = program.get<unsigned long long>("--seed");
+    strcpy(outpath, program.get("--output").c_str());
+    strcpy(datapath, program.get("source").c_str());
+
+#endif
+
+    if (!(level > 0 && level < 1)) {
+        printf("[e] the confidence level should be within (0, 1). \n");
+        return 1;
+    }
+
+    if (outpath[0] == 0) {
+        strcpy(outpath, datapath);
+        strcat(outpath, "/samples.tsv");
+    }
+
+    auto start = chrono::steady_clock::now();
+    std::string source = std::string(datapath) + (binary ? "/results.bin" : "/stats.tsv");
+    long rows = binary ? read_binary(source.c_str()) : read_stats(source.c_str());
+    if (rows < 0) {
+        printf("[e] cannot read %s. \n", source.c_str());
+        return 1;
+    }
+
+    if (resamples > 0) {
+        auto booting = chrono::steady_clock::now();
+        bootstrap(jobs);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - booting).count();
+        printf("[i] bootstrapped %zu samples with %d resamples in %.2f s. \n",
+               samples.size(), resamples, seconds);
+    }
+
+    FILE* out = fopen(outpath, "w");
+    if (out == NULL) {
+        printf("[e] cannot open the output file %s! \n", outpath);
+        return 1;
+    }
+
+    write_samples(out);
+    fclose(out);
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("[i] %ld rows of %zu samples on %zu photographs in %.2f s. \n",
+           rows, samples.size(), file_index.size(), seconds);
+    return 0;
+}
@@ -0,0 +1,63 @@
+//    Copyright (C) 2024 Zheng Yang <xornent@outlook.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "blob.h"
+
+#include <array>
+
+// the online mean and variance of one measure.
+
+typedef struct welford {
+    uint64_t n;
+    double mean;
+    double m2;
+} welford_t;
+
+// the bootstrap intervals of the mean of a measure, by the percentiles and by
+// the bias-corrected and accelerated (bca) percentiles of the resampled means.
+
+typedef struct boot {
+    double low;
+    double high;
+    double bca_low;
+    double bca_high;
+    bool valid;
+} boot_t;
+
+// the accumulators of a sample: the eight logarithms of stats.tsv over all
+// its replicates, and over its replicates on each photograph (by the index
+// of the file name), for the f test across the photographs.
+
+typedef struct sample {
+    std::string name;
+    welford_t measures[8];
+    std::map<int, std::array<welford_t, 8>> files;
+
+    // with the bootstrap, the values of log.abs and log.delta of every replicate,
+    // and their intervals.
+
+    std::vector<double> replicates[2];
+    boot_t boot[2];
+} sample_t;
+
+void welford_add(welford_t& acc, double x);
+void sample_add(const char* fname, const char* name, const double* values);
+long read_stats(const char* fname);
+long read_binary(const char* fname);
+void t_quantiles(double p, std::vector<double>& df, std::vector<double>& out);
+void bootstrap_sample(sample_t& sample, uint64_t index, std::vector<double>* draws);
+void bootstrap(int threads);
+void write_samples(FILE* out);
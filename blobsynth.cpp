@@ -0,0 +1,763 @@
+//    Copyright (C) 2024 Zheng Yang <xornent@outlook.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "blobsynth.h"
+
+#include <iostream>
+#include <filesystem>
+#include <chrono>
+#include <algorithm>
+
+#ifdef unix
+#include <argp.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#else
+#include "argparse/argparse.hpp"
+#endif
+
+namespace fs = std::filesystem;
+namespace chrono = std::chrono;
+
+#include <opencv2/opencv.hpp>
+
+// ============================================================================
+
+int count = 10;
+double megapixels = 12;
+int papers = 8;
+uint64_t seed = 42;
+char corpus[1024] = "";
+char work[1024] = "";
+char bindir[1024] = ".";
+char modelfpath[1024] = "";
+char refdir[1024] = "";
+
+// the layout of a test paper, in units. the two positioning triangles sit at
+// the left corners of the card with their right angles 156 units apart, the
+// scale card with its dark circle lies between them, and the strip carrying
+// the blob extends to the right, where blobroi searches its borders at the
+// proximal (270) and distal (300) positions and extracts 350 units of it.
+
+#define card_left -12.0
+#define card_right 240.0
+#define card_half 92.0
+#define strip_right 700.0
+#define triangle_vertex 78.0
+#define triangle_leg 26.0
+#define circle_x 85.0
+#define circle_radius 40.0
+#define blob_x 445.0
+
+// the papers are laid in two columns of cells.
+
+#define cell_width 820.0
+#define cell_height 270.0
+
+// ============================================================================
+
+// argument parser
+
+static char doc[] =
+    "blobsynth: render synthetic photographs of test papers with their ground truth, " soft_br
+    "and benchmark blobroi and blobshed (or blobnn) end to end on them. \n\n"
+    "this software is a free software licensed under gnu gplv3. it comes with absolutely " soft_br
+    "no warranty. for details, see <https://www.gnu.org/licenses/gpl-3.0.html>";
+
+static char args_doc[] =
+    "[-n COUNT] [-m MP] [-p PAPERS] [-e SEED] -o CORPUS\n"
+    "[-d BIN] [-t PT] [-r REFBIN] -o CORPUS --bench WORK";
+
+#ifdef unix
+static struct argp_option options[] = {
+    { "count", 'n', "COUNT", 0, "number of photographs to render (10)"},
+    { "megapixels", 'm', "MP", 0, "size of the photographs in megapixels, in 4:3 (12)"},
+    { "papers", 'p', "PAPERS", 0, "number of test papers in each photograph, 1 to 16 (8)"},
+    { "seed", 'e', "SEED", 0, "seed of the papers and the capture conditions (42)"},
+    { "output", 'o', "CORPUS", 0, "the corpus directory. the photographs are written to "
+      "CORPUS/photos, and the ground truth to CORPUS/truth.tsv"},
+    { "bench", 'b', "WORK", 0, "run blobroi and blobshed (or blobnn with --model) on the "
+      "photographs of CORPUS with WORK as their output directory, and compare the "
+      "measurements with the ground truth"},
+    { "model", 't', "PT", 0, "benchmark blobnn with the torch script model PT instead of blobshed"},
+    { "bin", 'd', "BIN", 0, "the directory of the blobroi, blobshed and blobnn executables (.)"},
+    { "reference", 'r', "REFBIN", 0, "also run the executables of a reference build in REFBIN "
+      "into WORK/reference, and check the outputs against them with blobdiff"},
+    { 0 }
+};
+
+const char *argp_program_version = "spblob:blobsynth 1.5";
+const char *argp_program_bug_address = "yang-z. <xornent@outlook.com>";
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    switch (key) {
+        case 'n': count = atoi(arg); break;
+        case 'm': megapixels = atof(arg); break;
+        case 'p': papers = atoi(arg); break;
+        case 'e': seed = strtoull(arg, NULL, 10); break;
+        case 'o': strcpy(corpus, arg); break;
+        case 'b': strcpy(work, arg); break;
+        case 't': strcpy(modelfpath, arg); break;
+        case 'd': strcpy(bindir, arg); break;
+        case 'r': strcpy(refdir, arg); break;
+        case ARGP_KEY_ARG: argp_usage(state); break;
+        case ARGP_KEY_END:
+            if (corpus[0] == 0) argp_usage(state);
+            break;
+        default: return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+#endif
+
+// ============================================================================
+
+// the placement of a paper in the photograph before the perspective: the
+// units are scaled by k, rotated, and moved to the paper's origin.
+
+typedef struct placement {
+    cv::Point2d origin;
+    double k;
+    double cos;
+    double sin;
+} placement_t;
+
+static cv::Point place(placement_t& pl, double x, double y)
+{
+    return cv::Point(
+        (int) lround(pl.origin.x + pl.k * (pl.cos * x - pl.sin * y)),
+        (int) lround(pl.origin.y + pl.k * (pl.sin * x + pl.cos * y))
+    );
+}
+
+static void fill_rect(
+    cv::Mat& photo, placement_t& pl,
+    double left, double top, double right, double bottom, cv::Scalar color)
+{
+    std::vector<cv::Point> corners = {
+        place(pl, left, top), place(pl, right, top),
+        place(pl, right, bottom), place(pl, left, bottom)
+    };
+
+    cv::fillConvexPoly(photo, corners, color, cv::LINE_AA);
+}
+
+// a slightly warm tint of a gray level, keeping its luminance.
+
+static cv::Scalar tint(int gray)
+{
+    return cv::Scalar(gray - 6, gray - 1, gray + 2);
+}
+
+void render_photo(
+    cv::Mat& photo, int width, int height, int papers, capture_t& cond,
+    cv::RNG& rng, std::vector<truth_t>& truths)
+{
+    int cols = papers > 1 ? 2 : 1;
+    int rows = (papers + cols - 1) / cols;
+    double k = 0.94 * std::min(width / (cols * cell_width), height / (rows * cell_height));
+    double theta = cond.rotation * CV_PI / 180.0;
+    cv::Point2d center(width / 2.0, height / 2.0);
+
+    // the desk, darker than the papers, with a low-frequency texture.
+
+    photo = cv::Mat(cv::Size(width, height), CV_8UC3, cv::Scalar(58, 64, 72));
+    cv::Mat texture(cv::Size(16, 12), CV_8UC3);
+    rng.fill(texture, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(30));
+    cv::resize(texture, texture, photo.size(), 0, 0, cv::INTER_CUBIC);
+    cv::add(photo, texture, photo);
+    texture.release();
+
+    truths.clear();
+    for (int p = 0; p < papers; p++) {
+        double u = ((p % cols) + 0.5 - cols / 2.0) * cell_width - (card_left + strip_right) / 2;
+        double v = ((p / cols) + 0.5 - rows / 2.0) * cell_height;
+
+        placement_t pl;
+        pl.k = k;
+        pl.cos = cos(theta);
+        pl.sin = sin(theta);
+        pl.origin = cv::Point2d(
+            center.x + k * (pl.cos * u - pl.sin * v),
+            center.y + k * (pl.sin * u + pl.cos * v)
+        );
+
+        truth_t t;
+        t.paper = p + 1;
+        t.origin_x = pl.origin.x;
+        t.origin_y = pl.origin.y;
+        t.unit = k;
+        t.paper_gray = rng.uniform(195, 231);
+        t.circle_gray = rng.uniform(50, 81);
+        t.contrast = rng.uniform(0.55, 0.92);
+        t.blob_gray = (int) lround(t.paper_gray * t.contrast);
+        t.contrast = t.blob_gray / (double) t.paper_gray;
+
+        double half = rng.uniform(36.0, 46.0);
+        double a = rng.uniform(10.0, std::min(32.0, half * 0.6));
+        double b = rng.uniform(8.0, std::min(28.0, half * 0.5));
+        double angle = rng.uniform(0.0, 180.0);
+        double bx = blob_x + rng.uniform(-20.0, 20.0);
+        double by = rng.uniform(-half / 6, half / 6);
+        t.blob_area = CV_PI * a * b;
+
+        // the card and the strip.
+
+        fill_rect(photo, pl, card_left, -card_half, card_right, card_half, tint(t.paper_gray));
+        fill_rect(photo, pl, card_right - 1, -half, strip_right, half, tint(t.paper_gray));
+
+        // the positioning triangles, with their right angles at the corners.
+
+        cv::Scalar red(rng.uniform(35, 56), rng.uniform(30, 51), rng.uniform(180, 216));
+        std::vector<cv::Point> upper = {
+            place(pl, 0, -triangle_vertex),
+            place(pl, triangle_leg, -triangle_vertex),
+            place(pl, 0, -triangle_vertex + triangle_leg)
+        };
+        std::vector<cv::Point> lower = {
+            place(pl, 0, triangle_vertex),
+            place(pl, triangle_leg, triangle_vertex),
+            place(pl, 0, triangle_vertex - triangle_leg)
+        };
+
+        cv::fillConvexPoly(photo, upper, red, cv::LINE_AA);
+        cv::fillConvexPoly(photo, lower, red, cv::LINE_AA);
+
+        // the dark circle of the scale card, and the blob.
+
+        cv::circle(
+            photo, place(pl, circle_x, 0), (int) lround(circle_radius * k),
+            tint(t.circle_gray), -1, cv::LINE_AA
+        );
+
+        cv::ellipse(
+            photo, place(pl, bx, by),
+            cv::Size((int) lround(a * k), (int) lround(b * k)),
+            angle + cond.rotation, 0, 360, tint(t.blob_gray), -1, cv::LINE_AA
+        );
+
+        truths.push_back(t);
+    }
+
+    if (cond.blur > 0)
+        cv::GaussianBlur(photo, photo, cv::Size(0, 0), cond.blur * k);
+
+    // the perspective of a hand-held camera. each corner of the photograph is
+    // displaced, and the origins of the papers move with them.
+
+    double shift = cond.perspective * std::min(width, height);
+    cv::Point2f src[4] = {
+        cv::Point2f(0, 0), cv::Point2f(width - 1, 0),
+        cv::Point2f(width - 1, height - 1), cv::Point2f(0, height - 1)
+    };
+
+    cv::Point2f dst[4];
+    for (int i = 0; i < 4; i++)
+        dst[i] = cv::Point2f(
+            src[i].x + rng.uniform(-shift, shift),
+            src[i].y + rng.uniform(-shift, shift)
+        );
+
+    cv::Mat homography = cv::getPerspectiveTransform(src, dst);
+    cv::Mat warped;
+    cv::warpPerspective(
+        photo, warped, homography, photo.size(),
+        cv::INTER_LINEAR, cv::BORDER_REPLICATE
+    );
+    photo = warped;
+
+    std::vector<cv::Point2f> origins, moved;
+    for (auto& t : truths) origins.push_back(cv::Point2f(t.origin_x, t.origin_y));
+    cv::perspectiveTransform(origins, moved, homography);
+    for (int i = 0; i < truths.size(); i++) {
+        truths[i].origin_x = moved[i].x;
+        truths[i].origin_y = moved[i].y;
+    }
+
+    // the uneven lighting, interpolated bilinearly over a coarse random grid,
+    // and the sensor noise.
+
+    const int gw = 5, gh = 4;
+    double grid[gh][gw];
+    for (int y = 0; y < gh; y++)
+        for (int x = 0; x < gw; x++)
+            grid[y][x] = 1.0 + cond.illumination * rng.uniform(-1.0, 1.0);
+
+    for (int r = 0; r < height; r++) {
+        double fy = r * (gh - 1.0) / std::max(1, height - 1);
+        int iy = std::min((int) fy, gh - 2);
+        double ty = fy - iy;
+        cv::Vec3b* row = photo.ptr<cv::Vec3b>(r);
+
+        for (int c = 0; c < width; c++) {
+            double fx = c * (gw - 1.0) / std::max(1, width - 1);
+            int ix = std::min((int) fx, gw - 2);
+            double tx = fx - ix;
+            double top = grid[iy][ix] + (grid[iy][ix + 1] - grid[iy][ix]) * tx;
+            double bottom = grid[iy + 1][ix] + (grid[iy + 1][ix + 1] - grid[iy + 1][ix]) * tx;
+            double light = top + (bottom - top) * ty;
+
+            for (int ch = 0; ch < 3; ch++)
+                row[c][ch] = cv::saturate_cast<uchar>(
+                    row[c][ch] * light + rng.gaussian(cond.noise)
+                );
+        }
+    }
+}
+
+// ============================================================================
+
+int generate(const char* corpus, int count, double megapixels, int papers, uint64_t seed)
+{
+    std::string photos = std::string(corpus) + "/photos";
+    fs::create_directories(photos);
+
+    std::string truthfname = std::string(corpus) + "/truth.tsv";
+    FILE* truthfile = fopen(truthfname.c_str(), "w");
+    if (truthfile == NULL) {
+        printf("[e] cannot write the ground truth to %s! \n", truthfname.c_str());
+        return 1;
+    }
+
+    fprintf(
+        truthfile,
+        "file\tpaper\torigin_x\torigin_y\tunit\tblob_area\tcontrast\tpaper_gray\t"
+        "blob_gray\tcircle_gray\trotation\tperspective\tblur\tnoise\tillumination\n"
+    );
+
+    int width = (int) lround(sqrt(megapixels * 1e6 * 4.0 / 3.0));
+    int height = (int) lround(width * 3.0 / 4.0);
+    cv::RNG rng(seed);
+
+    for (int i = 0; i < count; i++) {
+        capture_t cond;
+        cond.rotation = rng.uniform(-3.0, 3.0);
+        cond.perspective = rng.uniform(0.0, 0.02);
+        cond.blur = rng.uniform(0.3, 1.2);
+        cond.noise = rng.uniform(2.0, 8.0);
+        cond.illumination = rng.uniform(0.0, 0.2);
+
+        auto start = chrono::steady_clock::now();
+        cv::Mat photo;
+        std::vector<truth_t> truths;
+        render_photo(photo, width, height, papers, cond, rng, truths);
+
+        char fname[256];
+        sprintf(fname, "synth-%04d.jpg", i + 1);
+        std::string path = photos + "/" + fname;
+        cv::imwrite(path, photo, { cv::IMWRITE_JPEG_QUALITY, 92 });
+
+        for (auto& t : truths) {
+            strcpy(t.file, fname);
+            fprintf(
+                truthfile,
+                "%s\t%d\t%.1f\t%.1f\t%.4f\t%.1f\t%.4f\t%d\t%d\t%d\t%.2f\t%.4f\t%.3f\t%.2f\t%.3f\n",
+                t.file, t.paper, t.origin_x, t.origin_y, t.unit, t.blob_area, t.contrast,
+                t.paper_gray, t.blob_gray, t.circle_gray,
+                cond.rotation, cond.perspective, cond.blur, cond.noise, cond.illumination
+            );
+        }
+
+        double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        printf(
+            "[i] %s: %d x %d, %d papers, rotation %.1f, blur %.2f, noise %.1f, "
+            "lighting %.2f (%.2f s) \n",
+            fname, width, height, papers, cond.rotation, cond.blur, cond.noise,
+            cond.illumination, secs
+        );
+    }
+
+    fclose(truthfile);
+    return 0;
+}
+
+// ============================================================================
+
+// run one of the tools with its output to logfile. returns its exit status,
+// and sets its wall time in seconds and its peak resident memory in mb (-1
+// where it cannot be read).
+
+static int run_tool(
+    std::vector<std::string>& args, std::string logfile,
+    double& secs, double& peak_mb)
+{
+    auto start = chrono::steady_clock::now();
+    peak_mb = -1;
+    int ret = -1;
+
+#ifdef unix
+    pid_t pid = fork();
+    if (pid == 0) {
+        int log = open(logfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (log >= 0) {
+            dup2(log, STDOUT_FILENO);
+            dup2(log, STDERR_FILENO);
+            close(log);
+        }
+
+        std::vector<char*> argv;
+        for (auto& arg : args) argv.push_back((char*) arg.c_str());
+        argv.push_back(NULL);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+
+    if (pid > 0) {
+        int status = 0;
+        struct rusage usage;
+        if (wait4(pid, &status, 0, &usage) == pid) {
+            ret = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+            peak_mb = usage.ru_maxrss / 1024.0;
+        }
+    }
+#else
+    std::string command;
+    for (auto& arg : args) command += "\"" + arg + "\" ";
+    command += "> \"" + logfile + "\" 2>&1";
+    ret = system(command.c_str());
+#endif
+
+    secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return ret;
+}
+
+static double quantile(std::vector<double> values, double q)
+{
+    if (values.size() == 0) return NAN;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t) (q * values.size()))];
+}
+
+// read the rows of a tab-separated table. truth.tsv has a header line, the
+// outputs of the tools do not.
+
+static void read_rows(
+    const char* fname, bool header, std::vector<std::vector<std::string>>& rows)
+{
+    FILE* file = fopen(fname, "r");
+    if (file == NULL) return;
+
+    char line[4096];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (header) { header = false; continue; }
+        if (line[0] == '\0') continue;
+
+        std::vector<char*> cols;
+        split_columns(line, cols);
+        std::vector<std::string> row;
+        for (auto col : cols) row.push_back(col);
+        rows.push_back(row);
+    }
+
+    fclose(file);
+}
+
+// run blobroi and the segmenter of bindir on the photographs of the corpus,
+// with workdir as their output directory.
+
+static bool run_pipeline(
+    const char* corpus, std::string workdir, std::string bin, const char* model,
+    double& roisecs, double& roimb, double& segsecs, double& segmb)
+{
+    fs::create_directories(workdir);
+
+    // blobroi appends to rois.tsv, so a used directory would mix two runs.
+
+    if (fs::exists(workdir + "/rois.tsv")) {
+        printf("[e] %s already has a rois.tsv. benchmark into an empty directory. \n", workdir.c_str());
+        return false;
+    }
+
+    std::vector<std::string> roiargs = {
+        bin + "/blobroi", "-d", "-f", "-o", workdir, std::string(corpus) + "/photos"
+    };
+
+    std::vector<std::string> segargs = { bin + "/blobshed", workdir };
+    if (model[0] != 0) segargs = { bin + "/blobnn", "-t", model, workdir };
+    const char* segmenter = model[0] != 0 ? "blobnn" : "blobshed";
+
+    printf("[i] running %s/blobroi ... \n", bin.c_str());
+    if (run_tool(roiargs, workdir + "/blobroi.log", roisecs, roimb) != 0) {
+        printf("[e] blobroi failed, see %s/blobroi.log. \n", workdir.c_str());
+        return false;
+    }
+
+    printf("[i] running %s/%s ... \n", bin.c_str(), segmenter);
+    if (run_tool(segargs, workdir + "/" + segmenter + ".log", segsecs, segmb) != 0) {
+        printf("[e] %s failed, see %s/%s.log. \n", segmenter, workdir.c_str(), segmenter);
+        return false;
+    }
+
+    return true;
+}
+
+int bench(
+    const char* corpus, const char* work, const char* bindir,
+    const char* model, const char* refdir)
+{
+    std::vector<std::vector<std::string>> truthrows;
+    read_rows((std::string(corpus) + "/truth.tsv").c_str(), true, truthrows);
+    if (truthrows.size() == 0) {
+        printf("[e] no ground truth under %s. render the corpus first. \n", corpus);
+        return 1;
+    }
+
+    std::string workdir(work);
+    const char* segmenter = model[0] != 0 ? "blobnn" : "blobshed";
+
+    double roisecs, roimb, segsecs, segmb;
+    if (!run_pipeline(corpus, workdir, bindir, model, roisecs, roimb, segsecs, segmb))
+        return 1;
+
+    // match each paper of the ground truth to the roi of the same photograph
+    // whose origin is nearest, within a quarter of the triangle span.
+
+    std::vector<std::vector<std::string>> roirows, rawrows;
+    read_rows((workdir + "/rois.tsv").c_str(), false, roirows);
+    read_rows((workdir + "/raw.tsv").c_str(), false, rawrows);
+
+    std::map<int, std::vector<std::string>*> raw;
+    for (auto& row : rawrows) if (row.size() >= 11) raw[atoi(row[0].c_str())] = &row;
+
+    FILE* out = fopen((workdir + "/e2e.tsv").c_str(), "w");
+    if (out == NULL) {
+        printf("[e] cannot write e2e.tsv to %s! \n", work);
+        return 1;
+    }
+
+    fprintf(
+        out, "file\tpaper\tuid\tfound\tsegmented\tblob_area\tmeasured_area\t"
+        "contrast\tmeasured_contrast\n"
+    );
+
+    std::set<std::string> photos;
+    std::vector<double> area_errors, contrast_errors;
+    int found = 0, segmented = 0;
+
+    for (auto& t : truthrows) {
+        if (t.size() < 7) continue;
+        photos.insert(t[0]);
+        double ox = atof(t[2].c_str()), oy = atof(t[3].c_str());
+        double unit = atof(t[4].c_str());
+        double area = atof(t[5].c_str());
+        double contrast = atof(t[6].c_str());
+
+        int uid = -1;
+        double nearest = triangle_vertex * 0.5 * unit;
+        for (auto& row : roirows) {
+            if (row.size() < 11) continue;
+            if (fs::path(row[1]).filename().string() != t[0]) continue;
+            double d = distance(
+                cv::Point2d(ox, oy),
+                cv::Point2d(atof(row[9].c_str()), atof(row[10].c_str()))
+            );
+
+            if (d < nearest) {
+                nearest = d;
+                uid = atoi(row[0].c_str());
+            }
+        }
+
+        double marea = -1, mcontrast = -1;
+        bool seg = false;
+        if (uid >= 0 && raw.count(uid) > 0) {
+            std::vector<std::string>& r = *raw[uid];
+            double fm = atof(r[7].c_str());
+            double fsz = atof(r[8].c_str());
+            double bs = atof(r[9].c_str());
+            seg = r[6] == "x" && fsz > 0 && bs > 0;
+
+            if (seg) {
+                marea = fsz;
+                mcontrast = fm / bs;
+                area_errors.push_back(fabs(marea - area) / area);
+                contrast_errors.push_back(fabs(mcontrast - contrast));
+            }
+        }
+
+        if (uid >= 0) found += 1;
+        if (seg) segmented += 1;
+
+        fprintf(
+            out, "%s\t%s\t%d\t%s\t%s\t%.1f\t%.1f\t%.4f\t%.4f\n",
+            t[0].c_str(), t[1].c_str(), uid, uid >= 0 ? "x" : ".", seg ? "x" : ".",
+            area, marea, contrast, mcontrast
+        );
+    }
+
+    fclose(out);
+
+    int total = truthrows.size();
+    printf(
+        "[i] %zu photographs, %d papers, %d rois found (%.1f%%), %d blobs segmented (%.1f%%). \n",
+        photos.size(), total, found, 100.0 * found / total,
+        segmented, 100.0 * segmented / total
+    );
+
+    printf(
+        "[i] %-10s %8.2f s %8.3f photos/s   peak rss %8.1f mb \n",
+        "blobroi", roisecs, photos.size() / roisecs, roimb
+    );
+
+    printf(
+        "[i] %-10s %8.2f s %8.3f rois/s     peak rss %8.1f mb \n",
+        segmenter, segsecs, roirows.size() / segsecs, segmb
+    );
+
+    printf(
+        "[i] %-10s %8.2f s %8.3f photos/s \n",
+        "end to end", roisecs + segsecs, photos.size() / (roisecs + segsecs)
+    );
+
+    if (area_errors.size() > 0)
+        printf(
+            "[i] blob size error: median %.1f%%, p90 %.1f%%. "
+            "contrast error: median %.3f, p90 %.3f. \n",
+            100 * quantile(area_errors, 0.5), 100 * quantile(area_errors, 0.9),
+            quantile(contrast_errors, 0.5), quantile(contrast_errors, 0.9)
+        );
+
+    if (refdir[0] == 0) return 0;
+
+    // with a reference build, run it on the same corpus into WORK/reference,
+    // and check the outputs of this build against it with blobdiff.
+
+    double refroisecs, refroimb, refsegsecs, refsegmb;
+    std::string reference = workdir + "/reference";
+    if (!run_pipeline(
+            corpus, reference, refdir, model,
+            refroisecs, refroimb, refsegsecs, refsegmb))
+        return 1;
+
+    printf(
+        "[i] %-10s %8.2f s %8.3f photos/s (reference %.2f s, %.2fx) \n",
+        "end to end", roisecs + segsecs, photos.size() / (roisecs + segsecs),
+        refroisecs + refsegsecs, (refroisecs + refsegsecs) / (roisecs + segsecs)
+    );
+
+    std::vector<std::string> diffargs = {
+        std::string(bindir) + "/blobdiff", "-o", workdir + "/diff.tsv", reference, workdir
+    };
+
+    double diffsecs, diffmb;
+    int diff = run_tool(diffargs, workdir + "/blobdiff.log", diffsecs, diffmb);
+
+    FILE* log = fopen((workdir + "/blobdiff.log").c_str(), "r");
+    if (log != NULL) {
+        char line[1024];
+        while (fgets(line, sizeof(line), log) != NULL) printf("%s", line);
+        fclose(log);
+    }
+
+    return diff == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+#ifdef unix
+    argp_parse(&argp, argc, argv, 0, 0, NULL);
+#else
+
+    argparse::ArgumentParser program("blobsynth", "1.5");
+
+    program.add_argument("-n", "--count")
+        .help("number of photographs to render (10)")
+        .metavar("COUNT")
+        .default_value(count)
+        .scan<'i', int>();
+
+    program.add_argument("-m", "--megapixels")
+        .help("size of the photographs in megapixels, in 4:3 (12)")
+        .metavar("MP")
+        .default_value(megapixels)
+        .scan<'f', double>();
+
+    program.add_argument("-p", "--papers")
+        .help("number of test papers in each photograph, 1 to 16 (8)")
+        .metavar("PAPERS")
+        .default_value(papers)
+        .scan<'i', int>();
+
+    program.add_argument("-e", "--seed")
+        .help("seed of the papers and the capture conditions (42)")
+        .metavar("SEED")
+        .default_value((unsigned long long) 42)
+        .scan<'u', unsigned long long>();
+
+    program.add_argument("-o", "--output")
+        .help("the corpus directory. the photographs are written to CORPUS/photos, " soft_br
+              "and the ground truth to CORPUS/truth.tsv")
+        .metavar("CORPUS")
+        .required();
+
+    program.add_argument("-b", "--bench")
+        .help("run blobroi and blobshed (or blobnn with --model) on the photographs " soft_br
+              "of CORPUS with WORK as their output directory, and compare the " soft_br
+              "measurements with the ground truth")
+        .metavar("WORK")
+        .default_value(std::string(""));
+
+    program.add_argument("-t", "--model")
+        .help("benchmark blobnn with the torch script model PT instead of blobshed")
+        .metavar("PT")
+        .default_value(std::string(""));
+
+    program.add_argument("-d", "--bin")
+        .help("the directory of the blobroi, blobshed and blobnn executables (.)")
+        .metavar("BIN")
+        .default_value(std::string("."));
+
+    program.add_argument("-r", "--reference")
+        .help("also run the executables of a reference build in REFBIN into " soft_br
+              "WORK/reference, and check the outputs against them with blobdiff")
+        .metavar("REFBIN")
+        .default_value(std::string(""));
+
+    program.add_description(doc);
+
+    try { program.parse_args(argc, argv); }
+    catch (const std::exception& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    count = program.get<int>("--count");
+    megapixels = program.get<double>("--megapixels");
+    papers = program.get<int>("--papers");
+    seed = program.get<unsigned long long>("--seed");
+    strcpy(corpus, program.get("--output").c_str());
+    strcpy(work, program.get("--bench").c_str());
+    strcpy(modelfpath, program.get("--model").c_str());
+    strcpy(bindir, program.get("--bin").c_str());
+    strcpy(refdir, program.get("--reference").c_str());
+
+#endif
+
+    if (work[0] != 0) return bench(corpus, work, bindir, modelfpath, refdir);
+
+    if (megapixels < 1 || megapixels > 64 || papers < 1 || papers > 16 || count < 1) {
+        printf("[e] expect 1 to 64 megapixels, 1 to 16 papers and at least 1 photograph. \n");
+        return 1;
+    }
+
+    return generate(corpus, count, megapixels, papers, seed);
+}
@@ -0,0 +1,56 @@
+//    Copyright (C) 2024 Zheng Yang <xornent@outlook.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "blob.h"
+
+// the ground truth of one test paper in a synthetic photograph. the papers
+// are drawn in units of the extracted roi pixels under the default blobroi
+// settings (the two positioning triangles 156 units apart). the origin is the
+// midpoint of the right-angle vertices of the two triangles, in photograph
+// pixels, as blobroi reports it in rois.tsv.
+
+typedef struct truth {
+    char file[256];
+    int paper;
+    double origin_x;
+    double origin_y;
+    double unit;            // photograph pixels per unit.
+    double blob_area;       // in square units, that is, roi pixels.
+    double contrast;        // the blob over the paper grayscale.
+    int paper_gray;
+    int blob_gray;
+    int circle_gray;
+} truth_t;
+
+// the capture conditions of one photograph.
+
+typedef struct capture {
+    double rotation;        // degrees.
+    double perspective;     // the corner displacement, a fraction of the short side.
+    double blur;            // the gaussian sigma, in units.
+    double noise;           // the gaussian sigma, in gray levels.
+    double illumination;    // the relative amplitude of the uneven lighting.
+} capture_t;
+
+void render_photo(
+    cv::Mat& photo, int width, int height, int papers, capture_t& cond,
+    cv::RNG& rng, std::vector<truth_t>& truths
+);
+
+int generate(const char* corpus, int count, double megapixels, int papers, uint64_t seed);
+int bench(
+    const char* corpus, const char* work, const char* bindir,
+    const char* model, const char* refdir
+);
@@ -0,0 +1,153 @@
+//    Copyright (C) 2024 Zheng Yang <xornent@outlook.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "blobtsv.h"
+
+#include <iostream>
+#include <filesystem>
+
+#ifdef unix
+#include <argp.h>
+#else
+#include "argparse/argparse.hpp"
+#endif
+
+namespace fs = std::filesystem;
+
+// ============================================================================
+
+char source[1024] = "";
+char outdir[1024] = "";
+
+// ============================================================================
+
+// argument parser
+
+static char doc[] =
+    "blobtsv: convert the binary columnar results (results.bin) of blobshed, blobnn or " soft_br
+    "blobseg --binary in SOURCE to raw.tsv and stats.tsv. \n\n"
+    "this software is a free software licensed under gnu gplv3. it comes with absolutely " soft_br
+    "no warranty. for details, see <https://www.gnu.org/licenses/gpl-3.0.html>";
+
+static char args_doc[] =
+    "[-o DIR] SOURCE";
+
+#ifdef unix
+static struct argp_option options[] = {
+    { "output", 'o', "DIR", 0, "write raw.tsv and stats.tsv to DIR (SOURCE)"},
+    { 0 }
+};
+
+const char *argp_program_version = "spblob:blobtsv 1.5";
+const char *argp_program_bug_address = "yang-z. <xornent@outlook.com>";
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    switch (key) {
+        case 'o': strcpy(outdir, arg); break;
+        case ARGP_KEY_ARG:
+            if (state -> arg_num == 0) strcpy(source, arg);
+            else argp_usage(state);
+            break;
+        case ARGP_KEY_END:
+            if (state -> arg_num != 1) argp_usage(state);
+            break;
+        default: return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+#endif
+
+// ============================================================================
+
+// write the rows of results.bin under source, in uid order, as the lines of
+// raw.tsv and stats.tsv under target. returns the number of rows, or -1.
+
+int convert(const char* source, const char* target)
+{
+    std::string binfpath = std::string(source) + "/results.bin";
+    columns_t cols;
+    if (!columns_open(cols, binfpath.c_str(), false)) {
+        printf("[e] no valid results.bin under %s. \n", source);
+        return -1;
+    }
+
+    std::vector<result_row_t> rows;
+    columns_rows(cols, rows);
+
+    std::string rawfpath = std::string(target) + "/raw.tsv";
+    std::string statfpath = std::string(target) + "/stats.tsv";
+    FILE* rawfile = fopen(rawfpath.c_str(), "w");
+    FILE* statfile = fopen(statfpath.c_str(), "w");
+    if (rawfile == NULL || statfile == NULL) {
+        printf("[e] cannot write the tables under %s. \n", target);
+        if (rawfile != NULL) fclose(rawfile);
+        if (statfile != NULL) fclose(statfile);
+        columns_close(cols);
+        return -1;
+    }
+
+    int stats = 0;
+    for (auto& row : rows) {
+        write_raw_row(rawfile, row);
+        if (write_stat_row(statfile, row)) stats += 1;
+    }
+
+    fclose(rawfile);
+    fclose(statfile);
+    columns_close(cols);
+
+    printf("[i] %zu rows written to raw.tsv, %d to stats.tsv. \n", rows.size(), stats);
+    return rows.size();
+}
+
+int main(int argc, char* argv[])
+{
+#ifdef unix
+    argp_parse(&argp, argc, argv, 0, 0, NULL);
+#else
+
+    argparse::ArgumentParser program("blobtsv", "1.5");
+
+    program.add_argument("-o", "--output")
+        .help("write raw.tsv and stats.tsv to DIR (SOURCE)")
+        .metavar("DIR")
+        .default_value(std::string(""));
+
+    program.add_argument("source")
+        .help("the output directory with results.bin")
+        .metavar("SOURCE");
+
+    program.add_description(doc);
+
+    try { program.parse_args(argc, argv); }
+    catch (const std::exception& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    strcpy(outdir, program.get("--output").c_str());
+    strcpy(source, program.get("source").c_str());
+
+#endif
+
+    if (outdir[0] == 0) strcpy(outdir, source);
+    if (!fs::is_directory(outdir)) fs::create_directories(outdir);
+
+    return convert(source, outdir) < 0 ? 1 : 0;
+}
@@ -0,0 +1,136 @@
+
+// the benchmark of the array entry points against the scalar functions in a
+// loop. for each distribution, prints the nanoseconds per value of the scalar
+// loop, of the array entry point on one thread and on all the threads, and the
+// largest difference from the scalar results.
+//
+//     distbench [N] [THREADS]
+//
+// with N values (1000000) and THREADS threads (0, the online processors).
+
+#include "distrib.h"
+
+#include <string.h>
+#include <time.h>
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// a deterministic uniform variate in [0, 1), so that the runs are comparable.
+
+static unsigned long long bench_state = 88172645463325252ULL;
+
+static double uniform()
+{
+    bench_state ^= bench_state << 13;
+    bench_state ^= bench_state >> 7;
+    bench_state ^= bench_state << 17;
+    return (bench_state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double max_diff(const double *a, const double *b, size_t n)
+{
+    double worst = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (a[i] == b[i] || (ISNAN(a[i]) && ISNAN(b[i])))
+            continue;
+        double d = fabs(a[i] - b[i]);
+        if (!(d <= worst))
+            worst = d;
+    }
+
+    return worst;
+}
+
+static void report(const char *name, size_t n, double scalar, double single, double multi,
+                   const double *ref, const double *out)
+{
+    printf("%-22s %8.1f %8.1f %8.1f %8.2fx %10.3g\n", name,
+           scalar * 1e9 / n, single * 1e9 / n, multi * 1e9 / n,
+           scalar / multi, max_diff(ref, out, n));
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = argc > 1 ? (size_t)atol(argv[1]) : 1000000;
+    int threads = argc > 2 ? atoi(argv[2]) : 0;
+
+    double *x = (double *)malloc(sizeof(double) * n);
+    double *u = (double *)malloc(sizeof(double) * n);
+    double *df = (double *)malloc(sizeof(double) * n);
+    double *df2 = (double *)malloc(sizeof(double) * n);
+    double *ref = (double *)malloc(sizeof(double) * n);
+    double *out = (double *)malloc(sizeof(double) * n);
+
+    // the values span the central and the outer regions of pnorm, the
+    // statistics of small and large samples, and the unit interval.
+
+    for (size_t i = 0; i < n; i++)
+    {
+        x[i] = (uniform() - 0.5) * 16;
+        u[i] = uniform();
+        df[i] = 1 + (int)(uniform() * 60);
+        df2[i] = 2 + (int)(uniform() * 200);
+    }
+
+    printf("[i] %zu values. \n", n);
+    printf("%-22s %8s %8s %8s %9s %10s\n",
+           "function", "scalar", "single", "threads", "speedup", "max.diff");
+
+    double t0, scalar, single, multi;
+
+#define bench(NAME, SCALAR, VECTOR)              \
+    t0 = now();                                  \
+    for (size_t i = 0; i < n; i++)               \
+        ref[i] = SCALAR;                         \
+    scalar = now() - t0;                         \
+    distrib_threads(1);                          \
+    t0 = now();                                  \
+    VECTOR;                                      \
+    single = now() - t0;                         \
+    distrib_threads(threads);                    \
+    t0 = now();                                  \
+    VECTOR;                                      \
+    multi = now() - t0;                          \
+    report(NAME, n, scalar, single, multi, ref, out);
+
+    bench("pnorm5", pnorm5(x[i], 0, 1, 1, 0),
+          pnorm5_v(x, out, n, 0, 1, 1, 0));
+    bench("pnorm5 upper log", pnorm5(x[i], 0.5, 2, 0, 1),
+          pnorm5_v(x, out, n, 0.5, 2, 0, 1));
+    bench("pt", pt(x[i], df[i], 1, 0),
+          pt_v(x, df, out, n, 1, 0));
+    bench("pt upper log", pt(x[i], df[i], 0, 1),
+          pt_v(x, df, out, n, 0, 1));
+    bench("pbeta (2.5, 4)", pbeta(u[i], 2.5, 4, 1, 0),
+          pbeta_v(u, out, n, 2.5, 4, 1, 0));
+    bench("pbeta (1, 30) upper", pbeta(u[i], 1, 30, 0, 0),
+          pbeta_v(u, out, n, 1, 30, 0, 0));
+
+    // the inner region of pnorm alone, which its kernel finishes in place.
+
+    for (size_t i = 0; i < n; i++)
+        u[i] = x[i] / 12;
+    bench("pnorm5 inner", pnorm5(u[i], 0, 1, 1, 0),
+          pnorm5_v(u, out, n, 0, 1, 1, 0));
+
+    // the f statistics are positive.
+
+    for (size_t i = 0; i < n; i++)
+        u[i] = fabs(x[i]);
+    bench("pf", pf(u[i], df[i], df2[i], 0, 0),
+          pf_v(u, df, df2, out, n, 0, 0));
+
+    free(x);
+    free(u);
+    free(df);
+    free(df2);
+    free(ref);
+    free(out);
+    return 0;
+}
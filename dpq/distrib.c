@@ -1695,6 +1695,278 @@ void pnorm_both(double x, double *cum, double *ccum, int i_tail, int log_p)
     return;
 }
 
+// the quantile function of the normal distribution, by the algorithm as241 of
+// wichura (1988), accurate to about 1 part in 10^16.
+
+double qnorm5(double p, double mu, double sigma, int lower_tail, int log_p)
+{
+    double p_, q, r, val;
+
+#ifdef IEEE_754
+    if (ISNAN(p) || ISNAN(mu) || ISNAN(sigma))
+        return p + mu + sigma;
+#endif
+
+    R_Q_P01_boundaries(p, ML_NEGINF, ML_POSINF);
+
+    if (sigma < 0)
+        ML_ERR_return_NAN;
+    if (sigma == 0)
+        return mu;
+
+    p_ = R_DT_qIv(p); // real lower_tail prob. p
+    q = p_ - 0.5;
+
+    // 0.075 <= p <= 0.925
+
+    if (fabs(q) <= .425)
+    {
+        r = .180625 - q * q;
+        val =
+            q * (((((((r * 2509.0809287301226727 +
+                       33430.575583588128105) * r + 67265.770927008700853) * r +
+                     45921.953931549871457) * r + 13731.693765509461125) * r +
+                   1971.5909503065514427) * r + 133.14166789178437745) * r +
+                 3.387132872796366608)
+            / (((((((r * 5226.495278852545925 +
+                     28729.085735721942674) * r + 39307.89580009271061) * r +
+                   21213.794301586595867) * r + 5394.1960214247511077) * r +
+                 687.1870074920579083) * r + 42.313330701600911252) * r + 1.);
+    }
+
+    // closer than 0.075 from {0,1} boundary. r = min(p, 1-p) < 0.075
+
+    else
+    {
+        if (q > 0)
+            r = R_DT_CIv(p); // 1-p
+        else
+            r = p_;
+
+        r = sqrt(-((log_p &&
+                    ((lower_tail && q <= 0) || (!lower_tail && q > 0)))
+                       ? p
+                       : log(r)));
+
+        // r = sqrt(-log(r))  <==>  min(p, 1-p) = exp( - r^2 )
+
+        if (r <= 5.) // <==> min(p,1-p) >= exp(-25) ~= 1.3888e-11
+        {
+            r += -1.6;
+            val = (((((((r * 7.7454501427834140764e-4 +
+                         .0227238449892691845833) * r + .24178072517745061177) *
+                       r + 1.27045825245236838258) * r +
+                      3.64784832476320460504) * r + 5.7694972214606914055) *
+                    r + 4.6303378461565452959) * r +
+                   1.42343711074968357734)
+                  / (((((((r *
+                           1.05075007164441684324e-9 + 5.475938084995344946e-4) *
+                          r + .0151986665636164571966) * r +
+                         .14810397642748007459) * r + .68976733498510000455) *
+                       r + 1.6763848301838038494) * r +
+                      2.05319162663775882187) * r + 1.);
+        }
+
+        // very close to  0 or 1
+
+        else
+        {
+            r += -5.;
+            val = (((((((r * 2.01033439929228813265e-7 +
+                         2.71155556874348757815e-5) * r +
+                        .0012426609473880784386) * r + .026532189526576123093) *
+                      r + .29656057182850489123) * r +
+                     1.7848265399172913358) * r + 5.4637849111641143699) *
+                   r + 6.6579046435011037772)
+                  / (((((((r *
+                           2.04426310338993978564e-15 + 1.4215117583164458887e-7) *
+                          r + 1.8463183175100546818e-5) * r +
+                         7.868691311456132591e-4) * r + .0148753612908506148525)
+                       * r + .13692988092273580531) * r +
+                      .59983220655588793769) * r + 1.);
+        }
+
+        if (q < 0.0)
+            val = -val;
+    }
+
+    return mu + sigma * val;
+}
+
+// the quantile function of the t distribution, by the algorithm of hill
+// (1970, 1981) with two-term taylor steps, and by bisection on pt for the
+// degrees of freedom below 1.
+
+double qt(double p, double ndf, int lower_tail, int log_p)
+{
+    const static double eps = 1.e-12;
+
+    double P, q;
+
+#ifdef IEEE_754
+    if (ISNAN(p) || ISNAN(ndf))
+        return p + ndf;
+#endif
+
+    R_Q_P01_boundaries(p, ML_NEGINF, ML_POSINF);
+
+    if (ndf <= 0)
+        ML_ERR_return_NAN;
+
+    if (ndf < 1)
+    {
+        const static double accu = 1e-13;
+        const static double Eps = 1e-11; // must be > accu
+
+        double ux, lx, nx, pp;
+        int iter = 0;
+
+        p = R_DT_qIv(p);
+
+        // invert pt(.): find an upper and a lower bound, and halve the
+        // interval (lx, ux). regula falsi failed on qt(0.1, 0.1).
+
+        if (p > 1 - DBL_EPSILON)
+            return ML_POSINF;
+        pp = fmin(1 - DBL_EPSILON, p * (1 + Eps));
+        for (ux = 1.; ux < DBL_MAX && pt(ux, ndf, 1, 0) < pp; ux *= 2)
+            ;
+        pp = p * (1 - Eps);
+        for (lx = -1.; lx > -DBL_MAX && pt(lx, ndf, 1, 0) > pp; lx *= 2)
+            ;
+
+        do
+        {
+            nx = 0.5 * (lx + ux);
+            if (pt(nx, ndf, 1, 0) > p)
+                ux = nx;
+            else
+                lx = nx;
+        } while ((ux - lx) / fabs(nx) > accu && ++iter < 1000);
+
+        if (iter >= 1000)
+            ML_ERROR(ME_PRECISION, "qt");
+
+        return 0.5 * (lx + ux);
+    }
+
+    if (ndf > 1e20)
+        return qnorm(p, 0., 1., lower_tail, log_p);
+
+    P = R_D_qIv(p); // if exp(p) underflows, we fix below
+
+    int neg = (!lower_tail || P < 0.5) && (lower_tail || P > 0.5),
+        is_neg_lower = (lower_tail == neg); // both true or false == !xor
+    if (neg)
+        P = 2 * (log_p ? (lower_tail ? P : -expm1(p)) : R_D_Lval(p));
+    else
+        P = 2 * (log_p ? (lower_tail ? -expm1(p) : P) : R_D_Cval(p));
+
+    // 0 <= P <= 1 ; P = 2*min(P', 1 - P')  in all cases
+
+    if (fabs(ndf - 2) < eps) // df ~= 2
+    {
+        if (P > DBL_MIN)
+        {
+            if (3 * P < DBL_EPSILON) // P ~= 0
+                q = 1 / sqrt(P);
+            else if (P > 0.9) // P ~= 1
+                q = (1 - P) * sqrt(2 / (P * (2 - P)));
+            else // eps/3 <= P <= 0.9
+                q = sqrt(2 / (P * (2 - P)) - 2);
+        }
+        else // P << 1, q = 1/sqrt(P) = ...
+        {
+            if (log_p)
+                q = is_neg_lower ? exp(-p / 2) / M_SQRT2 : 1 / sqrt(-expm1(p));
+            else
+                q = ML_POSINF;
+        }
+    }
+    else if (ndf < 1 + eps) // df ~= 1 (df < 1 excluded above): cauchy
+    {
+        if (P == 1.)
+            q = 0;
+        else if (P > 0)
+            q = 1 / tanpi(P / 2.); // == - tan((P+1) * M_PI_2), suffers for P ~= 0
+        else // P = 0, but maybe = 2*exp(p)
+        {
+            if (log_p) // 1/tan(e) ~ 1/e
+                q = is_neg_lower ? M_1_PI * exp(-p) : -1. / (M_PI * expm1(p));
+            else
+                q = ML_POSINF;
+        }
+    }
+    else // the usual case, including e.g. df = 1.1
+    {
+        double x = 0., y = 0., log_P2 = 0.,
+               a = 1 / (ndf - 0.5),
+               b = 48 / (a * a),
+               c = ((20700 * a / b - 98) * a - 16) * a + 96.36,
+               d = ((94.5 / (b + c) - 3) / b + 1) * sqrt(a * M_PI_2) * ndf;
+
+        int P_ok1 = P > DBL_MIN || !log_p, P_ok = P_ok1;
+        if (P_ok1)
+        {
+            y = pow(d * P, 2.0 / ndf);
+            P_ok = (y >= DBL_EPSILON);
+        }
+        if (!P_ok) // log_p and P very small, or (d*P)^(2/df) =: y < eps_c
+        {
+            log_P2 = is_neg_lower ? R_D_log(p) : R_D_LExp(p); // == log(P / 2)
+            x = (log(d) + M_LN2 + log_P2) / ndf;
+            y = exp(2 * x);
+        }
+
+        if ((ndf < 2.1 && P > 0.5) || y > 0.05 + a) // P > P0(df)
+        {
+            // asymptotic inverse expansion about the normal
+
+            if (P_ok)
+                x = qnorm(0.5 * P, 0., 1., /*lower_tail*/ 1, /*log_p*/ 0);
+            else // log_p and P underflowed
+                x = qnorm(log_P2, 0., 1., lower_tail, /*log_p*/ 1);
+
+            y = x * x;
+            if (ndf < 5)
+                c += 0.3 * (ndf - 4.5) * (x + 0.6);
+            c = (((0.05 * d * x - 5) * x - 7) * x - 2) * x + b + c;
+            y = (((((0.4 * y + 6.3) * y + 36) * y + 94.5) / c - y - 3) / b + 1) * x;
+            y = expm1(a * y * y);
+            q = sqrt(ndf * y);
+        }
+        else if (!P_ok && x < -M_LN2 * DBL_MANT_DIG) // 0.5 * log(DBL_EPSILON)
+        {
+            // y above might underflow
+
+            q = sqrt(ndf) * exp(-x);
+        }
+        else // re-use y from above
+        {
+            y = ((1 / (((ndf + 6) / (ndf * y) - 0.089 * d - 0.822) * (ndf + 2) * 3) +
+                  0.5 / (ndf + 4)) * y - 1) * (ndf + 1) / (ndf + 2) + 1 / y;
+            q = sqrt(ndf * y);
+        }
+
+        // the 2-term taylor expansion improvement (1-term = newton), as by
+        // hill (1981).
+
+        if (P_ok1)
+        {
+            int it = 0;
+            while (it++ < 10 && (y = dt(q, ndf, 0)) > 0 &&
+                   R_FINITE(x = (pt(q, ndf, 0, 0) - P / 2) / y) &&
+                   fabs(x) > 1e-14 * fabs(q))
+                q += x * (1. + x * q * (ndf + 1) / (2 * (q * q + ndf)));
+        }
+    }
+
+    if (neg)
+        q = -q;
+
+    return q;
+}
+
 double pt(double x, double n, int lower_tail, int log_p)
 {
     // return  P[ T <= x ]	where
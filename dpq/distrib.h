@@ -364,9 +364,27 @@ double gammafn(double x);
 double dnorm4(double x, double mu, double sigma, int give_log);
 double pnorm5(double x, double mu, double sigma, int lower_tail, int log_p);
 void pnorm_both(double x, double *cum, double *ccum, int i_tail, int log_p);
+double qnorm5(double p, double mu, double sigma, int lower_tail, int log_p);
 double dt(double x, double n, int give_log);
 double pt(double x, double n, int lower_tail, int log_p);
+double qt(double p, double ndf, int lower_tail, int log_p);
 double lbeta(double a, double b);
 
 #define dnorm dnorm4
-#define pnorm pnorm5
\ No newline at end of file
+#define pnorm pnorm5
+#define qnorm qnorm5
+// the array-in, array-out entry points (vector.c). each fills out[i] with what
+// the scalar function returns for the i-th values, splitting large arrays
+// across a pool of threads (the online processors, or as set by
+// distrib_threads). pnorm5_v evaluates its central regions in avx2 where the
+// cpu has it; the others loop over the scalar functions.
+
+void distrib_threads(int threads);
+void pnorm5_v(const double *x, double *out, size_t n,
+              double mu, double sigma, int lower_tail, int log_p);
+void pt_v(const double *x, const double *df, double *out, size_t n,
+          int lower_tail, int log_p);
+void pbeta_v(const double *x, double *out, size_t n,
+             double a, double b, int lower_tail, int log_p);
+void pf_v(const double *x, const double *df1, const double *df2, double *out, size_t n,
+          int lower_tail, int log_p);
@@ -0,0 +1,503 @@
+// the array-in, array-out entry points of the distributions. each returns
+// for every value what the scalar function returns for it, and splits large
+// arrays across a pool of threads.
+//
+// pnorm5_v has a kernel of its own. it standardizes four values at a time and
+// evaluates the rational functions of the two central regions of pnorm_both
+// (|z| <= 0.674 and |z| <= sqrt(32)) in avx2 registers, with the operations of
+// the scalar code in the same order, so the results do not change. a block of
+// the inner region is finished in the registers too. the outer region still
+// takes exp of each value, and the tails, nan and inf go to pnorm5. cpus
+// without avx2, and other targets, take the scalar loop.
+//
+// pt_v, pbeta_v and pf_v loop over the scalar functions. their regions run
+// through lgamma, log1p and the continued fractions of bratio, whose number of
+// terms differs from value to value, so they are only split across threads.
+
+// the scalar functions keep no state between calls (the lazily initialized
+// constants of rmath are compiled out unless NOMORE_FOR_THREADS), so the
+// entry points are safe to call from several threads at once.
+
+#include "distrib.h"
+
+#include <string.h>
+#include <stdatomic.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define vector_avx2
+#endif
+
+// the number of values below which an array is not split across threads,
+// and the number of threads (0 for the online processors). the count is read
+// once per call, so a caller changing it does not tear another's call.
+
+#define split_min 16384
+
+static atomic_int vector_threads = 0;
+
+void distrib_threads(int threads)
+{
+    atomic_store(&vector_threads, threads);
+}
+
+static int thread_count(size_t n)
+{
+    int threads = atomic_load(&vector_threads);
+
+#ifndef _WIN32
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    if (threads < 1)
+        threads = 1;
+    if ((size_t)threads > n / split_min)
+        threads = (int)(n / split_min);
+    return threads < 1 ? 1 : threads;
+}
+
+// one call of a kernel on a contiguous range of the arrays.
+
+typedef struct vector_call vector_call_t;
+
+typedef struct vector_task {
+    void (*kernel)(struct vector_task *task, size_t begin, size_t end);
+    const double *x;
+    const double *p1;
+    const double *p2;
+    double s1;
+    double s2;
+    double *out;
+    int lower_tail;
+    int log_p;
+    size_t begin;
+    size_t end;
+    vector_call_t *call;
+    struct vector_task *next;
+} vector_task_t;
+
+#ifndef _WIN32
+
+// the pool. workers are started on demand, up to the largest count a call
+// has asked for, and then wait on the queue for the slices of later calls
+// for the life of the process. a call counts its slices still queued or
+// running, and its caller waits on that count.
+
+struct vector_call {
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    int pending;
+};
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;
+static vector_task_t *pool_head = NULL;
+static vector_task_t *pool_tail = NULL;
+static int pool_workers = 0;
+
+static void task_finish(vector_task_t *task)
+{
+    vector_call_t *call = task->call;
+    pthread_mutex_lock(&call->lock);
+    if (--call->pending == 0)
+        pthread_cond_signal(&call->done);
+    pthread_mutex_unlock(&call->lock);
+}
+
+// pops the first queued slice, or null. the pool lock is held.
+
+static vector_task_t *pool_pop()
+{
+    vector_task_t *task = pool_head;
+    if (task)
+    {
+        pool_head = task->next;
+        if (pool_head == NULL)
+            pool_tail = NULL;
+    }
+    return task;
+}
+
+static void *pool_worker(void *arg)
+{
+    (void)arg;
+    for (;;)
+    {
+        pthread_mutex_lock(&pool_lock);
+        vector_task_t *task;
+        while ((task = pool_pop()) == NULL)
+            pthread_cond_wait(&pool_wake, &pool_lock);
+        pthread_mutex_unlock(&pool_lock);
+
+        task->kernel(task, task->begin, task->end);
+        task_finish(task);
+    }
+    return NULL;
+}
+
+// queues the slices and starts the workers missing for them. a worker that
+// cannot be started is not fatal: the caller drains the queue itself.
+
+static void pool_submit(vector_task_t *tasks, int count)
+{
+    pthread_mutex_lock(&pool_lock);
+
+    for (int t = 0; t < count; t++)
+    {
+        tasks[t].next = NULL;
+        if (pool_tail)
+            pool_tail->next = &tasks[t];
+        else
+            pool_head = &tasks[t];
+        pool_tail = &tasks[t];
+    }
+
+    while (pool_workers < count)
+    {
+        pthread_t worker;
+        if (pthread_create(&worker, NULL, pool_worker, NULL) != 0)
+            break;
+        pthread_detach(worker);
+        pool_workers++;
+    }
+
+    pthread_cond_broadcast(&pool_wake);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+#endif
+
+// run the kernel over [0, n), on contiguous slices of the arrays, one per
+// thread. the calling thread takes the first slice, and then any slice still
+// queued, before it waits for the rest.
+
+static void vector_run(vector_task_t *task, size_t n)
+{
+    int threads = thread_count(n);
+
+#ifndef _WIN32
+    if (threads > 1)
+    {
+        vector_task_t *tasks = (vector_task_t *)malloc(sizeof(vector_task_t) * threads);
+        vector_call_t call;
+        size_t step = (n + threads - 1) / threads;
+
+        pthread_mutex_init(&call.lock, NULL);
+        pthread_cond_init(&call.done, NULL);
+        call.pending = threads - 1;
+
+        for (int t = 0; t < threads; t++)
+        {
+            tasks[t] = *task;
+            tasks[t].begin = step * t < n ? step * t : n;
+            tasks[t].end = step * (t + 1) < n ? step * (t + 1) : n;
+            tasks[t].call = &call;
+        }
+
+        pool_submit(tasks + 1, threads - 1);
+        task->kernel(&tasks[0], tasks[0].begin, tasks[0].end);
+
+        for (;;)
+        {
+            pthread_mutex_lock(&pool_lock);
+            vector_task_t *queued = pool_pop();
+            pthread_mutex_unlock(&pool_lock);
+            if (queued == NULL)
+                break;
+            queued->kernel(queued, queued->begin, queued->end);
+            task_finish(queued);
+        }
+
+        pthread_mutex_lock(&call.lock);
+        while (call.pending > 0)
+            pthread_cond_wait(&call.done, &call.lock);
+        pthread_mutex_unlock(&call.lock);
+
+        pthread_mutex_destroy(&call.lock);
+        pthread_cond_destroy(&call.done);
+        free(tasks);
+        return;
+    }
+#endif
+
+    task->kernel(task, 0, n);
+}
+
+// ============================================================================
+
+// the standard normal distribution.
+
+#ifdef vector_avx2
+
+#define SIXTEN 16
+
+// the coefficients of the two central regions of pnorm_both.
+
+static const double pnorm_a[5] = {
+    2.2352520354606839287,
+    161.02823106855587881,
+    1067.6894854603709582,
+    18154.981253343561249,
+    0.065682337918207449113};
+static const double pnorm_b[4] = {
+    47.20258190468824187,
+    976.09855173777669322,
+    10260.932208618978205,
+    45507.789335026729956};
+static const double pnorm_c[9] = {
+    0.39894151208813466764,
+    8.8831497943883759412,
+    93.506656132177855979,
+    597.27027639480026226,
+    2494.5375852903726711,
+    6848.1904505362823326,
+    11602.651437647350124,
+    9842.7148383839780218,
+    1.0765576773720192317e-8};
+static const double pnorm_d[8] = {
+    22.266688044328115691,
+    235.38790178262499861,
+    1519.377599407554805,
+    6485.558298266760755,
+    18615.571640885098091,
+    34900.952721145977266,
+    38912.003286093271411,
+    19685.429676859990727};
+
+// finishes one value z of the middle region from its rational function
+// temp, as do_del and swap_tail of pnorm_both. the tail holding the smaller
+// probability is the lower one for z <= 0.
+
+static double pnorm_middle(double z, double temp, int lower_tail, int log_p)
+{
+    double y = fabs(z);
+    double xsq = trunc(y * SIXTEN) / SIXTEN;
+    double del = (y - xsq) * (y + xsq);
+    int small = lower_tail ? z <= 0. : z > 0.;
+
+    if (log_p)
+    {
+        if (small)
+            return (-xsq * xsq * 0.5) + (-del * 0.5) + log(temp);
+        return log1p(-exp(-xsq * xsq * 0.5) * exp(-del * 0.5) * temp);
+    }
+
+    double cum = exp(-xsq * xsq * 0.5) * exp(-del * 0.5) * temp;
+    return small ? cum : 1.0 - cum;
+}
+
+// evaluates [begin, end) four values at a time, and returns where it
+// stopped (the last values, fewer than four, are left to the caller).
+
+__attribute__((target("avx2")))
+static size_t pnorm_avx2(vector_task_t *task, size_t begin, size_t end)
+{
+    const double *x = task->x;
+    double *out = task->out;
+    double mu = task->s1, sigma = task->s2;
+    int lower_tail = task->lower_tail, log_p = task->log_p;
+
+    const __m256d vmu = _mm256_set1_pd(mu);
+    const __m256d vsigma = _mm256_set1_pd(sigma);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d eps = _mm256_set1_pd(DBL_EPSILON * 0.5);
+    const __m256d inner_max = _mm256_set1_pd(0.67448975);
+    const __m256d middle_max = _mm256_set1_pd(M_SQRT_32);
+
+    double z[4], inner[4], middle[4];
+    size_t i = begin;
+
+    for (; i + 4 <= end; i += 4)
+    {
+        __m256d vz = _mm256_div_pd(_mm256_sub_pd(_mm256_loadu_pd(x + i), vmu), vsigma);
+        __m256d vy = _mm256_andnot_pd(sign, vz);
+
+        // the inner region, with xnum = xden = 0 below eps.
+
+        __m256d xsq = _mm256_mul_pd(vz, vz);
+        __m256d xnum = _mm256_mul_pd(_mm256_set1_pd(pnorm_a[4]), xsq);
+        __m256d xden = xsq;
+        for (int k = 0; k < 3; k++)
+        {
+            xnum = _mm256_mul_pd(_mm256_add_pd(xnum, _mm256_set1_pd(pnorm_a[k])), xsq);
+            xden = _mm256_mul_pd(_mm256_add_pd(xden, _mm256_set1_pd(pnorm_b[k])), xsq);
+        }
+
+        __m256d tiny = _mm256_cmp_pd(vy, eps, _CMP_LE_OQ);
+        xnum = _mm256_blendv_pd(xnum, zero, tiny);
+        xden = _mm256_blendv_pd(xden, zero, tiny);
+        __m256d vinner = _mm256_div_pd(
+            _mm256_mul_pd(vz, _mm256_add_pd(xnum, _mm256_set1_pd(pnorm_a[3]))),
+            _mm256_add_pd(xden, _mm256_set1_pd(pnorm_b[3])));
+
+        int in_inner = _mm256_movemask_pd(_mm256_cmp_pd(vy, inner_max, _CMP_LE_OQ));
+        if (in_inner == 0xf && !log_p)
+        {
+            _mm256_storeu_pd(out + i, lower_tail
+                                          ? _mm256_add_pd(half, vinner)
+                                          : _mm256_sub_pd(half, vinner));
+            continue;
+        }
+
+        // the middle region, up to its exponentials.
+
+        xnum = _mm256_mul_pd(_mm256_set1_pd(pnorm_c[8]), vy);
+        xden = vy;
+        for (int k = 0; k < 7; k++)
+        {
+            xnum = _mm256_mul_pd(_mm256_add_pd(xnum, _mm256_set1_pd(pnorm_c[k])), vy);
+            xden = _mm256_mul_pd(_mm256_add_pd(xden, _mm256_set1_pd(pnorm_d[k])), vy);
+        }
+        __m256d vmiddle = _mm256_div_pd(
+            _mm256_add_pd(xnum, _mm256_set1_pd(pnorm_c[7])),
+            _mm256_add_pd(xden, _mm256_set1_pd(pnorm_d[7])));
+
+        int in_middle = _mm256_movemask_pd(_mm256_cmp_pd(vy, middle_max, _CMP_LE_OQ));
+
+        _mm256_storeu_pd(z, vz);
+        _mm256_storeu_pd(inner, vinner);
+        _mm256_storeu_pd(middle, vmiddle);
+
+        for (int k = 0; k < 4; k++)
+        {
+            if (in_inner & (1 << k))
+            {
+                double p = lower_tail ? 0.5 + inner[k] : 0.5 - inner[k];
+                out[i + k] = log_p ? log(p) : p;
+            }
+            else if (in_middle & (1 << k))
+                out[i + k] = pnorm_middle(z[k], middle[k], lower_tail, log_p);
+            else
+                out[i + k] = pnorm5(x[i + k], mu, sigma, lower_tail, log_p);
+        }
+    }
+
+    return i;
+}
+
+#endif
+
+static void pnorm_kernel(vector_task_t *task, size_t begin, size_t end)
+{
+    size_t i = begin;
+
+#ifdef vector_avx2
+    // a nan or non-positive sigma, or a nan mu, is left to pnorm5 whole.
+
+    if (task->s2 > 0 && R_FINITE(task->s1) && R_FINITE(task->s2) &&
+        __builtin_cpu_supports("avx2"))
+        i = pnorm_avx2(task, begin, end);
+#endif
+
+    for (; i < end; i++)
+        task->out[i] = pnorm5(task->x[i], task->s1, task->s2, task->lower_tail, task->log_p);
+}
+
+// out[i] = pnorm5(x[i], mu, sigma, lower_tail, log_p), for i in [0, n).
+
+void pnorm5_v(
+    const double *x, double *out, size_t n,
+    double mu, double sigma, int lower_tail, int log_p)
+{
+    vector_task_t task;
+    memset(&task, 0, sizeof(task));
+    task.kernel = pnorm_kernel;
+    task.x = x;
+    task.out = out;
+    task.s1 = mu;
+    task.s2 = sigma;
+    task.lower_tail = lower_tail;
+    task.log_p = log_p;
+    vector_run(&task, n);
+}
+
+// ============================================================================
+
+// the student t distribution, with the degrees of freedom of each value.
+
+static void pt_kernel(vector_task_t *task, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++)
+        task->out[i] = pt(task->x[i], task->p1[i], task->lower_tail, task->log_p);
+}
+
+// out[i] = pt(x[i], df[i], lower_tail, log_p), for i in [0, n).
+
+void pt_v(
+    const double *x, const double *df, double *out, size_t n,
+    int lower_tail, int log_p)
+{
+    vector_task_t task;
+    memset(&task, 0, sizeof(task));
+    task.kernel = pt_kernel;
+    task.x = x;
+    task.p1 = df;
+    task.out = out;
+    task.lower_tail = lower_tail;
+    task.log_p = log_p;
+    vector_run(&task, n);
+}
+
+// ============================================================================
+
+// the beta distribution, with shapes a and b shared by the values.
+
+static void pbeta_kernel(vector_task_t *task, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++)
+        task->out[i] = pbeta(task->x[i], task->s1, task->s2, task->lower_tail, task->log_p);
+}
+
+// out[i] = pbeta(x[i], a, b, lower_tail, log_p), for i in [0, n).
+
+void pbeta_v(
+    const double *x, double *out, size_t n,
+    double a, double b, int lower_tail, int log_p)
+{
+    vector_task_t task;
+    memset(&task, 0, sizeof(task));
+    task.kernel = pbeta_kernel;
+    task.x = x;
+    task.out = out;
+    task.s1 = a;
+    task.s2 = b;
+    task.lower_tail = lower_tail;
+    task.log_p = log_p;
+    vector_run(&task, n);
+}
+
+// ============================================================================
+
+// the f distribution, with the degrees of freedom of each value.
+
+static void pf_kernel(vector_task_t *task, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++)
+        task->out[i] = pf(task->x[i], task->p1[i], task->p2[i], task->lower_tail, task->log_p);
+}
+
+// out[i] = pf(x[i], df1[i], df2[i], lower_tail, log_p), for i in [0, n).
+
+void pf_v(
+    const double *x, const double *df1, const double *df2, double *out, size_t n,
+    int lower_tail, int log_p)
+{
+    vector_task_t task;
+    memset(&task, 0, sizeof(task));
+    task.kernel = pf_kernel;
+    task.x = x;
+    task.p1 = df1;
+    task.p2 = df2;
+    task.out = out;
+    task.lower_tail = lower_tail;
+    task.log_p = log_p;
+    vector_run(&task, n);
+}
@@ -0,0 +1,229 @@
+
+//    Copyright (C) 2024 Zheng Yang <xornent@outlook.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "quick.h"
+
+#include <random>
+#include <algorithm>
+
+extern "C" {
+#include "dpq/distrib.h"
+}
+
+// the least replicates of a sample before it may stop, and the confidence
+// level of the intervals.
+
+int quick_least = 3;
+double quick_level = 0.95;
+
+// segment the rows of the batch sample by sample until the interval of each
+// sample is narrower than width. the first round takes quick_least rois of
+// every sample, and each later round one more roi of every sample not yet
+// converged, so that a round still spreads over the workers. the rows of the
+// batch carry the encoded source files (read once, and hashed from the same
+// bytes) but no pixels: the rois are decoded as their rounds take them, and
+// segmented under the budget (in bytes, 0 for none) as described below. the segmented rows are written to the sink in uid
+// order (as the sinks expect), and their count returned. the samples are
+// summarized in quick.tsv under datapath.
+//
+// a skipped uid keeps its previous result (is added to kept) only if that was
+// derived from the same rois.tsv row and the same source image, as checked by
+// --incremental. the previous results of the others are dropped, since they
+// no longer describe the roi.
+
+int segment_quick(
+    segmenter_t& seg, roi_batch_t& batch, double width, int jobs, bool use_cache,
+    double budget, double footprint, sink_t& sink, std::set<int>& kept,
+    const char* datapath)
+{
+    std::vector<quick_sample_t> samples;
+    std::map<std::string, int> index;
+
+    for (int i = 0; i < batch_size(batch); i++) {
+        std::string name(batch_name(batch, i));
+        auto found = index.find(name);
+        if (found == index.end()) {
+            quick_sample_t sample = {};
+            sample.name = name;
+            index[name] = samples.size();
+            samples.push_back(sample);
+            found = index.find(name);
+        }
+
+        samples[found->second].rows.push_back(i);
+    }
+
+    // the order of the rois of a sample is shuffled with a fixed seed per
+    // sample, so that a run is reproducible.
+
+    for (size_t s = 0; s < samples.size(); s++) {
+        std::mt19937 rng(42 + s);
+        std::shuffle(samples[s].rows.begin(), samples[s].rows.end(), rng);
+    }
+
+    roi_batch_t segmented;
+    for (int round = 0; ; round++) {
+        roi_batch_t part;
+        std::vector<int> owner;
+
+        for (size_t s = 0; s < samples.size(); s++) {
+            quick_sample_t& sample = samples[s];
+            size_t take = round == 0 ? quick_least : 1;
+            for (size_t k = 0; k < take && !sample.converged &&
+                 sample.taken < sample.rows.size(); k++) {
+                batch_take(part, batch, sample.rows[sample.taken++]);
+                owner.push_back(s);
+            }
+        }
+
+        if (batch_size(part) == 0) break;
+
+        // the rois of the round are decoded here, in chunks whose estimated
+        // footprint (footprint bytes per roi pixel) fits in the budget, if
+        // any. a chunk writes its images and drops its matrices once
+        // measured, so only the measures are held to the end.
+
+        for (int begin = 0, end = 0; begin < batch_size(part); begin = end) {
+            roi_batch_t chunk;
+            double pending = 0;
+            for (; end < batch_size(part); end++) {
+                char fname[1024];
+                snprintf(fname, sizeof(fname), "%s/sources/%d.jpg", datapath, part.uid.at(end));
+
+                if (budget > 0) {
+                    int w = 0, h = 0;
+                    double bytes = image_size(fname, w, h) ? (double) w * h * footprint : 0;
+                    if (end > begin && pending + bytes > budget) break;
+                    pending += bytes;
+                }
+
+                batch_take(chunk, part, end);
+                stage_timer_t timer("decode", part.uid.at(end));
+                chunk.rois.back() = decode_roi(chunk.encoded.back());
+                std::vector<uchar>().swap(chunk.encoded.back());
+            }
+
+            if (budget > 0)
+                printf("[i] quick: segmenting %d rois (about %.0f mb). \n",
+                       batch_size(chunk), pending / (1024 * 1024));
+
+            segment_batch(seg, chunk, jobs, use_cache, false);
+            batch_measure(chunk, use_cache);
+
+            // the running mean and variance (welford) of log.abs, over the
+            // rois that reach stats.tsv.
+
+            double values[8];
+            for (int i = 0; i < batch_size(chunk); i++) {
+                result_row_t row = {
+                    chunk.uid.at(i), batch_fname(chunk, i), chunk.sid.at(i), batch_name(chunk, i),
+                    (bool) chunk.det_success.at(i), (bool) chunk.scale_success.at(i),
+                    chunk.scale_dark.at(i), chunk.scale_light.at(i), chunk.measures.at(i)
+                };
+                row.measures.detected = chunk.has_foreground.at(i);
+
+                if (stat_values(row, values)) {
+                    quick_sample_t& sample = samples[owner[begin + i]];
+                    sample.n += 1;
+                    double delta = values[0] - sample.mean;
+                    sample.mean += delta / sample.n;
+                    sample.m2 += delta * (values[0] - sample.mean);
+                }
+
+                stage_timer_t timer("write", chunk.uid.at(i));
+                sink_images(sink, chunk, i);
+                timer.stop();
+
+                batch_release(chunk, i);
+                batch_take(segmented, chunk, i);
+            }
+        }
+
+        int active = 0;
+        for (auto& sample : samples) {
+            if (sample.n >= 2) {
+                double half = qt(1 - (1 - quick_level) / 2, sample.n - 1, 1, 0) *
+                    sqrt(sample.m2 / (sample.n - 1) / sample.n);
+                sample.low = sample.mean - half;
+                sample.high = sample.mean + half;
+                if (sample.n >= (uint64_t) quick_least && 2 * half <= width)
+                    sample.converged = true;
+            }
+
+            if (!sample.converged && sample.taken < sample.rows.size()) active += 1;
+        }
+
+        printf("[i] quick: round %d, %d rois segmented, %d samples continue. \n",
+               round + 1, batch_size(part), active);
+    }
+
+    // the skipped uids, and the segmented rows in uid order.
+
+    int saved = 0, converged = 0, current = 0;
+    for (auto& sample : samples) {
+        for (size_t k = sample.taken; k < sample.rows.size(); k++) {
+            int i = sample.rows[k];
+            bool stale = sink_stale(
+                sink, batch.uid.at(i), batch_fname(batch, i), batch.sid.at(i),
+                batch_name(batch, i), batch.det_success.at(i), batch.scale_success.at(i),
+                batch.scale_dark.at(i), batch.scale_light.at(i), batch.source.at(i));
+            if (stale) continue;
+            kept.insert(batch.uid.at(i));
+            current += 1;
+        }
+
+        saved += sample.rows.size() - sample.taken;
+        converged += sample.converged;
+    }
+
+    roi_batch_t done;
+    std::vector<int> order(batch_size(segmented));
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        return segmented.uid[a] < segmented.uid[b];
+    });
+    for (int i : order) batch_take(done, segmented, i);
+    sink_write(sink, done, kept, use_cache, false);
+
+    printf("[i] quick: %d of %d rois segmented, %d saved. %d of %zu samples converged. \n",
+           batch_size(done), batch_size(batch), saved, converged, samples.size());
+    printf("[i] quick: %d skipped rois keep their previous results, %d have none. \n",
+           current, saved - current);
+
+    // the summary: sample, rois, segmented, saved, the replicates in stats.tsv,
+    // the mean of log.abs and its interval, and whether it converged.
+
+    std::string path = std::string(datapath) + "/quick.tsv";
+    FILE* out = fopen(path.c_str(), "w");
+    if (out == NULL) {
+        printf("[!] cannot write %s. \n", path.c_str());
+        return batch_size(done);
+    }
+
+    fprintf(out, "sample\trois\tsegmented\tsaved\tn\tmean\tci.low\tci.high\tconverged\n");
+    for (auto& sample : samples) {
+        fprintf(out, "%s\t%zu\t%zu\t%zu\t%llu", sample.name.c_str(), sample.rows.size(),
+                sample.taken, sample.rows.size() - sample.taken, (unsigned long long) sample.n);
+        if (sample.n >= 1) fprintf(out, "\t%.5f", sample.mean);
+        else fprintf(out, "\tNA");
+        if (sample.n >= 2) fprintf(out, "\t%.5f\t%.5f", sample.low, sample.high);
+        else fprintf(out, "\tNA\tNA");
+        fprintf(out, "\t%c\n", sample.converged ? 'x' : '.');
+    }
+
+    fclose(out);
+    return batch_size(done);
+}
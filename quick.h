@@ -0,0 +1,43 @@
+
+//    Copyright (C) 2024 Zheng Yang <xornent@outlook.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "blob.h"
+
+// the progressive early-stopping mode of blobshed and blobnn (--quick). the
+// rois of each sample are segmented in a shuffled order, a few at a time, and
+// a sample stops once the t confidence interval of its mean log.abs is
+// narrower than the target width. the rest of its rois are skipped.
+
+typedef struct quick_sample {
+    std::string name;
+    std::vector<int> rows;
+    size_t taken;
+    uint64_t n;
+    double mean;
+    double m2;
+    double low;
+    double high;
+    bool converged;
+} quick_sample_t;
+
+extern int quick_least;
+extern double quick_level;
+
+int segment_quick(
+    segmenter_t& seg, roi_batch_t& batch, double width, int jobs, bool use_cache,
+    double budget, double footprint, sink_t& sink, std::set<int>& kept,
+    const char* datapath
+);
@@ -0,0 +1,269 @@
+
+//    Copyright (C) 2024 Zheng Yang <xornent@outlook.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "unet.h"
+
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+#include <opencv2/opencv.hpp>
+
+#include "torch/script.h"
+#include "torch/torch.h"
+
+// ============================================================================
+
+// the unet segmenter (blobnn). the rois are reversed and passed through the
+// torch script model, and the prediction is thresholded at the cutoff into the
+// foreground blobs. the model is loaded once by unet_open.
+
+int unet_cutoff = 180;
+
+static torch::jit::Module model;
+static char modelfpath[1024] = "";
+static bool isgpu = false;
+
+// load the model onto the gpu if cuda and cudnn are available, or the cpu.
+
+bool unet_open(const char* path)
+{
+    strcpy(modelfpath, path);
+    if (fs::is_regular_file(modelfpath)) {
+
+        printf("[i] loading model file from: %s ... \n", modelfpath);
+        std::string modelf(modelfpath);
+        model = torch::jit::load(modelf);
+        printf("[i] loading model file successfully. \n");
+
+        bool gpu = true;
+        if (torch::cuda::is_available()) {
+            printf("[i] cuda available on this device. \n");
+        }
+        else {
+            printf("[i] no gpu or no corrected cuda driver installed. \n");
+            gpu = false;
+        }
+
+        if (gpu && torch::cuda::cudnn_is_available()) {
+            printf("[i] cudnn available on this device. \n");
+        }
+        else gpu = false;
+
+        if (gpu) {
+            printf("[i] found %ld available gpu(s) installed on this device. \n",
+                   torch::cuda::device_count());
+
+            printf("[i] transporting model to cuda \n");
+            model.eval();
+            model.to(at::kCUDA);
+            isgpu = true;
+        }
+        else {
+            printf("[i] transporting model to cpu \n");
+            model.eval();
+            model.to(at::kCPU);
+            isgpu = false;
+        }
+    }
+    else {
+        printf("[e] pytorch model not found or invalid! \n");
+        return false;
+    }
+
+    return true;
+}
+
+// the seed of cache keys. the model is hashed by its content, so that
+// retrained models with the same file name do not hit the stale entries.
+
+uint64_t unet_params()
+{
+    const char tag[] = "spblob:blobnn 1.5";
+    uint64_t h = hash_bytes(tag, sizeof(tag), 0);
+    h = hash_bytes(&unet_cutoff, sizeof(unet_cutoff), h);
+    h = hash_file(modelfpath, h);
+    return h;
+}
+
+void unet_segment(bool show_msg, roi_batch_t& batch, roi_slice_t slice)
+{
+    for (int i = slice.begin; i < slice.end; i++)
+    {
+        cv::Mat& roi = batch.rois[i];
+        if (!batch.det_success[i]) {
+            batch.back_strict[i] = cv::Mat(cv::Size(3, 3), CV_8U, cv::Scalar(0));
+            batch.back_loose[i] = cv::Mat(cv::Size(3, 3), CV_8U, cv::Scalar(0));
+            batch.foreground[i] = cv::Mat(cv::Size(3, 3), CV_8U, cv::Scalar(0));
+            batch.overlap[i] = cv::Mat(cv::Size(3, 3), CV_8U, cv::Scalar(0));
+            batch.prediction[i] = cv::Mat(cv::Size(3, 3), CV_8U, cv::Scalar(0));
+            batch.has_foreground[i] = false;
+            printf("[!] detection %d failed.                                \r",
+                batch.uid[i]);
+            continue;
+        }
+
+        if (batch.hit[i]) continue;
+
+        stage_timer_t span("roi", batch.uid[i]);
+        cv::Mat bgstrict, bgloose, fg, ol;
+        cv::cvtColor(roi, ol, cv::COLOR_GRAY2BGR);
+        cv::Mat red(roi.size(), CV_8UC3, cv::Scalar(0, 0, 255));
+        cv::Mat green(roi.size(), CV_8UC3, cv::Scalar(0, 255, 0));
+        cv::Mat blue(roi.size(), CV_8UC3, cv::Scalar(255, 0, 0));
+        bool detected = false;
+
+        stage_timer_t inference("inference", batch.uid[i]);
+
+        // we first need to reverse the source image. since in our neural network, blobs
+        // with reversed pixel values are generated for training, to make the blob regions
+        // have higher values.
+
+        cv::Mat roirev;
+        roi.copyTo(roirev);
+        reverse(roirev);
+
+        torch::Tensor tensor_image = torch::from_blob(
+            roirev.data, { roi.rows, roi.cols, 1 }, torch::kByte);
+        tensor_image = tensor_image.permute({ 2, 0, 1 });
+        tensor_image = tensor_image.toType(torch::kFloat);
+        tensor_image = tensor_image.unsqueeze(0);
+
+        if (isgpu) tensor_image = tensor_image.to(at::kCUDA);
+        else tensor_image = tensor_image.to(at::kCPU);
+
+        at::Tensor output = model.forward({ tensor_image }).toTensor();
+
+        // here, we assume that the first two dimensions of the image is both 1. meaning
+        // that we explicitly disables batch processing in the forwarding step. the classes
+        // (dimension 2) is always zero because the model gives one-channel prediction.
+
+        output = output.squeeze(0).squeeze(0).detach();
+        output = output.mul(255).clamp(0, 255).to(torch::kU8);
+        output = output.to(torch::kCPU);
+
+        // cv::Mat outcv(roi.rows, roi.cols, CV_8U);
+        // std::memcpy(
+        //     (void *) outcv.data, output.data_ptr(),
+        //     sizeof(torch::kU8) * output.numel()
+        // );
+
+        cv::Mat outcv(cv::Size(roi.cols, roi.rows), CV_8U, output.data_ptr());
+        cv::Mat copycv;
+        outcv.copyTo(copycv);
+        batch.prediction[i] = copycv;
+        inference.stop();
+
+        stage_timer_t postprocess("postprocess", batch.uid[i]);
+        cv::Mat binary;
+        cv::threshold(outcv, binary, unet_cutoff, 255, cv::THRESH_BINARY);
+        std::vector<std::vector<cv::Point>> contours;
+        cv::findContours(binary, contours, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+
+        int idc = 0;
+
+        // initialized to be blanked black.
+
+        fg = cv::Mat::zeros(roi.size(), CV_8U);
+        bgloose = cv::Mat::zeros(roi.size(), CV_8U);
+
+        std::vector<std::vector<cv::Point>> bginits;
+        std::vector<cv::Point> bginit1;
+        int padding = 5;
+
+        bginit1.push_back(cv::Point(padding, padding));
+        bginit1.push_back(cv::Point(roi.cols - padding, padding));
+        bginit1.push_back(cv::Point(roi.cols - padding, roi.rows - padding));
+        bginit1.push_back(cv::Point(padding, roi.rows - padding));
+        bginits.push_back(bginit1);
+        
+        cv::drawContours(bgloose, bginits, 0, cv::Scalar(255), cv::FILLED);
+
+        for (auto cont : contours) {
+            
+            double lenconts = cv::arcLength(cont, true);
+            double area = cv::contourArea(cont, false);
+            double ratio = lenconts * lenconts / area;
+
+            if (area > 1000 && area < 50000) {
+                
+                cv::drawContours(fg, contours, idc, cv::Scalar(255), cv::FILLED);
+                cv::drawContours(ol, contours, idc, cv::Scalar(0, 0, 255), 2);
+                detected = true;
+
+                // draw the background masks.
+                // neural network model does not produce a background detection,
+                // we should just have the left and surrounding part of the surface
+                // only to avoid inclusion of the righter dark lines.
+
+                cv::Rect bounds = cv::boundingRect(cont);
+                std::vector<std::vector<cv::Point>> bgcont;
+                std::vector<cv::Point> bgcont1;
+                
+                bgcont1.push_back(cv::Point(bounds.x + bounds.width, 0));
+                bgcont1.push_back(cv::Point(roi.cols, 0));
+                bgcont1.push_back(cv::Point(roi.cols, roi.rows));
+                bgcont1.push_back(cv::Point(bounds.x + bounds.width, roi.rows));
+                bgcont.push_back(bgcont1);
+
+                cv::drawContours(bgloose, bgcont, 0, cv::Scalar(0), cv::FILLED);
+                cv::drawContours(bgloose, contours, idc, cv::Scalar(0), cv::FILLED);
+
+                // we noticed that some neural network modules may be trained
+                // to report hollow circles with two (inner and outer) boundaries,
+                // however, these models seldom report excess detections, we may just
+                // stack these detections together (likely union). so we do not break.
+                
+                // break;
+            }
+            else cv::drawContours(ol, contours, idc, cv::Scalar(0, 0, 0), 1);
+            idc++;
+        }
+
+        cv::Mat kernel_full = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
+        cv::morphologyEx(
+            bgloose, bgstrict,
+            cv::MORPH_ERODE, kernel_full,
+            cv::Point(-1, -1), padding
+        );
+
+        // draw the visualization map.
+
+        cv::Mat temp1, temp2, temp3;
+        cv::bitwise_and(blue, blue, temp1, bgloose);
+        cv::bitwise_and(green, green, temp2, bgstrict);
+        cv::bitwise_and(red, red, temp3, fg);
+        cv::addWeighted(temp1, 0.3, ol, 0.7, 0, ol);
+        cv::addWeighted(temp2, 0.3, ol, 0.7, 0, ol);
+        cv::addWeighted(temp3, 0.3, ol, 0.7, 0, ol);
+
+        batch.back_strict[i] = bgstrict;
+        batch.back_loose[i] = bgloose;
+        batch.foreground[i] = fg;
+        batch.overlap[i] = ol;
+        batch.has_foreground[i] = detected;
+        postprocess.stop();
+
+        double seconds = span.stop() / 1000;
+        if (show_msg)
+            printf("[i] processing detection %d ... %.2f s \r", batch.uid[i], seconds);
+    }
+}
+
+// the inference runs on the one model, so the batch is one slice.
+
+segmenter_t unet_segmenter = { "unet", 4, true, unet_params, unet_segment };